@@ -0,0 +1,477 @@
+/*
+  ==============================================================================
+
+    Headless benchmarks for state save/load, todo list operations and notes
+    updates. Results are printed and written as JSON so runs can be compared.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+#include "PluginEditor.h"
+#include "StateChunk.h"
+#include "TodoTransfer.h"
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+    struct Measurement
+    {
+        juce::String name;
+        int numItems = 0;
+        int notesBytes = 0;
+        int numChannels = 0;
+        int iterations = 0;
+        juce::int64 chunkBytes = 0; // size of the saved state, for the chunk format cases
+        double minMs = 0.0, medianMs = 0.0, meanMs = 0.0, maxMs = 0.0;
+    };
+
+    double ticksToMs (juce::int64 ticks)
+    {
+        return juce::Time::highResolutionTicksToSeconds (ticks) * 1000.0;
+    }
+
+    // Runs setup untimed before every iteration, then times body.
+    // The returned measurement is the given case with the timings filled in.
+    Measurement measure (Measurement m, int iterations,
+                         const std::function<void (int)>& setup, const std::function<void (int)>& body)
+    {
+        std::vector<double> times;
+        times.reserve ((size_t) iterations);
+
+        for (int i = 0; i < iterations; ++i)
+        {
+            if (setup != nullptr)
+                setup (i);
+
+            auto start = juce::Time::getHighResolutionTicks();
+            body (i);
+            times.push_back (ticksToMs (juce::Time::getHighResolutionTicks() - start));
+        }
+
+        std::sort (times.begin(), times.end());
+
+        m.iterations = iterations;
+        m.minMs = times.front();
+        m.maxMs = times.back();
+        m.medianMs = times[times.size() / 2];
+
+        double total = 0.0;
+        for (auto t : times)
+            total += t;
+        m.meanMs = total / (double) times.size();
+
+        std::cout << m.name.paddedRight (' ', 36) << " items " << juce::String (m.numItems).paddedLeft (' ', 7)
+                  << "  notes " << juce::String (m.notesBytes).paddedLeft (' ', 9)
+                  << "  channels " << juce::String (m.numChannels).paddedLeft (' ', 3)
+                  << "  median " << juce::String (m.medianMs, 3).paddedLeft (' ', 10) << " ms";
+
+        if (m.chunkBytes > 0)
+            std::cout << "  chunk " << juce::String (m.chunkBytes).paddedLeft (' ', 10) << " bytes";
+
+        std::cout << std::endl;
+        return m;
+    }
+
+    juce::String makeNotes (int numBytes)
+    {
+        const juce::String line ("Bar 32: bring the vocal up 1 dB, check the reverb tail on the bridge\n");
+        juce::MemoryOutputStream notes ((size_t) numBytes + (size_t) line.length());
+        while ((int) notes.getDataSize() < numBytes)
+            notes << line;
+        return notes.toString().substring (0, numBytes);
+    }
+
+    void populate (NotePadAudioProcessor& processor, int numItems, const juce::String& notes)
+    {
+        auto& state = processor.treeState.state;
+        state.setProperty ("SessionText", notes, nullptr);
+
+        auto todoItems = state.getOrCreateChildWithName ("TodoItems", nullptr);
+        todoItems.removeAllChildren (nullptr);
+
+        for (int i = 0; i < numItems; ++i)
+        {
+            juce::ValueTree item ("TodoItem");
+            item.setProperty ("Id", (juce::int64) i + 1, nullptr);
+            item.setProperty ("Text", "Item " + juce::String (i) + " - fix the edit around marker " + juce::String (i % 97), nullptr);
+            item.setProperty ("Checked", juce::var (i % 3 == 0), nullptr);
+            todoItems.appendChild (item, nullptr);
+        }
+
+        todoItems.setProperty ("NextId", (juce::int64) numItems + 1, nullptr);
+    }
+
+    int iterationsFor (int numItems, int notesBytes)
+    {
+        auto size = juce::jmax (numItems * 64, notesBytes);
+        if (size >= 4 * 1024 * 1024)  return 3;
+        if (size >= 512 * 1024)       return 10;
+        return 50;
+    }
+
+    void runCase (int numItems, int notesBytes, std::vector<Measurement>& results)
+    {
+        auto notes = makeNotes (notesBytes);
+        auto iterations = iterationsFor (numItems, notesBytes);
+        auto testCase = [&] (const juce::String& name)
+        {
+            Measurement m;
+            m.name = name;
+            m.numItems = numItems;
+            m.notesBytes = notesBytes;
+            return m;
+        };
+
+        NotePadAudioProcessor processor;
+        populate (processor, numItems, notes);
+
+        juce::MemoryBlock chunk;
+        processor.getStateInformation (chunk);
+
+        // Content changes every iteration, so the cached chunk can't be reused
+        results.push_back (measure (testCase ("getStateInformation (changed)"), iterations,
+                                    [&] (int i) { processor.treeState.state.setProperty ("BenchmarkCounter", i, nullptr); },
+                                    [&] (int) { juce::MemoryBlock block; processor.getStateInformation (block); }));
+
+        results.push_back (measure (testCase ("getStateInformation (unchanged)"), iterations, nullptr,
+                                    [&] (int) { juce::MemoryBlock block; processor.getStateInformation (block); }));
+
+        processor.getStateInformation (chunk);
+
+        results.push_back (measure (testCase ("setStateInformation"), iterations, nullptr,
+                                    [&] (int) { processor.setStateInformation (chunk.getData(), (int) chunk.getSize()); }));
+
+        results.push_back (measure (testCase ("setStateInformation + hydrate"), iterations, nullptr,
+                                    [&] (int)
+                                    {
+                                        processor.setStateInformation (chunk.getData(), (int) chunk.getSize());
+                                        processor.ensureContentHydrated();
+                                    }));
+
+        // The same state saved and loaded as the XML chunk the plugin used to write, and as a
+        // StateChunk, with the size of each. Only the formats are timed, not the processor.
+        auto state = processor.treeState.copyState();
+        juce::MemoryBlock xmlChunk, stateChunk;
+        if (auto xml = state.createXml())
+            juce::AudioProcessor::copyXmlToBinary (*xml, xmlChunk);
+        StateChunk::write (state, stateChunk);
+
+        auto formatCase = [&] (const juce::String& name, const juce::MemoryBlock& formatChunk)
+        {
+            auto m = testCase (name);
+            m.chunkBytes = (juce::int64) formatChunk.getSize();
+            return m;
+        };
+
+        results.push_back (measure (formatCase ("XML chunk write", xmlChunk), iterations, nullptr,
+                                    [&] (int)
+                                    {
+                                        juce::MemoryBlock block;
+                                        if (auto xml = state.createXml())
+                                            juce::AudioProcessor::copyXmlToBinary (*xml, block);
+                                    }));
+
+        results.push_back (measure (formatCase ("XML chunk read", xmlChunk), iterations, nullptr,
+                                    [&] (int)
+                                    {
+                                        if (auto xml = juce::AudioProcessor::getXmlFromBinary (xmlChunk.getData(), (int) xmlChunk.getSize()))
+                                            juce::ValueTree::fromXml (*xml);
+                                    }));
+
+        results.push_back (measure (formatCase ("StateChunk write", stateChunk), iterations, nullptr,
+                                    [&] (int) { juce::MemoryBlock block; StateChunk::write (state, block); }));
+
+        results.push_back (measure (formatCase ("StateChunk read", stateChunk), iterations, nullptr,
+                                    [&] (int) { StateChunk::read (stateChunk.getData(), (int) stateChunk.getSize()); }));
+
+        // Both directions hold one item at a time, so these should grow linearly with the list
+        auto todoItems = processor.treeState.state.getChildWithName ("TodoItems");
+
+        for (auto format : { TodoTransfer::Format::markdown, TodoTransfer::Format::json, TodoTransfer::Format::csv })
+        {
+            juce::String formatName (format == TodoTransfer::Format::markdown ? "Markdown"
+                                        : format == TodoTransfer::Format::json ? "JSON" : "CSV");
+            juce::MemoryOutputStream exported;
+
+            results.push_back (measure (testCase ("Todo export (" + formatName + ")"), iterations,
+                                        [&] (int) { exported.reset(); },
+                                        [&] (int)
+                                        {
+                                            TodoTransfer::Writer writer (exported, format);
+                                            for (const auto& item : todoItems)
+                                                writer.writeItem (item);
+                                            writer.finish();
+                                        }));
+
+            results.push_back (measure (testCase ("Todo import (" + formatName + ")"), iterations, nullptr,
+                                        [&] (int)
+                                        {
+                                            juce::MemoryInputStream in (exported.getData(), exported.getDataSize(), false);
+                                            TodoTransfer::Reader reader (in, format);
+                                            juce::ValueTree item;
+                                            while (reader.readNext (item))
+                                                ;
+                                        }));
+        }
+
+        std::unique_ptr<juce::AudioProcessorEditor> editorHolder (processor.createEditor());
+        auto* editor = dynamic_cast<NotePadAudioProcessorEditor*> (editorHolder.get());
+        jassert (editor != nullptr);
+
+        results.push_back (measure (testCase ("refreshTodoList"), iterations, nullptr,
+                                    [&] (int) { editor->refreshTodoList(); }));
+
+        results.push_back (measure (testCase ("updateTodoItemsState"), iterations, nullptr,
+                                    [&] (int) { editor->updateTodoItemsState(); }));
+
+        // Selection only changes how two rows look, so this shouldn't grow with the list
+        results.push_back (measure (testCase ("moveSelection"), iterations, nullptr,
+                                    [&] (int i) { editor->moveSelection ((i & 1) != 0 ? -1 : 1); }));
+
+        results.push_back (measure (testCase ("reorderItems (first to last)"), iterations, nullptr,
+                                    [&] (int) { editor->reorderItems (0, numItems - 1); }));
+
+        // The journal holds just the removed node, so taking it back shouldn't grow with the list
+        results.push_back (measure (testCase ("deleteTodoItem + undo"), iterations, nullptr,
+                                    [&] (int)
+                                    {
+                                        editor->deleteTodoItem (numItems / 2);
+                                        editor->undoJournal.undo();
+                                    }));
+
+        results.push_back (measure (testCase ("filterItems"), iterations,
+                                    [&] (int) { editor->filterItems ({}); },
+                                    [&] (int i) { editor->filterItems ("marker " + juce::String (i % 97)); }));
+        editor->filterItems ({});
+
+        // One keystroke's worth of change, then the coalesced publish to the processor
+        results.push_back (measure (testCase ("SessionText update"), iterations,
+                                    [&] (int)
+                                    {
+                                        editor->m1TextEditor->moveCaretToEnd();
+                                        editor->m1TextEditor->insertTextAtCaret ("x");
+                                        editor->sessionTextDirty = true;
+                                    },
+                                    [&] (int) { editor->flushSessionText(); }));
+
+        // Typing in the middle of the notes only touches the gap and the lines in view,
+        // so this should stay flat as the notes grow
+        results.push_back (measure (testCase ("Notes keystroke (middle)"), iterations,
+                                    [&] (int)
+                                    {
+                                        auto middle = editor->m1TextEditor->getDocument().getLength() / 2;
+                                        editor->m1TextEditor->setHighlightedRegion ({ middle, middle });
+                                    },
+                                    [&] (int) { editor->m1TextEditor->insertTextAtCaret ("x"); }));
+
+        editorHolder = nullptr;
+    }
+
+    enum class GainMode { off, fixed, ramping };
+
+    // Transport that plays straight through, so processBlock also meters every block
+    struct PlayingPlayHead : public juce::AudioPlayHead
+    {
+        juce::Optional<PositionInfo> getPosition() const override
+        {
+            PositionInfo info;
+            info.setTimeInSeconds (timeSeconds);
+            info.setIsPlaying (true);
+            return info;
+        }
+
+        double timeSeconds = 0.0;
+    };
+
+    void setParameter (NotePadAudioProcessor& processor, const juce::String& parameterID, float value)
+    {
+        auto* parameter = processor.treeState.getParameter (parameterID);
+        parameter->setValueNotifyingHost (parameter->convertTo0to1 (value));
+    }
+
+    // Cost per block at a fixed block size. With the gain stage off it should stay flat as
+    // the bus widens, with it on it should grow with one vectorized multiply per channel.
+    // While playing, level metering adds one pass over every channel.
+    void runProcessBlockCase (int numChannels, GainMode gainMode, bool playing, std::vector<Measurement>& results)
+    {
+        constexpr double sampleRate = 48000.0;
+        constexpr int blockSize = 512;
+        constexpr int blocksPerIteration = 100;
+
+        auto set = juce::AudioChannelSet::canonicalChannelSet (numChannels);
+        if (set.isDisabled())
+            set = juce::AudioChannelSet::discreteChannels (numChannels);
+
+        NotePadAudioProcessor processor;
+        juce::AudioProcessor::BusesLayout layout;
+        layout.inputBuses.add (set);
+        layout.outputBuses.add (set);
+
+        if (! processor.setBusesLayout (layout))
+        {
+            std::cerr << "Layout with " << numChannels << " channels was rejected" << std::endl;
+            return;
+        }
+
+        setParameter (processor, "gainEnabled", gainMode == GainMode::off ? 0.0f : 1.0f);
+        setParameter (processor, "gain", -6.0f);
+
+        PlayingPlayHead playHead;
+        if (playing)
+            processor.setPlayHead (&playHead);
+
+        processor.setRateAndBufferSizeDetails (sampleRate, blockSize);
+        processor.prepareToPlay (sampleRate, blockSize);
+
+        juce::AudioBuffer<float> buffer (numChannels, blockSize);
+        juce::MidiBuffer midi;
+        juce::Random random (numChannels);
+        for (int ch = 0; ch < numChannels; ++ch)
+            for (int i = 0; i < blockSize; ++i)
+                buffer.setSample (ch, i, random.nextFloat() * 2.0f - 1.0f);
+
+        Measurement m;
+        m.name = "processBlock x" + juce::String (blocksPerIteration) + " (512 samples)";
+        m.name << (gainMode == GainMode::off ? "" : gainMode == GainMode::fixed ? ", gain" : ", gain ramping");
+        m.name << (playing ? ", playing" : "");
+        m.numChannels = numChannels;
+
+        results.push_back (measure (m, 50, nullptr,
+                                    [&] (int)
+                                    {
+                                        for (int block = 0; block < blocksPerIteration; ++block)
+                                        {
+                                            // A new target every block keeps the smoother ramping throughout
+                                            if (gainMode == GainMode::ramping)
+                                                setParameter (processor, "gain", (block & 1) != 0 ? -6.0f : -12.0f);
+
+                                            processor.processBlock (buffer, midi);
+                                            playHead.timeSeconds += blockSize / sampleRate;
+                                        }
+                                    }));
+
+        processor.releaseResources();
+        processor.setPlayHead (nullptr);
+    }
+
+    juce::var toJson (const std::vector<Measurement>& results)
+    {
+        juce::Array<juce::var> entries;
+        for (const auto& m : results)
+        {
+            auto* entry = new juce::DynamicObject();
+            entry->setProperty ("name", m.name);
+            entry->setProperty ("items", m.numItems);
+            entry->setProperty ("notesBytes", m.notesBytes);
+            entry->setProperty ("channels", m.numChannels);
+            entry->setProperty ("iterations", m.iterations);
+            entry->setProperty ("chunkBytes", m.chunkBytes);
+            entry->setProperty ("minMs", m.minMs);
+            entry->setProperty ("medianMs", m.medianMs);
+            entry->setProperty ("meanMs", m.meanMs);
+            entry->setProperty ("maxMs", m.maxMs);
+            entries.add (juce::var (entry));
+        }
+
+        auto* root = new juce::DynamicObject();
+        root->setProperty ("version", JucePlugin_VersionString);
+        root->setProperty ("timestamp", juce::Time::getCurrentTime().toISO8601 (true));
+        root->setProperty ("results", entries);
+        return juce::var (root);
+    }
+
+    // The XML and StateChunk cases of each state size side by side, as a Markdown table
+    // that can go straight into a pull request changing the state format
+    void printFormatComparison (const std::vector<Measurement>& results)
+    {
+        auto find = [&] (const Measurement& like, const juce::String& name) -> const Measurement*
+        {
+            for (const auto& m : results)
+                if (m.name == name && m.numItems == like.numItems && m.notesBytes == like.notesBytes)
+                    return &m;
+
+            return nullptr;
+        };
+
+        std::cout << std::endl
+                  << "| Todos | Notes bytes | XML bytes | StateChunk bytes | XML write ms | StateChunk write ms | XML read ms | StateChunk read ms |" << std::endl
+                  << "|---:|---:|---:|---:|---:|---:|---:|---:|" << std::endl;
+
+        for (const auto& xmlRead : results)
+        {
+            if (xmlRead.name != "XML chunk read")
+                continue;
+
+            auto* xmlWrite = find (xmlRead, "XML chunk write");
+            auto* chunkWrite = find (xmlRead, "StateChunk write");
+            auto* chunkRead = find (xmlRead, "StateChunk read");
+
+            if (xmlWrite == nullptr || chunkWrite == nullptr || chunkRead == nullptr)
+                continue;
+
+            std::cout << "| " << xmlRead.numItems << " | " << xmlRead.notesBytes
+                      << " | " << xmlRead.chunkBytes << " | " << chunkRead->chunkBytes
+                      << " | " << juce::String (xmlWrite->medianMs, 3) << " | " << juce::String (chunkWrite->medianMs, 3)
+                      << " | " << juce::String (xmlRead.medianMs, 3) << " | " << juce::String (chunkRead->medianMs, 3)
+                      << " |" << std::endl;
+        }
+
+        std::cout << std::endl;
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::StringArray args;
+    for (int i = 1; i < argc; ++i)
+        args.add (argv[i]);
+
+    auto quick = args.contains ("--quick");
+    auto outputIndex = args.indexOf ("--output");
+    auto outputFile = juce::File::getCurrentWorkingDirectory().getChildFile (outputIndex >= 0 ? args[outputIndex + 1] : "benchmark-results.json");
+
+    const int kilobyte = 1024;
+    std::vector<int> itemCounts { 100, 1000, 10000, 100000 };
+    std::vector<int> notesSizes { kilobyte, 100 * kilobyte, 1024 * kilobyte, 10 * 1024 * kilobyte };
+
+    if (quick)
+    {
+        itemCounts = { 100, 1000 };
+        notesSizes = { kilobyte, 100 * kilobyte };
+    }
+
+    std::vector<Measurement> results;
+
+    for (auto numChannels : { 1, 2, 4, 8, 12, 14, 16, 36, 64 })
+        for (auto gainMode : { GainMode::off, GainMode::fixed, GainMode::ramping })
+            for (auto playing : { false, true })
+                runProcessBlockCase (numChannels, gainMode, playing, results);
+
+    // Todo counts scale with small notes, notes sizes scale with a small list
+    for (auto numItems : itemCounts)
+        runCase (numItems, kilobyte, results);
+
+    for (auto notesBytes : notesSizes)
+        if (notesBytes != kilobyte)
+            runCase (100, notesBytes, results);
+
+    printFormatComparison (results);
+
+    if (! outputFile.replaceWithText (juce::JSON::toString (toJson (results))))
+    {
+        std::cerr << "Could not write " << outputFile.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    std::cout << "Results written to " << outputFile.getFullPathName() << std::endl;
+    return 0;
+}
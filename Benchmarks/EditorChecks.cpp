@@ -0,0 +1,187 @@
+/*
+  ==============================================================================
+
+    Behaviour checks for the editor against the processor's state. Each check
+    drives a real processor and editor the way a host and a user would, and
+    the executable fails if any of them does not hold. Run by ctest.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+#include "PluginEditor.h"
+#include "NotesEditor.h"
+
+#include <cstdio>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct Check
+    {
+        const char* name;
+        std::function<bool()> run;
+    };
+
+    bool expect (bool condition, const char* what)
+    {
+        if (! condition)
+            std::printf ("    expected: %s\n", what);
+
+        return condition;
+    }
+
+    // Saved state of another instance with its own notes and todos. Its ids start at 1
+    // like every instance's, so they overlap the ids of whatever the editor shows.
+    juce::MemoryBlock createOtherState()
+    {
+        NotePadAudioProcessor other;
+        other.treeState.state.setProperty ("SessionText", "Restored notes", nullptr);
+
+        auto todoItems = other.treeState.state.getOrCreateChildWithName ("TodoItems", nullptr);
+        for (auto text : { "Restored first", "Restored second" })
+        {
+            juce::ValueTree item ("TodoItem");
+            item.setProperty ("Id", (juce::int64) todoItems.getNumChildren() + 1, nullptr);
+            item.setProperty ("Text", text, nullptr);
+            item.setProperty ("Checked", false, nullptr);
+            todoItems.appendChild (item, nullptr);
+        }
+
+        other.flushPendingUpdates();
+
+        juce::MemoryBlock data;
+        other.getStateInformation (data);
+        return data;
+    }
+
+    // The editor has todos, undo history and notes typed but not yet published
+    void editBeforeLoad (NotePadAudioProcessorEditor& editor)
+    {
+        editor.addTodoItem ("Editor first", false);
+        editor.addTodoItem ("Editor second", false);
+        editor.addTodoItem ("Editor third", false);
+
+        editor.m1TextEditor->moveCaretToEnd();
+        editor.m1TextEditor->insertTextAtCaret ("typed before the load");
+        editor.sessionTextDirty = true;
+    }
+
+    bool matchesRestoredState (NotePadAudioProcessor& processor, NotePadAudioProcessorEditor& editor)
+    {
+        auto todoItems = processor.treeState.state.getChildWithName ("TodoItems");
+        auto passed = expect (processor.treeState.state.getProperty ("SessionText").toString() == "Restored notes",
+                              "the pending notes text does not overwrite the restored notes");
+        passed &= expect (editor.m1TextEditor->getText() == "Restored notes", "the editor shows the restored notes");
+        passed &= expect (editor.todoData.size() == 2 && editor.todoData[0].text == "Restored first",
+                          "the editor shows the restored todos");
+        passed &= expect (! editor.undoJournal.canUndo(), "the undo history of the replaced content is gone");
+
+        // Toggling the first row changes the first restored todo and nothing else
+        editor.setTodoCompleted (0, true);
+        processor.flushPendingUpdates();
+
+        passed &= expect (todoItems.getNumChildren() == 2, "the toggle adds or removes no todos");
+        passed &= expect (todoItems.getChild (0).getProperty ("Text").toString() == "Restored first"
+                           && static_cast<bool> (todoItems.getChild (0).getProperty ("Checked")),
+                          "the toggle lands on the restored todo shown in that row");
+        passed &= expect (! static_cast<bool> (todoItems.getChild (1).getProperty ("Checked")),
+                          "the other restored todo is left alone");
+        return passed;
+    }
+
+    bool loadStateWithEditorOpen (bool fromOtherThread)
+    {
+        auto data = createOtherState();
+
+        NotePadAudioProcessor processor;
+        std::unique_ptr<juce::AudioProcessorEditor> editorHolder (processor.createEditor());
+        auto* editor = dynamic_cast<NotePadAudioProcessorEditor*> (editorHolder.get());
+        editBeforeLoad (*editor);
+
+        if (fromOtherThread)
+        {
+            std::thread loader ([&] { processor.setStateInformation (data.getData(), (int) data.getSize()); });
+            loader.join();
+
+            // The notes flush timer can fire before the queued reload runs
+            editor->flushSessionText();
+            processor.flushPendingUpdates();
+        }
+        else
+        {
+            processor.setStateInformation (data.getData(), (int) data.getSize());
+            editor->flushSessionText();
+        }
+
+        return matchesRestoredState (processor, *editor);
+    }
+
+    // A line several times longer than a chunk is laid out, with no spaces to end the
+    // chunks early. Every position on it, up to the end, has a caret of its own that a
+    // click finds again, and the last characters are shaped once they're in view.
+    bool reachEndOfLongLine (bool wordWrap)
+    {
+        NotesEditor editor;
+        editor.setWordWrap (wordWrap);
+        editor.setBounds (0, 0, 400, 300);
+
+        auto longLine = juce::String::repeatedString ("x", 3 * 4096 + 100);
+        editor.setText ("first\n" + longLine + "\nlast");
+
+        auto lineStart = 6;
+        auto lineEnd = lineStart + longLine.length();
+        auto passed = true;
+
+        for (auto position : { lineStart + 4095, lineStart + 4096, lineStart + 9000, lineEnd - 1, lineEnd })
+        {
+            editor.setHighlightedRegion ({ position, position });
+            auto caret = editor.getCaretRectangleForCharIndex (position);
+
+            passed &= expect (editor.getLocalBounds().contains (caret.getPosition()), "the caret is scrolled into view");
+            passed &= expect (editor.getCharIndexForPoint ({ caret.getX(), caret.getCentreY() }) == position,
+                              "clicking on the caret finds its position again");
+        }
+
+        passed &= expect (editor.getCaretRectangleForCharIndex (lineEnd) != editor.getCaretRectangleForCharIndex (lineStart + 4096),
+                          "the end of the line is not drawn where the first chunk ends");
+        passed &= expect (! editor.getTextBounds ({ lineEnd - 10, lineEnd }).isEmpty(), "the last characters are laid out");
+
+        // Up from the start of the next line lands on the line's last row, past the first chunk
+        editor.setHighlightedRegion ({ lineEnd + 1, lineEnd + 1 });
+        editor.keyPressed (juce::KeyPress (juce::KeyPress::upKey));
+        passed &= expect (editor.getCaretPosition() > lineStart + 4096 && editor.getCaretPosition() <= lineEnd,
+                          "moving up reaches the end of the line");
+        return passed;
+    }
+
+    const std::vector<Check> checks
+    {
+        { "Load state with the editor open, then toggle a todo",            [] { return loadStateWithEditorOpen (false); } },
+        { "Load state from another thread with the editor open, then toggle", [] { return loadStateWithEditorOpen (true); } },
+        { "Reach the end of a line longer than 4096 characters, wrapped",   [] { return reachEndOfLongLine (true); } },
+        { "Reach the end of a line longer than 4096 characters, unwrapped", [] { return reachEndOfLongLine (false); } },
+    };
+}
+
+int main()
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    int failures = 0;
+
+    for (const auto& check : checks)
+    {
+        auto passed = check.run();
+        std::printf ("%-70s %s\n", check.name, passed ? "ok" : "FAIL");
+
+        if (! passed)
+            ++failures;
+    }
+
+    std::printf ("%d checks, %d failed\n", (int) checks.size(), failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,464 @@
+/*
+  ==============================================================================
+
+    Real-time safety check for processBlock. Runs prepareToPlay and then
+    processBlock for every layout the processor accepts, at a range of block
+    sizes and in both single and double precision, and fails if the audio callback allocates, frees or takes a mutex.
+    Also reports the distribution of per-block cost against the block budget.
+    --quick checks every layout at a few block sizes only, which is what ctest
+    runs, the full sweep is meant to be run by hand.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#if ! JUCE_WINDOWS
+ #include <dlfcn.h>
+ #include <pthread.h>
+ #include <sched.h>
+#endif
+
+//==============================================================================
+// Everything below must itself be safe to call from inside an allocator hook:
+// no allocation, no locks, only a thread_local flag and atomic counters.
+namespace RealtimeGuard
+{
+    thread_local bool inAudioCallback = false;
+
+    std::atomic<int> allocations { 0 };
+    std::atomic<int> deallocations { 0 };
+    std::atomic<int> mutexLocks { 0 };
+
+    struct ScopedAudioCallback
+    {
+        ScopedAudioCallback()  { inAudioCallback = true; }
+        ~ScopedAudioCallback() { inAudioCallback = false; }
+    };
+
+    inline void noteAllocation()   { if (inAudioCallback) ++allocations; }
+    inline void noteDeallocation() { if (inAudioCallback) ++deallocations; }
+    inline void noteMutexLock()    { if (inAudioCallback) ++mutexLocks; }
+
+    int getTotalViolations() { return allocations.load() + deallocations.load() + mutexLocks.load(); }
+
+    void reset()
+    {
+        allocations = 0;
+        deallocations = 0;
+        mutexLocks = 0;
+    }
+}
+
+//==============================================================================
+// Heap interception. On Linux the C allocator is replaced as well, which also
+// catches juce::HeapBlock and anything else that calls malloc directly.
+#if JUCE_LINUX
+extern "C"
+{
+    void* __libc_malloc (size_t);
+    void* __libc_calloc (size_t, size_t);
+    void* __libc_realloc (void*, size_t);
+    void  __libc_free (void*);
+
+    void* malloc (size_t size)                  { RealtimeGuard::noteAllocation(); return __libc_malloc (size); }
+    void* calloc (size_t count, size_t size)    { RealtimeGuard::noteAllocation(); return __libc_calloc (count, size); }
+    void* realloc (void* p, size_t size)        { RealtimeGuard::noteAllocation(); return __libc_realloc (p, size); }
+    void  free (void* p)                        { if (p != nullptr) RealtimeGuard::noteDeallocation(); __libc_free (p); }
+}
+
+static void* rawAllocate (std::size_t size)   { return __libc_malloc (size == 0 ? 1 : size); }
+static void  rawFree (void* p)                { __libc_free (p); }
+#else
+static void* rawAllocate (std::size_t size)   { return std::malloc (size == 0 ? 1 : size); }
+static void  rawFree (void* p)                { std::free (p); }
+#endif
+
+static void* rawAllocateAligned (std::size_t size, std::align_val_t alignment)
+{
+   #if JUCE_WINDOWS
+    return _aligned_malloc (size == 0 ? 1 : size, static_cast<std::size_t> (alignment));
+   #else
+    void* p = nullptr;
+    return posix_memalign (&p, juce::jmax (sizeof (void*), static_cast<std::size_t> (alignment)), size == 0 ? 1 : size) == 0 ? p : nullptr;
+   #endif
+}
+
+static void rawFreeAligned (void* p)
+{
+   #if JUCE_WINDOWS
+    _aligned_free (p);
+   #else
+    rawFree (p);
+   #endif
+}
+
+void* operator new (std::size_t size)
+{
+    RealtimeGuard::noteAllocation();
+    if (auto* p = rawAllocate (size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[] (std::size_t size)                                      { return operator new (size); }
+void* operator new (std::size_t size, const std::nothrow_t&) noexcept        { RealtimeGuard::noteAllocation(); return rawAllocate (size); }
+void* operator new[] (std::size_t size, const std::nothrow_t&) noexcept      { RealtimeGuard::noteAllocation(); return rawAllocate (size); }
+
+void* operator new (std::size_t size, std::align_val_t alignment)
+{
+    RealtimeGuard::noteAllocation();
+    if (auto* p = rawAllocateAligned (size, alignment))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[] (std::size_t size, std::align_val_t alignment)          { return operator new (size, alignment); }
+
+void operator delete (void* p) noexcept                                      { if (p != nullptr) RealtimeGuard::noteDeallocation(); rawFree (p); }
+void operator delete[] (void* p) noexcept                                    { operator delete (p); }
+void operator delete (void* p, std::size_t) noexcept                         { operator delete (p); }
+void operator delete[] (void* p, std::size_t) noexcept                       { operator delete (p); }
+void operator delete (void* p, std::align_val_t) noexcept                    { if (p != nullptr) RealtimeGuard::noteDeallocation(); rawFreeAligned (p); }
+void operator delete[] (void* p, std::align_val_t alignment) noexcept        { operator delete (p, alignment); }
+void operator delete (void* p, std::size_t, std::align_val_t alignment) noexcept   { operator delete (p, alignment); }
+void operator delete[] (void* p, std::size_t, std::align_val_t alignment) noexcept { operator delete (p, alignment); }
+
+//==============================================================================
+// Mutex interception. Defining these in the executable makes every call from
+// JUCE and the plugin code (which are linked in statically) land here first.
+// On Windows there is no equivalent hook, so only the heap is checked there.
+#if ! JUCE_WINDOWS
+namespace
+{
+    template <typename Fn>
+    Fn findNext (const char* name)
+    {
+        return reinterpret_cast<Fn> (dlsym (RTLD_NEXT, name));
+    }
+
+    using MutexFn = int (*) (pthread_mutex_t*);
+    using RwLockFn = int (*) (pthread_rwlock_t*);
+
+    struct RealLockFunctions
+    {
+        MutexFn mutexLock = nullptr;
+        RwLockFn rwLockRead = nullptr;
+        RwLockFn rwLockWrite = nullptr;
+    };
+
+    // Resolved by the first lock taken, which can come from a static initialiser in any
+    // translation unit (a juce::Identifier locks the StringPool) long before main. Only
+    // constant-initialised state is used here, so it is valid whenever that happens.
+    enum { unresolved, resolving, resolved };
+    std::atomic<int> lockFunctionsState { unresolved };
+    RealLockFunctions realLockFunctions;
+    thread_local bool resolvingOnThisThread = false;
+
+    const RealLockFunctions* getRealLockFunctions()
+    {
+        if (lockFunctionsState.load (std::memory_order_acquire) == resolved)
+            return &realLockFunctions;
+
+        // dlsym may take a lock of its own while it resolves, there is nothing to forward it to yet
+        if (resolvingOnThisThread)
+            return nullptr;
+
+        auto expected = (int) unresolved;
+        if (lockFunctionsState.compare_exchange_strong (expected, resolving, std::memory_order_acq_rel))
+        {
+            resolvingOnThisThread = true;
+            realLockFunctions.mutexLock = findNext<MutexFn> ("pthread_mutex_lock");
+            realLockFunctions.rwLockRead = findNext<RwLockFn> ("pthread_rwlock_rdlock");
+            realLockFunctions.rwLockWrite = findNext<RwLockFn> ("pthread_rwlock_wrlock");
+            resolvingOnThisThread = false;
+            lockFunctionsState.store (resolved, std::memory_order_release);
+        }
+        else
+        {
+            // Another thread is resolving them, which only takes a moment
+            while (lockFunctionsState.load (std::memory_order_acquire) != resolved)
+                sched_yield();
+        }
+
+        return &realLockFunctions;
+    }
+}
+
+// While the real functions are being looked up the lock is not taken: that only happens
+// once, on the one thread doing the lookup, before anything else can hold the lock.
+extern "C"
+{
+    int pthread_mutex_lock (pthread_mutex_t* mutex)
+    {
+        RealtimeGuard::noteMutexLock();
+        auto* real = getRealLockFunctions();
+        return real != nullptr ? real->mutexLock (mutex) : 0;
+    }
+
+    int pthread_rwlock_rdlock (pthread_rwlock_t* lock)
+    {
+        RealtimeGuard::noteMutexLock();
+        auto* real = getRealLockFunctions();
+        return real != nullptr ? real->rwLockRead (lock) : 0;
+    }
+
+    int pthread_rwlock_wrlock (pthread_rwlock_t* lock)
+    {
+        RealtimeGuard::noteMutexLock();
+        auto* real = getRealLockFunctions();
+        return real != nullptr ? real->rwLockWrite (lock) : 0;
+    }
+}
+#endif
+
+//==============================================================================
+namespace
+{
+    struct Sweep
+    {
+        std::vector<double> sampleRates;
+        std::vector<int> blockSizes;
+        std::vector<bool> precisions; // true for double
+        int blocksPerRun;
+    };
+
+    const Sweep fullSweep { { 44100.0, 96000.0 }, { 1, 16, 32, 64, 128, 256, 441, 512, 1024, 2048, 4096 }, { false, true }, 2000 };
+
+    // Still every layout, with the block sizes most likely to expose an edge: a single
+    // sample, one that isn't a power of two and the largest. A run is long enough to
+    // pass a cue, a gain ramp and a switch of cue mode.
+    const Sweep quickSweep { { 44100.0 }, { 1, 441, 4096 }, { false, true }, 300 };
+
+    // Every channel set a host might offer, the processor decides which it accepts
+    juce::Array<juce::AudioChannelSet> getCandidateLayouts()
+    {
+        juce::Array<juce::AudioChannelSet> sets;
+
+        for (int numChannels = 1; numChannels <= 64; ++numChannels)
+        {
+            sets.addIfNotAlreadyThere (juce::AudioChannelSet::canonicalChannelSet (numChannels));
+            sets.addIfNotAlreadyThere (juce::AudioChannelSet::discreteChannels (numChannels));
+        }
+
+        for (int order = 1; order <= 7; ++order)
+            sets.addIfNotAlreadyThere (juce::AudioChannelSet::ambisonic (order));
+
+        for (const auto& set : { juce::AudioChannelSet::createLCR(), juce::AudioChannelSet::quadraphonic(),
+                                 juce::AudioChannelSet::create5point0(), juce::AudioChannelSet::create5point1(),
+                                 juce::AudioChannelSet::create7point0(), juce::AudioChannelSet::create7point1(),
+                                 juce::AudioChannelSet::create7point1point4() })
+            sets.addIfNotAlreadyThere (set);
+
+        return sets;
+    }
+
+    // Host transport that plays forward block by block and loops back every few seconds,
+    // so the cue cursor sees both continuous playback and jumps
+    struct LoopingPlayHead : public juce::AudioPlayHead
+    {
+        juce::Optional<PositionInfo> getPosition() const override
+        {
+            PositionInfo info;
+            info.setTimeInSeconds (timeSeconds);
+            info.setTimeInSamples ((juce::int64) (timeSeconds * sampleRate));
+            info.setIsPlaying (true);
+            return info;
+        }
+
+        void advance (int numSamples)
+        {
+            timeSeconds += numSamples / sampleRate;
+            if (timeSeconds >= loopLengthSeconds)
+                timeSeconds = 0.0;
+        }
+
+        double timeSeconds = 0.0;
+        double sampleRate = 44100.0;
+        static constexpr double loopLengthSeconds = 4.0;
+    };
+
+    LoopingPlayHead playHead;
+
+    // Thousands of anchored todos, a few of them land in most blocks
+    void addCueMarkers (NotePadAudioProcessor& processor)
+    {
+        auto todoItems = processor.treeState.state.getOrCreateChildWithName ("TodoItems", nullptr);
+        for (int i = 0; i < 4000; ++i)
+        {
+            juce::ValueTree item ("TodoItem");
+            item.setProperty ("Id", (juce::int64) i + 1, nullptr);
+            item.setProperty ("Text", "Cue " + juce::String (i), nullptr);
+            item.setProperty ("AnchorTime", i * 0.001, nullptr);
+            todoItems.appendChild (item, nullptr);
+        }
+
+        auto* midiCues = processor.treeState.getParameter ("midiCues");
+        midiCues->setValueNotifyingHost (midiCues->convertTo0to1 ((float) NotePadAudioProcessor::midiCuesMarkers));
+        processor.flushPendingUpdates();
+    }
+
+    double percentile (const std::vector<double>& sorted, double p)
+    {
+        auto index = (size_t) juce::jlimit (0.0, (double) sorted.size() - 1.0, p * (double) (sorted.size() - 1));
+        return sorted[index];
+    }
+
+    struct RunResult
+    {
+        int violations = 0;
+        double p50Us = 0.0, p99Us = 0.0, p999Us = 0.0, maxUs = 0.0;
+        double budgetUs = 0.0;
+    };
+
+    template <typename SampleType>
+    RunResult runLayout (NotePadAudioProcessor& processor, int numChannels, double sampleRate, int blockSize, int blocksPerRun)
+    {
+        processor.setProcessingPrecision (std::is_same<SampleType, double>::value ? juce::AudioProcessor::doublePrecision
+                                                                                  : juce::AudioProcessor::singlePrecision);
+        processor.setRateAndBufferSizeDetails (sampleRate, blockSize);
+        processor.prepareToPlay (sampleRate, blockSize);
+
+        // Everything the callback touches is allocated up front, as a host would
+        juce::AudioBuffer<SampleType> buffer (numChannels, blockSize);
+        juce::MidiBuffer midi;
+        midi.ensureSize (4096);
+        playHead.timeSeconds = 0.0;
+        playHead.sampleRate = sampleRate;
+        std::vector<double> costs ((size_t) blocksPerRun);
+
+        juce::Random random (0x4d31);
+        for (int ch = 0; ch < numChannels; ++ch)
+            for (int i = 0; i < blockSize; ++i)
+                buffer.setSample (ch, i, (SampleType) (random.nextFloat() * 2.0f - 1.0f));
+
+        // Exercise the gain stage too: its target moves every 64 blocks so it spends time
+        // ramping, and every fourth stretch it is switched off to cover the unity path
+        auto* gainEnabled = processor.treeState.getParameter ("gainEnabled");
+        auto* gain = processor.treeState.getParameter ("gain");
+
+        RealtimeGuard::reset();
+
+        for (int block = 0; block < blocksPerRun; ++block)
+        {
+            if (block % 64 == 0)
+            {
+                gain->setValueNotifyingHost (random.nextFloat());
+                gainEnabled->setValueNotifyingHost ((block / 64) % 4 == 3 ? 0.0f : 1.0f);
+            }
+
+            // Alternate between MIDI cues as markers and as controllers
+            if (block % 256 == 0)
+            {
+                auto* midiCues = processor.treeState.getParameter ("midiCues");
+                auto mode = (block / 256) % 2 == 0 ? NotePadAudioProcessor::midiCuesMarkers : NotePadAudioProcessor::midiCuesControllers;
+                midiCues->setValueNotifyingHost (midiCues->convertTo0to1 ((float) mode));
+            }
+
+            midi.clear();
+
+            auto start = juce::Time::getHighResolutionTicks();
+            {
+                RealtimeGuard::ScopedAudioCallback audioCallback;
+                processor.processBlock (buffer, midi);
+            }
+            playHead.advance (blockSize);
+            costs[(size_t) block] = juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - start) * 1.0e6;
+        }
+
+        RunResult result;
+        result.violations = RealtimeGuard::getTotalViolations();
+        gainEnabled->setValueNotifyingHost (0.0f);
+
+        processor.releaseResources();
+
+        std::sort (costs.begin(), costs.end());
+        result.p50Us = percentile (costs, 0.5);
+        result.p99Us = percentile (costs, 0.99);
+        result.p999Us = percentile (costs, 0.999);
+        result.maxUs = costs.back();
+        result.budgetUs = (double) blockSize / sampleRate * 1.0e6;
+        return result;
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    auto quick = false;
+    for (int i = 1; i < argc; ++i)
+        if (juce::String (argv[i]) == "--quick")
+            quick = true;
+
+    const auto& sweep = quick ? quickSweep : fullSweep;
+
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    NotePadAudioProcessor processor;
+    processor.setPlayHead (&playHead);
+    processor.setClipCaptureEnabled (true);
+    addCueMarkers (processor);
+
+    int failures = 0;
+    int layoutsTested = 0;
+
+    std::printf ("%-28s %6s %6s %6s %10s %10s %10s %10s %8s  %s\n",
+                 "layout", "bits", "rate", "block", "p50 us", "p99 us", "p99.9 us", "max us", "max %", "result");
+
+    for (const auto& set : getCandidateLayouts())
+    {
+        juce::AudioProcessor::BusesLayout layout;
+        layout.inputBuses.add (set);
+        layout.outputBuses.add (set);
+
+        if (! processor.setBusesLayout (layout))
+            continue;
+
+        ++layoutsTested;
+        auto description = set.getDescription() + " (" + juce::String (set.size()) + ")";
+
+        for (auto useDouble : sweep.precisions)
+        {
+            for (auto sampleRate : sweep.sampleRates)
+            {
+                for (auto blockSize : sweep.blockSizes)
+                {
+                    auto result = useDouble ? runLayout<double> (processor, set.size(), sampleRate, blockSize, sweep.blocksPerRun)
+                                            : runLayout<float> (processor, set.size(), sampleRate, blockSize, sweep.blocksPerRun);
+                    auto passed = result.violations == 0;
+
+                    std::printf ("%-28s %6d %6d %6d %10.2f %10.2f %10.2f %10.2f %7.2f%%  %s\n",
+                                 description.substring (0, 28).toRawUTF8(), useDouble ? 64 : 32, (int) sampleRate, blockSize,
+                                 result.p50Us, result.p99Us, result.p999Us, result.maxUs,
+                                 100.0 * result.maxUs / result.budgetUs,
+                                 passed ? "ok" : "FAIL");
+
+                    if (! passed)
+                    {
+                        std::printf ("    %d allocations, %d frees, %d mutex locks on the audio thread\n",
+                                     RealtimeGuard::allocations.load(), RealtimeGuard::deallocations.load(),
+                                     RealtimeGuard::mutexLocks.load());
+                        ++failures;
+                    }
+                }
+            }
+        }
+    }
+
+    if (layoutsTested == 0)
+    {
+        std::printf ("No layouts were accepted by the processor\n");
+        return 1;
+    }
+
+    std::printf ("%d layouts tested, %d runs failed\n", layoutsTested, failures);
+    return failures == 0 ? 0 : 1;
+}
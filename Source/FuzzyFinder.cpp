@@ -0,0 +1,414 @@
+/*
+  ==============================================================================
+
+    Quick-open style fuzzy finder over the todo list.
+
+  ==============================================================================
+*/
+
+#include "FuzzyFinder.h"
+#include <algorithm>
+#include <limits>
+#include <queue>
+
+namespace
+{
+    // Scoring constants, same shape as fzf's
+    constexpr int scoreMatch = 16;
+    constexpr int penaltyGapStart = -3;
+    constexpr int penaltyGapExtension = -1;
+    constexpr int bonusBoundaryWhite = 10;
+    constexpr int bonusBoundaryDelimiter = 9;
+    constexpr int bonusBoundary = 8;
+    constexpr int bonusCamel = 7;
+    constexpr int bonusConsecutive = 4;
+    constexpr int bonusFirstCharMultiplier = 2;
+    
+    enum class CharClass { white, delimiter, nonWord, lower, upper, number };
+    
+    CharClass getCharClass (juce::juce_wchar c)
+    {
+        if (juce::CharacterFunctions::isWhitespace (c))        return CharClass::white;
+        if (c == '/' || c == ',' || c == ':' || c == ';' || c == '|' || c == '-' || c == '_')
+                                                                return CharClass::delimiter;
+        if (juce::CharacterFunctions::isDigit (c))             return CharClass::number;
+        if (juce::CharacterFunctions::isUpperCase (c))         return CharClass::upper;
+        if (juce::CharacterFunctions::isLetter (c))            return CharClass::lower;
+        return CharClass::nonWord;
+    }
+    
+    juce::uint64 getCharacterBit (juce::juce_wchar c)
+    {
+        if (c >= 'a' && c <= 'z')  return 1ull << (c - 'a');
+        if (c >= '0' && c <= '9')  return 1ull << (26 + (c - '0'));
+        return 1ull << (36 + (juce::uint32) c % 28);
+    }
+    
+    // Index of the lowest set bit, word must not be zero
+    int getLowestBit (juce::uint64 word)
+    {
+        return juce::countNumberOfBits ((word & (~word + 1)) - 1);
+    }
+    
+    constexpr size_t noPosition = std::numeric_limits<size_t>::max();
+}
+
+//==============================================================================
+void FuzzyMatcher::setCandidates (const juce::StringArray& texts)
+{
+    candidates.clear();
+    candidates.reserve ((size_t) texts.size());
+    
+    for (const auto& text : texts)
+    {
+        Candidate candidate;
+        candidate.text.reserve ((size_t) text.length());
+        
+        for (auto p = text.getCharPointer(); ! p.isEmpty();)
+            candidate.text.push_back (p.getAndAdvance());
+        
+        candidate.lower.reserve (candidate.text.size());
+        for (auto c : candidate.text)
+            candidate.lower.push_back (juce::CharacterFunctions::toLowerCase (c));
+        
+        candidate.mask = getCharacterMask (candidate.lower);
+        setPositions (candidate);
+        candidates.push_back (std::move (candidate));
+    }
+    
+    hasLastQuery = false;
+    lastMatches.clear();
+}
+
+juce::uint64 FuzzyMatcher::getCharacterMask (const std::vector<juce::juce_wchar>& lower)
+{
+    juce::uint64 mask = 0;
+    for (auto c : lower)
+        mask |= getCharacterBit (c);
+    return mask;
+}
+
+void FuzzyMatcher::setPositions (Candidate& candidate)
+{
+    const auto& lower = candidate.lower;
+    candidate.numWords = (lower.size() + 63) / 64;
+    candidate.positions.assign ((size_t) juce::countNumberOfBits (candidate.mask) * candidate.numWords, 0);
+    
+    for (size_t i = 0; i < lower.size(); ++i)
+    {
+        auto bit = getCharacterBit (lower[i]);
+        auto bucket = (size_t) juce::countNumberOfBits (candidate.mask & (bit - 1));
+        candidate.positions[bucket * candidate.numWords + i / 64] |= 1ull << (i % 64);
+    }
+}
+
+size_t FuzzyMatcher::findNext (const Candidate& candidate, juce::juce_wchar c, size_t from)
+{
+    auto bit = getCharacterBit (c);
+    if ((candidate.mask & bit) == 0 || from >= candidate.lower.size())
+        return noPosition;
+    
+    auto bucket = (size_t) juce::countNumberOfBits (candidate.mask & (bit - 1));
+    const auto* words = candidate.positions.data() + bucket * candidate.numWords;
+    
+    auto word = words[from / 64] & (~0ull << (from % 64));
+    for (auto w = from / 64;;)
+    {
+        // Letters and digits have a bucket each, anything else shares one and is checked
+        while (word != 0)
+        {
+            auto index = w * 64 + (size_t) getLowestBit (word);
+            if (candidate.lower[index] == c)
+                return index;
+            
+            word &= word - 1;
+        }
+        
+        if (++w >= candidate.numWords)
+            return noPosition;
+        
+        word = words[w];
+    }
+}
+
+int FuzzyMatcher::getBoundaryBonus (const Candidate& candidate, size_t index)
+{
+    if (index == 0)
+        return bonusBoundaryWhite;
+    
+    auto previous = getCharClass (candidate.text[index - 1]);
+    auto current = getCharClass (candidate.text[index]);
+    
+    if (previous == CharClass::white)       return bonusBoundaryWhite;
+    if (previous == CharClass::delimiter)   return bonusBoundaryDelimiter;
+    if (previous == CharClass::nonWord)     return bonusBoundary;
+    
+    if ((previous == CharClass::lower && current == CharClass::upper)
+        || (previous != CharClass::number && current == CharClass::number))
+        return bonusCamel;
+    
+    return 0;
+}
+
+int FuzzyMatcher::scoreCandidate (const Candidate& candidate, const std::vector<juce::juce_wchar>& query)
+{
+    const auto& lower = candidate.lower;
+    
+    // Forward pass: earliest position where the whole query has matched in order,
+    // skipping through the position bitmasks a word at a time
+    size_t end = 0;
+    for (auto q : query)
+    {
+        auto position = findNext (candidate, q, end);
+        if (position == noPosition)
+            return 0;
+        end = position + 1;
+    }
+    
+    // Backward pass: the latest start that still matches, giving the tightest window
+    auto start = end;
+    auto queryIndex = query.size();
+    while (queryIndex > 0 && start > 0)
+    {
+        --start;
+        if (lower[start] == query[queryIndex - 1])
+            --queryIndex;
+    }
+    
+    int score = 0;
+    int consecutive = 0;
+    bool inGap = false;
+    queryIndex = 0;
+    
+    for (auto i = start; i < end; ++i)
+    {
+        if (queryIndex < query.size() && lower[i] == query[queryIndex])
+        {
+            auto bonus = getBoundaryBonus (candidate, i);
+            if (consecutive > 0)
+                bonus = juce::jmax (bonus, bonusConsecutive);
+            if (queryIndex == 0)
+                bonus *= bonusFirstCharMultiplier;
+            
+            score += scoreMatch + bonus;
+            ++consecutive;
+            ++queryIndex;
+            inGap = false;
+        }
+        else
+        {
+            score += inGap ? penaltyGapExtension : penaltyGapStart;
+            consecutive = 0;
+            inGap = true;
+        }
+    }
+    
+    // Any match, however gappy, ranks above no match
+    return juce::jmax (1, score);
+}
+
+std::vector<FuzzyMatcher::Result> FuzzyMatcher::search (const juce::String& query, int maxResults)
+{
+    std::vector<juce::juce_wchar> lowerQuery;
+    for (auto p = query.getCharPointer(); ! p.isEmpty();)
+    {
+        auto c = juce::CharacterFunctions::toLowerCase (p.getAndAdvance());
+        if (! juce::CharacterFunctions::isWhitespace (c))
+            lowerQuery.push_back (c);
+    }
+    
+    auto queryMask = getCharacterMask (lowerQuery);
+    
+    // A longer version of the previous query can only match what that one matched
+    auto refine = hasLastQuery && lastQuery.isNotEmpty() && query.startsWith (lastQuery);
+    
+    std::vector<int> matches;
+    auto moreRelevant = [this] (const Result& a, const Result& b)
+    {
+        if (a.score != b.score)
+            return a.score > b.score;
+        
+        auto lengthA = candidates[(size_t) a.candidate].text.size();
+        auto lengthB = candidates[(size_t) b.candidate].text.size();
+        if (lengthA != lengthB)
+            return lengthA < lengthB;
+        
+        return a.candidate < b.candidate;
+    };
+    
+    // Min-heap of the best maxResults so far, the weakest is on top and gets replaced
+    std::priority_queue<Result, std::vector<Result>, decltype (moreRelevant)> best (moreRelevant);
+    
+    auto consider = [&] (int index)
+    {
+        const auto& candidate = candidates[(size_t) index];
+        if ((candidate.mask & queryMask) != queryMask)
+            return;
+        
+        auto score = lowerQuery.empty() ? 1 : scoreCandidate (candidate, lowerQuery);
+        if (score <= 0)
+            return;
+        
+        matches.push_back (index);
+        
+        if ((int) best.size() < maxResults)
+            best.push ({ index, score });
+        else if (maxResults > 0 && moreRelevant ({ index, score }, best.top()))
+        {
+            best.pop();
+            best.push ({ index, score });
+        }
+    };
+    
+    if (refine)
+    {
+        for (auto index : lastMatches)
+            consider (index);
+    }
+    else
+    {
+        for (int i = 0; i < (int) candidates.size(); ++i)
+            consider (i);
+    }
+    
+    lastQuery = query;
+    lastMatches = std::move (matches);
+    hasLastQuery = true;
+    
+    std::vector<Result> results;
+    results.reserve (best.size());
+    while (! best.empty())
+    {
+        results.push_back (best.top());
+        best.pop();
+    }
+    
+    std::reverse (results.begin(), results.end());
+    return results;
+}
+
+//==============================================================================
+TodoFinderComponent::TodoFinderComponent()
+{
+    addAndMakeVisible (queryField);
+    queryField.addListener (this);
+    queryField.addKeyListener (this);
+    queryField.setMultiLine (false);
+    queryField.setReturnKeyStartsNewLine (false);
+    queryField.setTextToShowWhenEmpty ("Jump to todo...", juce::Colours::grey);
+    queryField.setColour (juce::TextEditor::backgroundColourId, juce::Colour (30, 30, 30));
+    queryField.setColour (juce::TextEditor::textColourId, juce::Colours::white);
+    
+    addAndMakeVisible (resultsList);
+    resultsList.setModel (this);
+    resultsList.setRowHeight (24);
+    resultsList.setWantsKeyboardFocus (false);
+    resultsList.setColour (juce::ListBox::backgroundColourId, juce::Colours::transparentBlack);
+}
+
+TodoFinderComponent::~TodoFinderComponent()
+{
+    queryField.removeKeyListener (this);
+    resultsList.setModel (nullptr);
+}
+
+void TodoFinderComponent::setItems (const juce::StringArray& texts, const juce::Array<juce::int64>& ids)
+{
+    itemTexts = texts;
+    itemIds = ids;
+    matcher.setCandidates (texts);
+    queryField.clear();
+    updateResults();
+}
+
+void TodoFinderComponent::grabQueryFocus()
+{
+    queryField.grabKeyboardFocus();
+}
+
+void TodoFinderComponent::paint (juce::Graphics& g)
+{
+    auto bounds = getLocalBounds().toFloat();
+    g.setColour (juce::Colour (24, 24, 24).withAlpha (0.97f));
+    g.fillRoundedRectangle (bounds, 4.0f);
+    g.setColour (juce::Colours::white.withAlpha (0.5f));
+    g.drawRoundedRectangle (bounds.reduced (0.5f), 4.0f, 1.0f);
+}
+
+void TodoFinderComponent::resized()
+{
+    auto area = getLocalBounds().reduced (8);
+    queryField.setBounds (area.removeFromTop (24));
+    area.removeFromTop (6);
+    resultsList.setBounds (area);
+}
+
+void TodoFinderComponent::updateResults()
+{
+    results = matcher.search (queryField.getText(), maxResults);
+    resultsList.updateContent();
+    resultsList.repaint();
+    
+    if (! results.empty())
+        resultsList.selectRow (0);
+}
+
+void TodoFinderComponent::chooseRow (int row)
+{
+    if (juce::isPositiveAndBelow (row, (int) results.size()) && onItemChosen != nullptr)
+        onItemChosen (itemIds[results[(size_t) row].candidate]);
+}
+
+void TodoFinderComponent::textEditorTextChanged (juce::TextEditor&)
+{
+    updateResults();
+}
+
+void TodoFinderComponent::textEditorReturnKeyPressed (juce::TextEditor&)
+{
+    chooseRow (resultsList.getSelectedRow());
+}
+
+void TodoFinderComponent::textEditorEscapeKeyPressed (juce::TextEditor&)
+{
+    if (onDismiss != nullptr)
+        onDismiss();
+}
+
+bool TodoFinderComponent::keyPressed (const juce::KeyPress& key, juce::Component*)
+{
+    // Arrow keys move through the results while typing continues in the query field
+    if (key == juce::KeyPress::upKey || key == juce::KeyPress::downKey)
+    {
+        auto delta = key == juce::KeyPress::upKey ? -1 : 1;
+        auto row = juce::jlimit (0, juce::jmax (0, (int) results.size() - 1), resultsList.getSelectedRow() + delta);
+        resultsList.selectRow (row);
+        return true;
+    }
+    
+    return false;
+}
+
+int TodoFinderComponent::getNumRows()
+{
+    return (int) results.size();
+}
+
+void TodoFinderComponent::paintListBoxItem (int rowNumber, juce::Graphics& g, int width, int height, bool rowIsSelected)
+{
+    if (! juce::isPositiveAndBelow (rowNumber, (int) results.size()))
+        return;
+    
+    if (rowIsSelected)
+        g.fillAll (juce::Colours::lightblue.withAlpha (0.25f));
+    
+    g.setColour (juce::Colours::white);
+    g.setFont (juce::Font (15.0f));
+    g.drawText (itemTexts[results[(size_t) rowNumber].candidate], 6, 0, width - 12, height,
+                juce::Justification::centredLeft, true);
+}
+
+void TodoFinderComponent::listBoxItemDoubleClicked (int row, const juce::MouseEvent&)
+{
+    chooseRow (row);
+}
@@ -0,0 +1,114 @@
+/*
+  ==============================================================================
+
+    Quick-open style fuzzy finder over the todo list.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+
+//==============================================================================
+/**
+ * Ranks candidates against a query the way fzf does: the query characters must
+ * appear in order, matches at word boundaries and runs of consecutive matches
+ * score higher, and gaps cost a little.
+ *
+ * Candidates are prepared once into flat lower-cased character arrays with a
+ * 64-bit character mask, so most of them are rejected by a single AND before
+ * the matching loop runs. Each candidate also keeps, per character bucket it
+ * contains, a bitmask of the positions holding it, so finding the next match
+ * looks at 64 positions per step instead of one. Extending the previous query
+ * only re-scores the candidates that matched it.
+ */
+class FuzzyMatcher
+{
+public:
+    struct Result
+    {
+        int candidate; // index into the array given to setCandidates()
+        int score;
+    };
+    
+    void setCandidates (const juce::StringArray& texts);
+    int getNumCandidates() const { return (int) candidates.size(); }
+    
+    // Best matches first, at most maxResults of them
+    std::vector<Result> search (const juce::String& query, int maxResults);
+    
+private:
+    struct Candidate
+    {
+        std::vector<juce::juce_wchar> text, lower;
+        juce::uint64 mask = 0;
+        
+        // numWords words per bit set in mask, in bit order. Bit i of word w is
+        // set when lower[w * 64 + i] falls in that bit's bucket
+        std::vector<juce::uint64> positions;
+        size_t numWords = 0;
+    };
+    
+    std::vector<Candidate> candidates;
+    
+    // Candidates that matched lastQuery, the only ones a longer query can match
+    juce::String lastQuery;
+    std::vector<int> lastMatches;
+    bool hasLastQuery = false;
+    
+    static juce::uint64 getCharacterMask (const std::vector<juce::juce_wchar>& lower);
+    static void setPositions (Candidate& candidate);
+    static size_t findNext (const Candidate& candidate, juce::juce_wchar c, size_t from);
+    static int scoreCandidate (const Candidate& candidate, const std::vector<juce::juce_wchar>& query);
+    static int getBoundaryBonus (const Candidate& candidate, size_t index);
+};
+
+//==============================================================================
+/**
+ * Popup with a query field and ranked results, shown over the editor.
+ */
+class TodoFinderComponent : public juce::Component,
+                            private juce::TextEditor::Listener,
+                            private juce::KeyListener,
+                            private juce::ListBoxModel
+{
+public:
+    TodoFinderComponent();
+    ~TodoFinderComponent() override;
+    
+    // Texts and the ids they belong to, ids are passed back through onItemChosen
+    void setItems (const juce::StringArray& texts, const juce::Array<juce::int64>& ids);
+    
+    std::function<void (juce::int64 id)> onItemChosen;
+    std::function<void()> onDismiss;
+    
+    void paint (juce::Graphics& g) override;
+    void resized() override;
+    void grabQueryFocus();
+    
+private:
+    juce::TextEditor queryField;
+    juce::ListBox resultsList;
+    FuzzyMatcher matcher;
+    juce::StringArray itemTexts;
+    juce::Array<juce::int64> itemIds;
+    std::vector<FuzzyMatcher::Result> results;
+    
+    static constexpr int maxResults = 50;
+    
+    void updateResults();
+    void chooseRow (int row);
+    
+    void textEditorTextChanged (juce::TextEditor&) override;
+    void textEditorReturnKeyPressed (juce::TextEditor&) override;
+    void textEditorEscapeKeyPressed (juce::TextEditor&) override;
+    bool keyPressed (const juce::KeyPress& key, juce::Component* originatingComponent) override;
+    
+    int getNumRows() override;
+    void paintListBoxItem (int rowNumber, juce::Graphics& g, int width, int height, bool rowIsSelected) override;
+    void listBoxItemDoubleClicked (int row, const juce::MouseEvent&) override;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TodoFinderComponent)
+};
@@ -0,0 +1,98 @@
+/*
+  ==============================================================================
+
+    Peak and level summary of a track, keyed by transport position.
+
+  ==============================================================================
+*/
+
+#include "LevelTimeline.h"
+
+LevelTimeline::LevelTimeline()
+{
+    for (auto& level : levels)
+        level.resize ((size_t) binsPerLevel);
+    
+    lastWrittenBin.fill (-1);
+}
+
+double LevelTimeline::getBinSeconds (int level)
+{
+    return finestBinSeconds * (double) (1 << level);
+}
+
+int LevelTimeline::getLevelFor (double lengthSeconds, int maxBins)
+{
+    for (int level = 0; level < numLevels; ++level)
+        if (lengthSeconds <= getLevelLength (level) && lengthSeconds / getBinSeconds (level) <= (double) maxBins)
+            return level;
+    
+    return numLevels - 1;
+}
+
+void LevelTimeline::addBlock (double timeSeconds, int numSamples, int numChannels,
+                              const ChannelLevels& peaks, const ChannelLevels& meanSquares)
+{
+    if (timeSeconds < 0.0 || numSamples <= 0 || numChannels <= 0)
+        return;
+    
+    numChannels = juce::jmin (numChannels, maxChannels);
+    
+    for (int level = 0; level < numLevels; ++level)
+    {
+        auto index = (int) (timeSeconds / getBinSeconds (level));
+        if (index >= binsPerLevel)
+            continue;
+        
+        auto& bin = levels[(size_t) level][(size_t) index];
+        
+        // Arriving at a different bin starts a new pass over it
+        if (index != lastWrittenBin[(size_t) level])
+        {
+            bin = {};
+            lastWrittenBin[(size_t) level] = index;
+        }
+        
+        for (size_t ch = 0; ch < (size_t) numChannels; ++ch)
+        {
+            bin.peak[ch] = juce::jmax (bin.peak[ch], peaks[ch]);
+            bin.sumOfSquares[ch] += meanSquares[ch] * (float) numSamples;
+        }
+        
+        bin.numSamples += (juce::uint32) numSamples;
+        bin.numChannels = juce::jmax (bin.numChannels, numChannels);
+    }
+    
+    endTime = juce::jmax (endTime, timeSeconds);
+}
+
+void LevelTimeline::clear()
+{
+    for (auto& level : levels)
+        std::fill (level.begin(), level.end(), Bin());
+    
+    lastWrittenBin.fill (-1);
+    endTime = 0.0;
+}
+
+float LevelTimeline::getShortTermDecibels (int level, int index) const
+{
+    auto windowBins = juce::jmax (1, (int) std::round (shortTermWindowSeconds / getBinSeconds (level)));
+    
+    double sum = 0.0;
+    double samples = 0.0;
+    for (int i = juce::jmax (0, index - windowBins + 1); i <= index; ++i)
+    {
+        const auto& bin = getBin (level, i);
+        for (int ch = 0; ch < bin.numChannels; ++ch)
+        {
+            sum += bin.sumOfSquares[(size_t) ch];
+            samples += bin.numSamples;
+        }
+    }
+    
+    if (samples <= 0.0)
+        return -100.0f;
+    
+    return juce::Decibels::gainToDecibels ((float) std::sqrt (sum / samples), -100.0f);
+}
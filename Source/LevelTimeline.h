@@ -0,0 +1,84 @@
+/*
+  ==============================================================================
+
+    Peak and level summary of a track, keyed by transport position.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <vector>
+
+//==============================================================================
+/**
+ * Multi-resolution summary of per-block levels along the host timeline.
+ *
+ * Level 0 has 100 ms bins and each level above halves the resolution. Every level
+ * has the same fixed number of bins starting at time zero, so level 0 covers the
+ * first ~7 minutes and the coarsest about 7 hours. Positions past a level's end
+ * only land in the coarser levels. Memory stays the same however long the
+ * session runs.
+ *
+ * Playing over a stretch again replaces what was there instead of averaging, so
+ * the summary shows the latest pass after a fix.
+ *
+ * Levels are kept per channel of the main pair. Any channels past the first two
+ * are folded onto left or right by parity (surround layouts put their pairs
+ * next to each other), which keeps a bin the same size whatever the layout.
+ *
+ * Message thread only, fed from the processor's level fifo.
+ */
+class LevelTimeline
+{
+public:
+    static constexpr int numLevels = 7;
+    static constexpr int binsPerLevel = 4096;
+    static constexpr double finestBinSeconds = 0.1;
+    static constexpr double shortTermWindowSeconds = 3.0;
+    static constexpr int maxChannels = 2;
+    
+    using ChannelLevels = std::array<float, maxChannels>;
+    
+    struct Bin
+    {
+        ChannelLevels peak {};
+        ChannelLevels sumOfSquares {}; // mean square of each block times its length
+        juce::uint32 numSamples = 0;
+        int numChannels = 0;
+        
+        bool isEmpty() const { return numSamples == 0; }
+        float getMeanSquare (int channel) const { return numSamples > 0 ? sumOfSquares[(size_t) channel] / (float) numSamples : 0.0f; }
+    };
+    
+    LevelTimeline();
+    
+    void addBlock (double timeSeconds, int numSamples, int numChannels,
+                   const ChannelLevels& peaks, const ChannelLevels& meanSquares);
+    void clear();
+    
+    bool isEmpty() const { return endTime <= 0.0; }
+    double getEndTime() const { return endTime; }
+    
+    static double getBinSeconds (int level);
+    static double getLevelLength (int level) { return getBinSeconds (level) * binsPerLevel; }
+    
+    // Finest level that covers lengthSeconds in no more than maxBins bins
+    static int getLevelFor (double lengthSeconds, int maxBins);
+    
+    const Bin& getBin (int level, int index) const { return levels[(size_t) level][(size_t) index]; }
+    
+    // Mean square over the shortTermWindowSeconds ending at this bin, averaged over
+    // the channels, in decibels. Unweighted, so it tracks loudness without being a
+    // calibrated LUFS reading
+    float getShortTermDecibels (int level, int index) const;
+    
+private:
+    std::array<std::vector<Bin>, numLevels> levels;
+    std::array<int, numLevels> lastWrittenBin;
+    double endTime = 0.0;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LevelTimeline)
+};
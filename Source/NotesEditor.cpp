@@ -0,0 +1,1486 @@
+/*
+  ==============================================================================
+
+    Notes pane: a gap buffer document with a line index, and an editor
+    component that only lays out the lines it shows.
+
+  ==============================================================================
+*/
+
+#include "NotesEditor.h"
+#include <algorithm>
+
+//==============================================================================
+NotesDocument::NotesDocument()
+{
+    lineStarts.push_back (0);
+}
+
+void NotesDocument::appendText (const juce::String& text, std::vector<juce::juce_wchar>& dest) const
+{
+    for (auto p = text.getCharPointer(); ! p.isEmpty();)
+    {
+        auto c = p.getAndAdvance();
+        
+        // "\r\n" and a lone "\r" both become "\n"
+        if (c == '\r')
+        {
+            if (*p == '\n')
+                continue;
+            
+            c = '\n';
+        }
+        
+        dest.push_back (c);
+    }
+}
+
+void NotesDocument::setText (const juce::String& newText)
+{
+    buffer.clear();
+    appendText (newText, buffer);
+    gapStart = gapEnd = (int) buffer.size();
+    
+    lineStarts.assign (1, 0);
+    for (int i = 0; i < (int) buffer.size(); ++i)
+        if (buffer[(size_t) i] == '\n')
+            lineStarts.push_back (i + 1);
+}
+
+juce::String NotesDocument::getText() const
+{
+    return getTextInRange ({ 0, getLength() });
+}
+
+juce::String NotesDocument::getTextInRange (juce::Range<int> range) const
+{
+    range = range.getIntersectionWith ({ 0, getLength() });
+    
+    auto makeString = [this] (int bufferStart, int numChars)
+    {
+        return numChars > 0 ? juce::String (juce::CharPointer_UTF32 (buffer.data() + bufferStart), (size_t) numChars)
+                            : juce::String();
+    };
+    
+    // Up to two pieces, either side of the gap
+    auto gapSize = gapEnd - gapStart;
+    auto beforeGap = juce::Range<int> (0, gapStart).getIntersectionWith (range);
+    auto afterGap = juce::Range<int> (gapStart, getLength()).getIntersectionWith (range);
+    
+    if (afterGap.isEmpty())
+        return makeString (beforeGap.getStart(), beforeGap.getLength());
+    
+    if (beforeGap.isEmpty())
+        return makeString (afterGap.getStart() + gapSize, afterGap.getLength());
+    
+    return makeString (beforeGap.getStart(), beforeGap.getLength())
+         + makeString (afterGap.getStart() + gapSize, afterGap.getLength());
+}
+
+juce::juce_wchar NotesDocument::getCharacter (int position) const
+{
+    if (! juce::isPositiveAndBelow (position, getLength()))
+        return 0;
+    
+    return buffer[(size_t) (position < gapStart ? position : position + gapEnd - gapStart)];
+}
+
+void NotesDocument::moveGapTo (int position)
+{
+    if (position < gapStart)
+    {
+        auto numToMove = gapStart - position;
+        std::move_backward (buffer.begin() + position, buffer.begin() + gapStart, buffer.begin() + gapEnd);
+        gapStart -= numToMove;
+        gapEnd -= numToMove;
+    }
+    else if (position > gapStart)
+    {
+        auto numToMove = position - gapStart;
+        std::move (buffer.begin() + gapEnd, buffer.begin() + gapEnd + numToMove, buffer.begin() + gapStart);
+        gapStart += numToMove;
+        gapEnd += numToMove;
+    }
+}
+
+void NotesDocument::ensureGap (int size)
+{
+    if (gapEnd - gapStart >= size)
+        return;
+    
+    // Grow in proportion to the document, so a run of typing rarely reallocates
+    auto newGapSize = juce::jmax (size, 1024, getLength() / 8);
+    auto numAfterGap = (int) buffer.size() - gapEnd;
+    
+    std::vector<juce::juce_wchar> newBuffer ((size_t) (getLength() + newGapSize));
+    std::copy (buffer.begin(), buffer.begin() + gapStart, newBuffer.begin());
+    std::copy (buffer.begin() + gapEnd, buffer.end(), newBuffer.end() - numAfterGap);
+    
+    buffer.swap (newBuffer);
+    gapEnd = gapStart + newGapSize;
+}
+
+juce::String NotesDocument::replace (juce::Range<int> range, const juce::String& text)
+{
+    range = range.getIntersectionWith ({ 0, getLength() });
+    
+    std::vector<juce::juce_wchar> inserted;
+    appendText (text, inserted);
+    
+    moveGapTo (range.getStart());
+    gapEnd += range.getLength();
+    ensureGap ((int) inserted.size());
+    std::copy (inserted.begin(), inserted.end(), buffer.begin() + gapStart);
+    gapStart += (int) inserted.size();
+    
+    // Line starts inside the removed text go, the ones after it shift, and every
+    // inserted newline adds one
+    auto delta = (int) inserted.size() - range.getLength();
+    auto firstRemoved = std::upper_bound (lineStarts.begin(), lineStarts.end(), range.getStart());
+    auto lastRemoved = std::upper_bound (firstRemoved, lineStarts.end(), range.getEnd());
+    auto following = lineStarts.erase (firstRemoved, lastRemoved);
+    
+    for (auto i = following; i != lineStarts.end(); ++i)
+        *i += delta;
+    
+    std::vector<int> newStarts;
+    for (int i = 0; i < (int) inserted.size(); ++i)
+        if (inserted[(size_t) i] == '\n')
+            newStarts.push_back (range.getStart() + i + 1);
+    
+    lineStarts.insert (following, newStarts.begin(), newStarts.end());
+    
+    return inserted.empty() ? juce::String()
+                            : juce::String (juce::CharPointer_UTF32 (inserted.data()), inserted.size());
+}
+
+int NotesDocument::getLineEnd (int line) const
+{
+    return line + 1 < getNumLines() ? lineStarts[(size_t) line + 1] - 1 : getLength();
+}
+
+int NotesDocument::getLineForPosition (int position) const
+{
+    return (int) (std::upper_bound (lineStarts.begin(), lineStarts.end(), position) - lineStarts.begin()) - 1;
+}
+
+juce::String NotesDocument::getLine (int line) const
+{
+    return getTextInRange ({ getLineStart (line), getLineEnd (line) });
+}
+
+//==============================================================================
+class NotesEditor::TextInterface : public juce::AccessibilityTextInterface
+{
+public:
+    explicit TextInterface (NotesEditor& editorToWrap) : editor (editorToWrap) {}
+    
+    bool isDisplayingProtectedText() const override        { return false; }
+    bool isReadOnly() const override                       { return ! editor.isEnabled(); }
+    int getTotalNumCharacters() const override             { return editor.document.getLength(); }
+    juce::Range<int> getSelection() const override         { return editor.getHighlightedRegion(); }
+    void setSelection (juce::Range<int> newRange) override { editor.setHighlightedRegion (newRange); }
+    int getTextInsertionOffset() const override            { return editor.caretPosition; }
+    juce::String getText (juce::Range<int> range) const override { return editor.document.getTextInRange (range); }
+    
+    void setText (const juce::String& newText) override
+    {
+        // Recorded like any other edit, so it can be undone
+        editor.closeUndoGroup();
+        editor.replaceRange ({ 0, editor.document.getLength() }, newText);
+        editor.closeUndoGroup();
+    }
+    
+    juce::RectangleList<int> getTextBounds (juce::Range<int> textRange) const override
+    {
+        auto bounds = editor.getTextBounds (textRange);
+        bounds.offsetAll (editor.getScreenPosition());
+        return bounds;
+    }
+    
+    int getOffsetAtPoint (juce::Point<int> point) const override
+    {
+        return editor.getCharIndexForPoint (editor.getLocalPoint (nullptr, point));
+    }
+    
+private:
+    NotesEditor& editor;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TextInterface)
+};
+
+//==============================================================================
+NotesEditor::NotesEditor()
+{
+    setWantsKeyboardFocus (true);
+    setMouseCursor (juce::MouseCursor::IBeamCursor);
+    
+    for (auto* scrollBar : { &verticalScrollBar, &horizontalScrollBar })
+    {
+        scrollBar->setAutoHide (false);
+        scrollBar->addListener (this);
+        addChildComponent (scrollBar);
+    }
+    
+    resetLineRows();
+    setFont (font);
+}
+
+NotesEditor::~NotesEditor()
+{
+}
+
+//==============================================================================
+void NotesEditor::setText (const juce::String& newText)
+{
+    document.setText (newText);
+    
+    layoutCache.clear();
+    widestLaidOutLine = 0.0f;
+    highlightedRanges.clear();
+    underlinedRanges.clear();
+    caretPosition = selectionAnchor = 0;
+    desiredCaretX = -1.0f;
+    
+    resetLineRows();
+    setScrollPosition (0.0f, 0);
+    
+    if (auto* handler = getAccessibilityHandler())
+        handler->notifyAccessibilityEvent (juce::AccessibilityEvent::textChanged);
+}
+
+void NotesEditor::insertTextAtCaret (const juce::String& text)
+{
+    insertText (text);
+}
+
+void NotesEditor::applyEdit (juce::Range<int> range, const juce::String& text)
+{
+    performReplace (range, text);
+}
+
+void NotesEditor::moveCaretToEnd()
+{
+    moveCaretTo (document.getLength(), false);
+}
+
+void NotesEditor::setHighlightedRegion (const juce::Range<int>& newRange)
+{
+    auto range = newRange.getIntersectionWith ({ 0, document.getLength() });
+    selectionAnchor = range.getStart();
+    caretPosition = range.getEnd();
+    desiredCaretX = -1.0f;
+    
+    scrollToKeepCaretOnScreen();
+    selectionChanged();
+}
+
+juce::Range<int> NotesEditor::getHighlightedRegion() const
+{
+    return { juce::jmin (selectionAnchor, caretPosition), juce::jmax (selectionAnchor, caretPosition) };
+}
+
+void NotesEditor::setHighlightedRanges (const juce::Array<juce::Range<int>>& ranges)
+{
+    highlightedRanges = ranges;
+    repaint();
+}
+
+void NotesEditor::setTextToShowWhenEmpty (const juce::String& text, juce::Colour colour)
+{
+    placeholderText = text;
+    placeholderColour = colour;
+    repaint();
+}
+
+void NotesEditor::setFont (const juce::Font& newFont)
+{
+    auto firstLine = getFirstVisibleLine();
+    
+    font = newFont;
+    lineHeight = juce::jmax (1, (int) std::ceil (font.getHeight()));
+    tabWidth = font.getStringWidthFloat (" ") * (float) tabSpaces;
+    averageCharacterWidth = font.getStringWidthFloat ("The quick brown fox jumps over the lazy dog. ") / 45.0f;
+    
+    layoutCache.clear();
+    widestLaidOutLine = 0.0f;
+    resetLineRows();
+    setScrollPosition (scrollX, getRowsBefore (firstLine) * lineHeight);
+}
+
+void NotesEditor::setWordWrap (bool shouldWrap)
+{
+    if (wordWrap == shouldWrap)
+        return;
+    
+    wordWrap = shouldWrap;
+    updateWrapWidth();
+}
+
+void NotesEditor::updateWrapWidth()
+{
+    // The vertical scrollbar's space is always left out, so it coming and going
+    // doesn't change where lines wrap
+    auto newWrapWidth = wordWrap ? (float) juce::jmax (1, getWidth() - getLookAndFeel().getDefaultScrollbarWidth() - textIndent * 2)
+                                 : 0.0f;
+    
+    if (newWrapWidth != wrapWidth)
+    {
+        auto firstLine = getFirstVisibleLine();
+        
+        wrapWidth = newWrapWidth;
+        layoutCache.clear();
+        widestLaidOutLine = 0.0f;
+        resetLineRows();
+        scrollY = getRowsBefore (firstLine) * lineHeight;
+    }
+    
+    setScrollPosition (scrollX, scrollY);
+}
+
+//==============================================================================
+int NotesEditor::estimateChunkRows (int numCharacters) const
+{
+    if (wrapWidth <= 0.0f)
+        return 1;
+    
+    return juce::jmax (1, (int) std::ceil ((float) numCharacters * averageCharacterWidth / wrapWidth));
+}
+
+int NotesEditor::estimateRows (int line) const
+{
+    // As if every chunk but the last were full
+    auto length = document.getLineEnd (line) - document.getLineStart (line);
+    auto fullChunks = length / maxChunkCharacters;
+    auto rest = length % maxChunkCharacters;
+    
+    return fullChunks * estimateChunkRows (maxChunkCharacters) + (rest > 0 || fullChunks == 0 ? estimateChunkRows (rest) : 0);
+}
+
+void NotesEditor::resetLineRows()
+{
+    lineRows.resize ((size_t) document.getNumLines());
+    for (int line = 0; line < document.getNumLines(); ++line)
+        lineRows[(size_t) line] = estimateRows (line);
+    
+    rebuildRowTree();
+}
+
+void NotesEditor::rebuildRowTree()
+{
+    auto numLines = (int) lineRows.size();
+    rowTree.assign ((size_t) numLines + 1, 0);
+    totalRows = 0;
+    
+    for (int i = 1; i <= numLines; ++i)
+    {
+        rowTree[(size_t) i] += lineRows[(size_t) i - 1];
+        totalRows += lineRows[(size_t) i - 1];
+        
+        auto parent = i + (i & -i);
+        if (parent <= numLines)
+            rowTree[(size_t) parent] += rowTree[(size_t) i];
+    }
+}
+
+void NotesEditor::setLineRows (int line, int rows)
+{
+    auto delta = rows - lineRows[(size_t) line];
+    if (delta == 0)
+        return;
+    
+    lineRows[(size_t) line] = rows;
+    totalRows += delta;
+    
+    for (int i = line + 1; i < (int) rowTree.size(); i += i & -i)
+        rowTree[(size_t) i] += delta;
+    
+    lineRowsChanged = true;
+}
+
+void NotesEditor::replaceRows (int line, int firstRow, int oldRows, int newRows)
+{
+    // Rows wholly above the view move the scroll position by the same amount, so the
+    // lines in view don't jump
+    if (newRows == oldRows)
+        return;
+    
+    if ((getRowsBefore (line) + firstRow + oldRows) * lineHeight <= scrollY)
+        scrollY += (newRows - oldRows) * lineHeight;
+    
+    setLineRows (line, lineRows[(size_t) line] + newRows - oldRows);
+}
+
+void NotesEditor::updateLineRows (int firstLine, int lastLine, int newLastLine)
+{
+    // Edited lines start from an estimate again, laying them out corrects it straight away
+    // if they're in view
+    if (newLastLine == lastLine)
+    {
+        for (int line = firstLine; line <= lastLine; ++line)
+            setLineRows (line, estimateRows (line));
+        
+        return;
+    }
+    
+    // Lines came or went, every count after them moves (as the document's line starts do)
+    lineRows.erase (lineRows.begin() + firstLine, lineRows.begin() + lastLine + 1);
+    std::vector<int> estimates;
+    for (int line = firstLine; line <= newLastLine; ++line)
+        estimates.push_back (estimateRows (line));
+    
+    lineRows.insert (lineRows.begin() + firstLine, estimates.begin(), estimates.end());
+    rebuildRowTree();
+    lineRowsChanged = true;
+}
+
+int NotesEditor::getRowsBefore (int line) const
+{
+    auto rows = 0;
+    for (int i = juce::jmin (line, (int) lineRows.size()); i > 0; i -= i & -i)
+        rows += rowTree[(size_t) i];
+    
+    return rows;
+}
+
+int NotesEditor::getLineAtRow (int row) const
+{
+    // Descends the tree to the last line starting at or before the row
+    auto numLines = (int) lineRows.size();
+    auto line = 0;
+    
+    for (auto step = juce::nextPowerOfTwo (numLines + 1) / 2; step > 0; step /= 2)
+    {
+        if (line + step <= numLines && rowTree[(size_t) (line + step)] <= row)
+        {
+            line += step;
+            row -= rowTree[(size_t) line];
+        }
+    }
+    
+    return juce::jlimit (0, numLines - 1, line);
+}
+
+int NotesEditor::getFirstVisibleLine() const
+{
+    return getLineAtRow (scrollY / lineHeight);
+}
+
+int NotesEditor::getLastVisibleLine() const
+{
+    return getLineAtRow ((scrollY + textArea.getHeight()) / lineHeight);
+}
+
+//==============================================================================
+int NotesEditor::LineChunk::getRow (int column) const
+{
+    return (int) (std::upper_bound (rowStarts.begin(), rowStarts.end(), column) - rowStarts.begin()) - 1;
+}
+
+float NotesEditor::LineChunk::getX (int row, int column) const
+{
+    // The end of a wrapped row is where the next row starts, its offset belongs to that row
+    return column == getRowEnd (row) && row + 1 < (int) rowStarts.size() ? rowWidths[(size_t) row]
+                                                                       : xOffsets[(size_t) column];
+}
+
+void NotesEditor::LineChunk::release()
+{
+    glyphs.clear();
+    xOffsets = {};
+    rowStarts = {};
+    rowWidths = {};
+    isLaidOut = false;
+}
+
+int NotesEditor::LineLayout::getChunkForColumn (int column) const
+{
+    auto next = std::upper_bound (chunks.begin(), chunks.end(), column,
+                                  [] (int c, const LineChunk& chunk) { return c < chunk.start; });
+    return juce::jmax (0, (int) (next - chunks.begin()) - 1);
+}
+
+int NotesEditor::LineLayout::getChunkForRow (int row) const
+{
+    return juce::jmax (0, (int) (std::upper_bound (firstRows.begin(), firstRows.end(), row) - firstRows.begin()) - 1);
+}
+
+void NotesEditor::LineLayout::updateRows()
+{
+    firstRows.resize (chunks.size());
+    numRows = 0;
+    
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+        firstRows[i] = numRows;
+        numRows += chunks[i].numRows;
+    }
+}
+
+const NotesEditor::LineLayout& NotesEditor::getLineLayout (int line)
+{
+    auto cached = layoutCache.find (line);
+    if (cached != layoutCache.end())
+        return cached->second;
+    
+    auto& layout = layoutCache[line];
+    auto lineStart = document.getLineStart (line);
+    layout.numCharacters = document.getLineEnd (line) - lineStart;
+    
+    // Only the few characters before each limit are looked at, so a long line costs
+    // little until its chunks come into view
+    for (int start = 0;;)
+    {
+        auto end = juce::jmin (start + maxChunkCharacters, layout.numCharacters);
+        
+        if (end < layout.numCharacters)
+        {
+            for (int column = end; column > end - maxChunkCharacters / 16; --column)
+            {
+                if (juce::CharacterFunctions::isWhitespace (document.getCharacter (lineStart + column - 1)))
+                {
+                    end = column;
+                    break;
+                }
+            }
+        }
+        
+        layout.chunks.emplace_back();
+        auto& chunk = layout.chunks.back();
+        chunk.start = start;
+        chunk.numCharacters = end - start;
+        chunk.numRows = estimateChunkRows (chunk.numCharacters);
+        
+        start = end;
+        if (start >= layout.numCharacters)
+            break;
+    }
+    
+    layout.updateRows();
+    replaceRows (line, 0, lineRows[(size_t) line], layout.getNumRows());
+    
+    if (layout.chunks.size() == 1)
+        getLineChunk (line, 0);
+    
+    return layout;
+}
+
+const NotesEditor::LineChunk& NotesEditor::getLineChunk (int line, int index)
+{
+    getLineLayout (line);
+    auto& layout = layoutCache[line];
+    auto& chunk = layout.chunks[(size_t) index];
+    
+    if (chunk.isLaidOut)
+        return chunk;
+    
+    auto chunkStart = document.getLineStart (line) + chunk.start;
+    chunk.xOffsets.reserve ((size_t) chunk.numCharacters + 1);
+    chunk.rowStarts.push_back (0);
+    
+    auto isTab = [&] (int column) { return document.getCharacter (chunkStart + column) == '\t'; };
+    auto getRun = [&] (int start, int end) { return document.getTextInRange ({ chunkStart + start, chunkStart + end }); };
+    
+    // First every character's offset as if the chunk didn't wrap. Tabs split it into
+    // runs, each run is measured on its own.
+    float x = 0.0f;
+    
+    auto measureRun = [&] (int start, int end)
+    {
+        if (start == end)
+            return;
+        
+        juce::Array<int> glyphNumbers;
+        juce::Array<float> offsets;
+        font.getGlyphPositions (getRun (start, end), glyphNumbers, offsets);
+        
+        auto runLength = end - start;
+        auto runWidth = offsets.isEmpty() ? 0.0f : offsets.getLast();
+        
+        // One glyph per character is the normal case, otherwise spread the run evenly
+        for (int i = 0; i < runLength; ++i)
+            chunk.xOffsets.push_back (x + (offsets.size() == runLength + 1 ? offsets[i] : runWidth * (float) i / (float) runLength));
+        
+        x += runWidth;
+    };
+    
+    auto runStart = 0;
+    for (int column = 0; column < chunk.numCharacters; ++column)
+    {
+        if (! isTab (column))
+            continue;
+        
+        measureRun (runStart, column);
+        chunk.xOffsets.push_back (x);
+        x = (std::floor (x / tabWidth) + 1.0f) * tabWidth;
+        runStart = column + 1;
+    }
+    
+    measureRun (runStart, chunk.numCharacters);
+    chunk.xOffsets.push_back (x);
+    
+    // Rows break after the last space that fits, or inside a word wider than the row.
+    // Spaces themselves never start a row, they hang past the edge as in TextEditor.
+    if (wrapWidth > 0.0f)
+    {
+        auto rowStart = 0, lastBreak = 0;
+        
+        for (int column = 0; column < chunk.numCharacters; ++column)
+        {
+            auto isSpace = juce::CharacterFunctions::isWhitespace (document.getCharacter (chunkStart + column));
+            
+            if (! isSpace && column > rowStart && chunk.xOffsets[(size_t) column + 1] - chunk.xOffsets[(size_t) rowStart] > wrapWidth)
+            {
+                rowStart = lastBreak > rowStart ? lastBreak : column;
+                chunk.rowStarts.push_back (rowStart);
+            }
+            
+            if (isSpace)
+                lastBreak = column + 1;
+        }
+    }
+    
+    // Then each row is shaped with its own baseline, and offsets made relative to the row
+    auto baseline = font.getAscent();
+    auto numRows = (int) chunk.rowStarts.size();
+    
+    for (int row = 0; row < numRows; ++row)
+    {
+        auto start = chunk.rowStarts[(size_t) row];
+        auto end = chunk.getRowEnd (row);
+        auto rowLeft = chunk.xOffsets[(size_t) start];
+        chunk.rowWidths.push_back (chunk.xOffsets[(size_t) end] - rowLeft);
+        
+        for (int column = start, runBegin = start; column <= end; ++column)
+        {
+            if (column < end && ! isTab (column))
+                continue;
+            
+            if (column > runBegin)
+                chunk.glyphs.addLineOfText (font, getRun (runBegin, column), chunk.xOffsets[(size_t) runBegin] - rowLeft,
+                                            baseline + (float) (row * lineHeight));
+            
+            runBegin = column + 1;
+        }
+    }
+    
+    for (int row = 0; row < numRows; ++row)
+    {
+        auto start = chunk.rowStarts[(size_t) row];
+        auto end = row + 1 < numRows ? chunk.getRowEnd (row) : chunk.numCharacters + 1;
+        auto rowLeft = chunk.xOffsets[(size_t) start];
+        
+        for (int column = start; column < end; ++column)
+            chunk.xOffsets[(size_t) column] -= rowLeft;
+    }
+    
+    auto widest = *std::max_element (chunk.rowWidths.begin(), chunk.rowWidths.end());
+    if (widest > widestLaidOutLine)
+    {
+        widestLaidOutLine = widest;
+        widestLineChanged = true;
+    }
+    
+    // Replace the estimate
+    chunk.isLaidOut = true;
+    
+    if (numRows != chunk.numRows)
+    {
+        auto oldRows = chunk.numRows;
+        chunk.numRows = numRows;
+        layout.updateRows();
+        replaceRows (line, layout.firstRows[(size_t) index], oldRows, numRows);
+    }
+    
+    return chunk;
+}
+
+juce::Range<int> NotesEditor::layoutChunksInView (int line)
+{
+    const auto& layout = getLineLayout (line);
+    auto rowsBefore = getRowsBefore (line);
+    auto first = layout.getChunkForRow (scrollY / lineHeight - rowsBefore);
+    auto last = layout.getChunkForRow ((scrollY + textArea.getHeight()) / lineHeight - rowsBefore);
+    
+    for (auto index = first; index <= last; ++index)
+        getLineChunk (line, index);
+    
+    return { first, last + 1 };
+}
+
+void NotesEditor::trimLayoutCache()
+{
+    auto first = getFirstVisibleLine() - layoutMarginLines;
+    auto last = getLastVisibleLine() + layoutMarginLines;
+    
+    layoutCache.erase (layoutCache.begin(), layoutCache.lower_bound (first));
+    layoutCache.erase (layoutCache.upper_bound (last), layoutCache.end());
+    
+    // Long lines that stay only keep the chunks near the view
+    auto firstRow = scrollY / lineHeight - layoutMarginLines;
+    auto lastRow = (scrollY + textArea.getHeight()) / lineHeight + layoutMarginLines;
+    
+    for (auto& cached : layoutCache)
+    {
+        auto& layout = cached.second;
+        if (layout.chunks.size() < 2)
+            continue;
+        
+        auto rowsBefore = getRowsBefore (cached.first);
+        
+        for (size_t i = 0; i < layout.chunks.size(); ++i)
+        {
+            auto top = rowsBefore + layout.firstRows[i];
+            if (top > lastRow || top + layout.chunks[i].numRows <= firstRow)
+                layout.chunks[i].release();
+        }
+    }
+}
+
+void NotesEditor::invalidateLayout (int firstLine, int lastLine, bool lineCountChanged)
+{
+    // When lines come or go every cached line below the edit has a new number
+    auto end = lineCountChanged ? layoutCache.end() : layoutCache.upper_bound (lastLine);
+    layoutCache.erase (layoutCache.lower_bound (firstLine), end);
+}
+
+void NotesEditor::layoutVisibleLines()
+{
+    // The last visible line is looked up again after each line, laying one out can
+    // change how many fit
+    for (int line = getFirstVisibleLine(); line <= getLastVisibleLine(); ++line)
+        layoutChunksInView (line);
+    
+    trimLayoutCache();
+    
+    if (widestLineChanged || lineRowsChanged)
+    {
+        widestLineChanged = lineRowsChanged = false;
+        updateScrollBars();
+    }
+}
+
+//==============================================================================
+juce::Point<float> NotesEditor::getCharacterPosition (int position)
+{
+    auto line = document.getLineForPosition (position);
+    auto column = position - document.getLineStart (line);
+    auto index = getLineLayout (line).getChunkForColumn (column);
+    const auto& chunk = getLineChunk (line, index);
+    
+    column -= chunk.start;
+    auto row = getLineLayout (line).firstRows[(size_t) index] + chunk.getRow (column);
+    return { chunk.xOffsets[(size_t) column], (float) ((getRowsBefore (line) + row) * lineHeight) };
+}
+
+int NotesEditor::getColumnForX (const LineLayout& layout, int index, int row, float x) const
+{
+    // Nearest character edge to x on the row. At the end of a wrapped row or a chunk the
+    // position after the last character is shown at the start of the next row, so it
+    // can't be picked here.
+    const auto& chunk = layout.chunks[(size_t) index];
+    auto isLastRow = row + 1 == (int) chunk.rowStarts.size() && index + 1 == (int) layout.chunks.size();
+    auto first = chunk.rowStarts[(size_t) row];
+    auto last = isLastRow ? chunk.numCharacters : chunk.getRowEnd (row) - 1;
+    
+    auto begin = chunk.xOffsets.begin() + first, end = chunk.xOffsets.begin() + last + 1;
+    auto next = std::upper_bound (begin, end, x);
+    if (next == begin)
+        return chunk.start + first;
+    
+    if (next == end)
+        return chunk.start + last;
+    
+    auto column = (int) (next - chunk.xOffsets.begin());
+    return chunk.start + (x - *(next - 1) < *next - x ? column - 1 : column);
+}
+
+int NotesEditor::getPositionAt (juce::Point<int> point)
+{
+    auto row = juce::jlimit (0, totalRows - 1, (point.y - textArea.getY() + scrollY) / lineHeight);
+    auto line = getLineAtRow (row);
+    const auto& layout = getLineLayout (line);
+    
+    auto rowInLine = juce::jlimit (0, layout.getNumRows() - 1, row - getRowsBefore (line));
+    auto index = layout.getChunkForRow (rowInLine);
+    const auto& chunk = getLineChunk (line, index);
+    
+    auto rowInChunk = juce::jlimit (0, (int) chunk.rowStarts.size() - 1, rowInLine - layout.firstRows[(size_t) index]);
+    auto x = (float) (point.x - textArea.getX() - textIndent) + scrollX;
+    return document.getLineStart (line) + getColumnForX (layout, index, rowInChunk, x);
+}
+
+template <typename Callback>
+void NotesEditor::forEachRowSpan (int line, const LineLayout& layout, juce::Range<int> range, Callback&& callback) const
+{
+    auto lineStart = document.getLineStart (line);
+    auto lineEnd = document.getLineEnd (line);
+    auto lineTop = (float) (getRowsBefore (line) * lineHeight);
+    auto newlineWidth = tabWidth / (float) tabSpaces;
+    
+    auto start = juce::jmax (range.getStart(), lineStart) - lineStart;
+    auto end = juce::jmin (range.getEnd(), lineEnd) - lineStart;
+    
+    for (auto index = layout.getChunkForColumn (start); index < (int) layout.chunks.size(); ++index)
+    {
+        const auto& chunk = layout.chunks[(size_t) index];
+        if (chunk.start > end)
+            break;
+        
+        if (! chunk.isLaidOut)
+            continue;
+        
+        auto isLastChunk = index + 1 == (int) layout.chunks.size();
+        auto chunkTop = lineTop + (float) (layout.firstRows[(size_t) index] * lineHeight);
+        
+        for (int row = 0; row < (int) chunk.rowStarts.size(); ++row)
+        {
+            auto isLastRow = isLastChunk && row + 1 == (int) chunk.rowStarts.size();
+            auto from = juce::jmax (start - chunk.start, chunk.rowStarts[(size_t) row]);
+            auto to = juce::jmin (end - chunk.start, chunk.getRowEnd (row));
+            
+            // A range running past the end of the line also covers the newline
+            auto coversNewline = isLastRow && range.getEnd() > lineEnd;
+            if (from > to || (from == to && ! coversNewline))
+                continue;
+            
+            auto left = chunk.getX (row, from);
+            auto right = chunk.getX (row, to) + (coversNewline ? newlineWidth : 0.0f);
+            callback (juce::Rectangle<float> (left, chunkTop + (float) (row * lineHeight), right - left, (float) lineHeight));
+        }
+    }
+}
+
+//==============================================================================
+void NotesEditor::setTemporaryUnderlining (const juce::Array<juce::Range<int>>& underlinedRegions)
+{
+    underlinedRanges = underlinedRegions;
+    repaint();
+}
+
+juce::Rectangle<int> NotesEditor::getCaretRectangleForCharIndex (int index) const
+{
+    auto position = getLayoutOwner().getCharacterPosition (juce::jlimit (0, document.getLength(), index));
+    auto x = (float) (textArea.getX() + textIndent) - scrollX + position.x;
+    return { juce::roundToInt (x), textArea.getY() + juce::roundToInt (position.y) - scrollY, 2, lineHeight };
+}
+
+int NotesEditor::getCharIndexForPoint (juce::Point<int> point) const
+{
+    return getLayoutOwner().getPositionAt (point);
+}
+
+juce::RectangleList<int> NotesEditor::getTextBounds (juce::Range<int> textRange) const
+{
+    juce::RectangleList<int> bounds;
+    auto& owner = getLayoutOwner();
+    auto origin = juce::Point<float> ((float) (textArea.getX() + textIndent) - scrollX, (float) (textArea.getY() - scrollY));
+    
+    auto firstLine = juce::jmax (getFirstVisibleLine(), document.getLineForPosition (textRange.getStart()));
+    auto lastLine = juce::jmin (getLastVisibleLine(), document.getLineForPosition (textRange.getEnd()));
+    
+    for (int line = firstLine; line <= lastLine; ++line)
+        forEachRowSpan (line, owner.getLineLayout (line), textRange, [&] (juce::Rectangle<float> span)
+        {
+            bounds.addWithoutMerging (span.translated (origin.x, origin.y).getSmallestIntegerContainer());
+        });
+    
+    return bounds;
+}
+
+std::unique_ptr<juce::AccessibilityHandler> NotesEditor::createAccessibilityHandler()
+{
+    return std::make_unique<juce::AccessibilityHandler> (*this, juce::AccessibilityRole::editableText,
+                                                         juce::AccessibilityActions(),
+                                                         juce::AccessibilityHandler::Interfaces { std::make_unique<TextInterface> (*this) });
+}
+
+//==============================================================================
+void NotesEditor::replaceRange (juce::Range<int> range, const juce::String& text)
+{
+    if (range.isEmpty() && text.isEmpty())
+        return;
+    
+    auto removed = document.getTextInRange (range);
+    auto inserted = performReplace (range, text);
+    
+    if (undoJournal != nullptr)
+        undoJournal->recordNotesEdit (range.getStart(), removed, inserted);
+}
+
+juce::String NotesEditor::performReplace (juce::Range<int> range, const juce::String& text)
+{
+    auto firstLine = document.getLineForPosition (range.getStart());
+    auto lastLine = document.getLineForPosition (range.getEnd());
+    auto numLines = document.getNumLines();
+    
+    auto inserted = document.replace (range, text);
+    invalidateLayout (firstLine, lastLine, document.getNumLines() != numLines);
+    updateLineRows (firstLine, lastLine, lastLine + document.getNumLines() - numLines);
+    
+    // Ranges after the edit no longer line up, the owner sets them again once it has re-searched
+    highlightedRanges.clearQuick();
+    
+    caretPosition = selectionAnchor = range.getStart() + inserted.length();
+    desiredCaretX = -1.0f;
+    
+    updateScrollBars();
+    scrollToKeepCaretOnScreen();
+    selectionChanged();
+    
+    if (auto* handler = getAccessibilityHandler())
+        handler->notifyAccessibilityEvent (juce::AccessibilityEvent::textChanged);
+    
+    if (onTextChange != nullptr)
+        onTextChange();
+    
+    return inserted;
+}
+
+void NotesEditor::insertText (const juce::String& text)
+{
+    replaceRange (getHighlightedRegion(), text);
+}
+
+void NotesEditor::deleteBackwards (bool wholeWord)
+{
+    auto selection = getHighlightedRegion();
+    if (selection.isEmpty())
+        selection = { wholeWord ? findWordBoundary (caretPosition, false) : juce::jmax (0, caretPosition - 1), caretPosition };
+    
+    replaceRange (selection, {});
+}
+
+void NotesEditor::deleteForwards (bool wholeWord)
+{
+    auto selection = getHighlightedRegion();
+    if (selection.isEmpty())
+        selection = { caretPosition, wholeWord ? findWordBoundary (caretPosition, true) : juce::jmin (document.getLength(), caretPosition + 1) };
+    
+    replaceRange (selection, {});
+}
+
+//==============================================================================
+void NotesEditor::moveCaretTo (int position, bool extendSelection)
+{
+    caretPosition = juce::jlimit (0, document.getLength(), position);
+    if (! extendSelection)
+        selectionAnchor = caretPosition;
+    
+    // Moving away ends the current undo step
+    closeUndoGroup();
+    
+    scrollToKeepCaretOnScreen();
+    selectionChanged();
+}
+
+void NotesEditor::moveCaretVertically (int rows, bool extendSelection)
+{
+    if (desiredCaretX < 0.0f)
+        desiredCaretX = getCharacterPosition (caretPosition).x;
+    
+    auto line = document.getLineForPosition (caretPosition);
+    auto column = caretPosition - document.getLineStart (line);
+    auto index = getLineLayout (line).getChunkForColumn (column);
+    const auto& current = getLineChunk (line, index);
+    auto row = getLineLayout (line).firstRows[(size_t) index] + current.getRow (column - current.start) + rows;
+    auto x = desiredCaretX;
+    
+    // Moves by rows on screen, walking through the lines it crosses
+    while (row < 0 && line > 0)
+        row += getLineLayout (--line).getNumRows();
+    
+    while (row >= getLineLayout (line).getNumRows() && line + 1 < document.getNumLines())
+        row -= getLineLayout (line++).getNumRows();
+    
+    if (row < 0)
+        moveCaretTo (0, extendSelection);
+    else if (row >= getLineLayout (line).getNumRows())
+        moveCaretTo (document.getLength(), extendSelection);
+    else
+    {
+        // Laying out the chunk the row is in can change how many rows it has
+        auto target = getLineLayout (line).getChunkForRow (row);
+        const auto& chunk = getLineChunk (line, target);
+        const auto& layout = getLineLayout (line);
+        row = juce::jlimit (0, (int) chunk.rowStarts.size() - 1, row - layout.firstRows[(size_t) target]);
+        
+        moveCaretTo (document.getLineStart (line) + getColumnForX (layout, target, row, x), extendSelection);
+    }
+    
+    desiredCaretX = x;
+}
+
+int NotesEditor::findWordBoundary (int position, bool forwards) const
+{
+    auto isWordCharacter = [this] (int p) { return juce::CharacterFunctions::isLetterOrDigit (document.getCharacter (p)); };
+    
+    if (forwards)
+    {
+        while (position < document.getLength() && ! isWordCharacter (position))  ++position;
+        while (position < document.getLength() && isWordCharacter (position))    ++position;
+    }
+    else
+    {
+        while (position > 0 && ! isWordCharacter (position - 1))  --position;
+        while (position > 0 && isWordCharacter (position - 1))    --position;
+    }
+    
+    return position;
+}
+
+//==============================================================================
+void NotesEditor::copy()
+{
+    auto selection = getHighlightedRegion();
+    if (! selection.isEmpty())
+        juce::SystemClipboard::copyTextToClipboard (document.getTextInRange (selection));
+}
+
+void NotesEditor::cut()
+{
+    copy();
+    closeUndoGroup();
+    insertText ({});
+}
+
+void NotesEditor::paste()
+{
+    closeUndoGroup();
+    insertText (juce::SystemClipboard::getTextFromClipboard());
+    closeUndoGroup();
+}
+
+void NotesEditor::undoOrRedo (bool redo)
+{
+    if (undoJournal != nullptr)
+        redo ? undoJournal->redo() : undoJournal->undo();
+}
+
+void NotesEditor::closeUndoGroup()
+{
+    if (undoJournal != nullptr)
+        undoJournal->closeGroup();
+}
+
+void NotesEditor::selectAll()
+{
+    selectionAnchor = 0;
+    caretPosition = document.getLength();
+    selectionChanged();
+}
+
+void NotesEditor::showPopupMenu()
+{
+    juce::Component::SafePointer<NotesEditor> safeThis (this);
+    auto hasSelection = ! getHighlightedRegion().isEmpty();
+    
+    juce::PopupMenu menu;
+    menu.addItem ("Cut", hasSelection, false, [safeThis] { if (safeThis != nullptr) safeThis->cut(); });
+    menu.addItem ("Copy", hasSelection, false, [safeThis] { if (safeThis != nullptr) safeThis->copy(); });
+    menu.addItem ("Paste", true, false, [safeThis] { if (safeThis != nullptr) safeThis->paste(); });
+    menu.addItem ("Delete", hasSelection, false, [safeThis] { if (safeThis != nullptr) safeThis->insertText ({}); });
+    menu.addSeparator();
+    menu.addItem ("Select All", true, false, [safeThis] { if (safeThis != nullptr) safeThis->selectAll(); });
+    menu.addSeparator();
+    menu.addItem ("Undo", undoJournal != nullptr && undoJournal->canUndo(), false, [safeThis] { if (safeThis != nullptr) safeThis->undoOrRedo (false); });
+    menu.addItem ("Redo", undoJournal != nullptr && undoJournal->canRedo(), false, [safeThis] { if (safeThis != nullptr) safeThis->undoOrRedo (true); });
+    
+    menu.showMenuAsync (juce::PopupMenu::Options().withTargetComponent (this).withMousePosition());
+}
+
+//==============================================================================
+void NotesEditor::setScrollPosition (float newScrollX, int newScrollY)
+{
+    scrollX = newScrollX;
+    scrollY = newScrollY;
+    
+    updateScrollBars();
+    layoutVisibleLines();
+    repaint();
+}
+
+void NotesEditor::scrollToKeepCaretOnScreen()
+{
+    // Laying out the caret's line can move scrollY, so that comes first
+    auto caret = getCharacterPosition (caretPosition);
+    auto newScrollY = scrollY;
+    auto caretTop = juce::roundToInt (caret.y);
+    
+    if (caretTop < newScrollY)
+        newScrollY = caretTop;
+    else if (caretTop + lineHeight > newScrollY + textArea.getHeight())
+        newScrollY = caretTop + lineHeight - textArea.getHeight();
+    
+    auto newScrollX = scrollX;
+    auto caretX = caret.x;
+    auto visibleWidth = (float) (textArea.getWidth() - textIndent * 2);
+    
+    if (caretX < newScrollX)
+        newScrollX = juce::jmax (0.0f, caretX - visibleWidth / 3.0f);
+    else if (caretX > newScrollX + visibleWidth)
+        newScrollX = caretX - visibleWidth * 2.0f / 3.0f;
+    
+    setScrollPosition (newScrollX, newScrollY);
+}
+
+void NotesEditor::updateScrollBars()
+{
+    auto bounds = getLocalBounds();
+    auto thickness = getLookAndFeel().getDefaultScrollbarWidth();
+    auto contentHeight = totalRows * lineHeight;
+    auto contentWidth = wrapWidth > 0.0f ? 0 : (int) std::ceil (widestLaidOutLine) + textIndent * 2;
+    
+    auto showVertical = contentHeight > bounds.getHeight();
+    auto showHorizontal = contentWidth > bounds.getWidth() - (showVertical ? thickness : 0);
+    if (showHorizontal && ! showVertical)
+        showVertical = contentHeight > bounds.getHeight() - thickness;
+    
+    textArea = bounds.withTrimmedRight (showVertical ? thickness : 0)
+                     .withTrimmedBottom (showHorizontal ? thickness : 0);
+    
+    scrollY = juce::jlimit (0, juce::jmax (0, contentHeight - textArea.getHeight()), scrollY);
+    scrollX = juce::jlimit (0.0f, (float) juce::jmax (0, contentWidth - textArea.getWidth()), scrollX);
+    
+    verticalScrollBar.setVisible (showVertical);
+    verticalScrollBar.setBounds (textArea.getRight(), 0, thickness, textArea.getHeight());
+    verticalScrollBar.setRangeLimits (0.0, (double) juce::jmax (contentHeight, textArea.getHeight()), juce::dontSendNotification);
+    verticalScrollBar.setCurrentRange ((double) scrollY, (double) textArea.getHeight(), juce::dontSendNotification);
+    verticalScrollBar.setSingleStepSize ((double) lineHeight);
+    
+    horizontalScrollBar.setVisible (showHorizontal);
+    horizontalScrollBar.setBounds (0, textArea.getBottom(), textArea.getWidth(), thickness);
+    horizontalScrollBar.setRangeLimits (0.0, (double) juce::jmax (contentWidth, textArea.getWidth()), juce::dontSendNotification);
+    horizontalScrollBar.setCurrentRange ((double) scrollX, (double) textArea.getWidth(), juce::dontSendNotification);
+    horizontalScrollBar.setSingleStepSize ((double) lineHeight);
+}
+
+void NotesEditor::scrollBarMoved (juce::ScrollBar* scrollBar, double newRangeStart)
+{
+    if (scrollBar == &verticalScrollBar)
+        setScrollPosition (scrollX, juce::roundToInt (newRangeStart));
+    else
+        setScrollPosition ((float) newRangeStart, scrollY);
+}
+
+//==============================================================================
+void NotesEditor::resized()
+{
+    updateWrapWidth();
+}
+
+void NotesEditor::paint (juce::Graphics& g)
+{
+    g.fillAll (findColour (juce::TextEditor::backgroundColourId));
+    
+    {
+        juce::Graphics::ScopedSaveState saveState (g);
+        g.reduceClipRegion (textArea);
+        
+        auto lineX = (float) (textArea.getX() + textIndent) - scrollX;
+        
+        if (document.getLength() == 0 && placeholderText.isNotEmpty() && ! hasKeyboardFocus (false))
+        {
+            g.setColour (placeholderColour);
+            g.setFont (font);
+            g.drawText (placeholderText, juce::Rectangle<float> (lineX, (float) textArea.getY(), (float) textArea.getWidth(), (float) lineHeight),
+                        juce::Justification::centredLeft, true);
+        }
+        
+        auto selection = getHighlightedRegion();
+        auto highlightColour = findColour (juce::TextEditor::highlightColourId);
+        auto textColour = findColour (juce::TextEditor::textColourId);
+        auto contentOrigin = juce::Point<float> (lineX, (float) (textArea.getY() - scrollY));
+        
+        // Highlighted ranges are sorted, so the first one reaching the view is a binary search
+        auto nextHighlight = std::lower_bound (highlightedRanges.begin(), highlightedRanges.end(),
+                                               document.getLineStart (getFirstVisibleLine()),
+                                               [] (juce::Range<int> range, int position) { return range.getEnd() <= position; });
+        
+        for (int line = getFirstVisibleLine(); line <= getLastVisibleLine(); ++line)
+        {
+            auto chunksInView = layoutChunksInView (line);
+            const auto& layout = getLineLayout (line);
+            auto lineEnd = document.getLineEnd (line);
+            
+            auto fillSpans = [&] (juce::Range<int> range)
+            {
+                forEachRowSpan (line, layout, range, [&] (juce::Rectangle<float> span) { g.fillRect (span + contentOrigin); });
+            };
+            
+            g.setColour (highlightColour.withMultipliedAlpha (0.5f));
+            while (nextHighlight != highlightedRanges.end() && nextHighlight->getStart() <= lineEnd)
+            {
+                fillSpans (*nextHighlight);
+                
+                if (nextHighlight->getEnd() > lineEnd)
+                    break;
+                
+                ++nextHighlight;
+            }
+            
+            if (! selection.isEmpty() && selection.getStart() <= lineEnd && selection.getEnd() >= document.getLineStart (line))
+            {
+                g.setColour (highlightColour);
+                fillSpans (selection);
+            }
+            
+            g.setColour (textColour);
+            auto lineTop = contentOrigin.y + (float) (getRowsBefore (line) * lineHeight);
+            
+            for (auto index = chunksInView.getStart(); index < chunksInView.getEnd(); ++index)
+            {
+                auto chunkTop = lineTop + (float) (layout.firstRows[(size_t) index] * lineHeight);
+                layout.chunks[(size_t) index].glyphs.draw (g, juce::AffineTransform::translation (contentOrigin.x, chunkTop));
+            }
+            
+            // Text an IME is still composing is underlined, as TextEditor does
+            for (const auto& range : underlinedRanges)
+                forEachRowSpan (line, layout, range, [&] (juce::Rectangle<float> span)
+                {
+                    g.fillRect ((span + contentOrigin).removeFromBottom (1.0f));
+                });
+        }
+        
+        if (hasKeyboardFocus (false) && caretFlashState)
+        {
+            g.setColour (findColour (juce::CaretComponent::caretColourId));
+            g.fillRect (getCaretRectangleForCharIndex (caretPosition));
+        }
+    }
+    
+    auto focused = hasKeyboardFocus (true);
+    g.setColour (findColour (focused ? juce::TextEditor::focusedOutlineColourId : juce::TextEditor::outlineColourId));
+    g.drawRect (getLocalBounds(), focused ? 2 : 1);
+}
+
+//==============================================================================
+bool NotesEditor::keyPressed (const juce::KeyPress& key)
+{
+    auto mods = key.getModifiers();
+    auto extend = mods.isShiftDown();
+    
+   #if JUCE_MAC
+    auto byWord = mods.isAltDown();
+    auto byLine = mods.isCommandDown();
+   #else
+    auto byWord = mods.isCtrlDown();
+    auto byLine = false;
+   #endif
+    
+    auto selection = getHighlightedRegion();
+    auto caretLine = document.getLineForPosition (caretPosition);
+    
+    if (key.isKeyCode (juce::KeyPress::leftKey) || key.isKeyCode (juce::KeyPress::rightKey))
+    {
+        auto forwards = key.isKeyCode (juce::KeyPress::rightKey);
+        desiredCaretX = -1.0f;
+        
+        if (! extend && ! selection.isEmpty() && ! byWord && ! byLine)
+            moveCaretTo (forwards ? selection.getEnd() : selection.getStart(), false);
+        else if (byLine)
+            moveCaretTo (forwards ? document.getLineEnd (caretLine) : document.getLineStart (caretLine), extend);
+        else if (byWord)
+            moveCaretTo (findWordBoundary (caretPosition, forwards), extend);
+        else
+            moveCaretTo (caretPosition + (forwards ? 1 : -1), extend);
+        
+        return true;
+    }
+    
+    if (key.isKeyCode (juce::KeyPress::upKey) || key.isKeyCode (juce::KeyPress::downKey))
+    {
+        auto down = key.isKeyCode (juce::KeyPress::downKey);
+        
+        if (byLine)
+            moveCaretTo (down ? document.getLength() : 0, extend);
+        else
+            moveCaretVertically (down ? 1 : -1, extend);
+        
+        return true;
+    }
+    
+    if (key.isKeyCode (juce::KeyPress::pageUpKey) || key.isKeyCode (juce::KeyPress::pageDownKey))
+    {
+        auto rowsPerPage = juce::jmax (1, textArea.getHeight() / lineHeight - 1);
+        moveCaretVertically (key.isKeyCode (juce::KeyPress::pageDownKey) ? rowsPerPage : -rowsPerPage, extend);
+        return true;
+    }
+    
+    if (key.isKeyCode (juce::KeyPress::homeKey) || key.isKeyCode (juce::KeyPress::endKey))
+    {
+        auto toEnd = key.isKeyCode (juce::KeyPress::endKey);
+        desiredCaretX = -1.0f;
+        
+        if (mods.isCommandDown())
+            moveCaretTo (toEnd ? document.getLength() : 0, extend);
+        else
+            moveCaretTo (toEnd ? document.getLineEnd (caretLine) : document.getLineStart (caretLine), extend);
+        
+        return true;
+    }
+    
+    if (key.isKeyCode (juce::KeyPress::backspaceKey))
+    {
+        deleteBackwards (byWord);
+        return true;
+    }
+    
+    if (key.isKeyCode (juce::KeyPress::deleteKey))
+    {
+        deleteForwards (byWord);
+        return true;
+    }
+    
+    if (key.isKeyCode (juce::KeyPress::returnKey))
+    {
+        // Each line is its own undo step
+        insertText ("\n");
+        closeUndoGroup();
+        return true;
+    }
+    
+    if (key == juce::KeyPress (juce::KeyPress::tabKey))
+    {
+        insertText ("\t");
+        return true;
+    }
+    
+    if (key == juce::KeyPress ('a', juce::ModifierKeys::commandModifier, 0))  { selectAll(); return true; }
+    if (key == juce::KeyPress ('c', juce::ModifierKeys::commandModifier, 0))  { copy();      return true; }
+    if (key == juce::KeyPress ('x', juce::ModifierKeys::commandModifier, 0))  { cut();       return true; }
+    if (key == juce::KeyPress ('v', juce::ModifierKeys::commandModifier, 0))  { paste();     return true; }
+    
+    if (key == juce::KeyPress ('z', juce::ModifierKeys::commandModifier, 0))
+    {
+        undoOrRedo (false);
+        return true;
+    }
+    
+    if (key == juce::KeyPress ('z', juce::ModifierKeys::commandModifier | juce::ModifierKeys::shiftModifier, 0)
+        || key == juce::KeyPress ('y', juce::ModifierKeys::commandModifier, 0))
+    {
+        undoOrRedo (true);
+        return true;
+    }
+    
+    // Printable characters. AltGr arrives as Ctrl+Alt on Windows and Option as Alt on
+    // macOS, both still type. Other shortcuts go up to the plugin editor.
+    auto character = key.getTextCharacter();
+    if (character >= ' ' && character != 127 && (! mods.isCommandDown() || mods.isAltDown()))
+    {
+        insertText (juce::String::charToString (character));
+        return true;
+    }
+    
+    return false;
+}
+
+void NotesEditor::mouseDown (const juce::MouseEvent& e)
+{
+    if (e.mods.isPopupMenu())
+    {
+        showPopupMenu();
+        return;
+    }
+    
+    desiredCaretX = -1.0f;
+    moveCaretTo (getPositionAt (e.getPosition()), e.mods.isShiftDown());
+    
+    // Keeps the selection growing while the mouse is held past an edge
+    juce::Component::beginDragAutoRepeat (50);
+}
+
+void NotesEditor::mouseDrag (const juce::MouseEvent& e)
+{
+    if (e.mods.isPopupMenu())
+        return;
+    
+    desiredCaretX = -1.0f;
+    moveCaretTo (getPositionAt (e.getPosition()), true);
+}
+
+void NotesEditor::mouseDoubleClick (const juce::MouseEvent& e)
+{
+    if (e.mods.isPopupMenu())
+        return;
+    
+    // Select the word under the mouse
+    auto position = getPositionAt (e.getPosition());
+    auto isWordCharacter = [this] (int p) { return juce::CharacterFunctions::isLetterOrDigit (document.getCharacter (p)); };
+    
+    auto start = position, end = position;
+    while (start > 0 && isWordCharacter (start - 1))
+        --start;
+    while (end < document.getLength() && isWordCharacter (end))
+        ++end;
+    
+    setHighlightedRegion ({ start, end });
+}
+
+void NotesEditor::mouseWheelMove (const juce::MouseEvent& e, const juce::MouseWheelDetails& wheel)
+{
+    // Same scaling as juce::Viewport, at least a pixel per event
+    auto toPixels = [this] (float delta)
+    {
+        if (delta == 0.0f)
+            return 0.0f;
+        
+        delta *= 14.0f * (float) lineHeight;
+        return delta < 0.0f ? juce::jmin (delta, -1.0f) : juce::jmax (delta, 1.0f);
+    };
+    
+    auto deltaX = wheel.deltaX, deltaY = wheel.deltaY;
+    if (e.mods.isShiftDown() && deltaX == 0.0f)
+        std::swap (deltaX, deltaY);
+    
+    setScrollPosition (scrollX - toPixels (deltaX), scrollY - juce::roundToInt (toPixels (deltaY)));
+}
+
+void NotesEditor::focusGained (FocusChangeType)
+{
+    resetCaretFlash();
+    repaint();
+    
+    // Lets the platform's IME find this editor as the target for composed text
+    if (auto* peer = getPeer())
+        peer->refreshTextInputTarget();
+}
+
+void NotesEditor::focusLost (FocusChangeType)
+{
+    stopTimer();
+    closeUndoGroup();
+    underlinedRanges.clear();
+    repaint();
+    
+    if (onFocusLost != nullptr)
+        onFocusLost();
+}
+
+//==============================================================================
+void NotesEditor::resetCaretFlash()
+{
+    caretFlashState = true;
+    repaint();
+    
+    if (hasKeyboardFocus (false))
+        startTimer (caretFlashIntervalMs);
+}
+
+void NotesEditor::selectionChanged()
+{
+    resetCaretFlash();
+    
+    if (auto* peer = getPeer())
+        peer->refreshTextInputTarget();
+    
+    if (auto* handler = getAccessibilityHandler())
+        handler->notifyAccessibilityEvent (juce::AccessibilityEvent::textSelectionChanged);
+}
+
+void NotesEditor::timerCallback()
+{
+    caretFlashState = ! caretFlashState;
+    repaint (getCaretRectangleForCharIndex (caretPosition));
+}
@@ -0,0 +1,294 @@
+/*
+  ==============================================================================
+
+    Notes pane: a gap buffer document with a line index, and an editor
+    component that only lays out the lines it shows.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "UndoJournal.h"
+#include <map>
+#include <vector>
+
+//==============================================================================
+/**
+ * Text of the notes, stored as UTF-32 in a gap buffer so typing at the caret
+ * doesn't move the rest of the document.
+ *
+ * Positions are character indices, the same as juce::String and TextEditor use.
+ * Line endings are kept as "\n" only, anything else is converted on the way in.
+ * The start of every line is kept in a sorted index that each edit patches,
+ * so mapping between positions and lines is a binary search.
+ */
+class NotesDocument
+{
+public:
+    NotesDocument();
+    
+    void setText (const juce::String& newText);
+    juce::String getText() const;
+    juce::String getTextInRange (juce::Range<int> range) const;
+    
+    int getLength() const { return (int) buffer.size() - (gapEnd - gapStart); }
+    juce::juce_wchar getCharacter (int position) const;
+    
+    // The one editing primitive: removes the range and inserts text in its place.
+    // Returns the (normalised) text that was inserted.
+    juce::String replace (juce::Range<int> range, const juce::String& text);
+    
+    int getNumLines() const { return (int) lineStarts.size(); }
+    int getLineStart (int line) const { return lineStarts[(size_t) line]; }
+    int getLineEnd (int line) const; // before the newline
+    int getLineForPosition (int position) const;
+    juce::String getLine (int line) const;
+    
+private:
+    std::vector<juce::juce_wchar> buffer;
+    int gapStart = 0, gapEnd = 0;
+    std::vector<int> lineStarts; // always starts with 0
+    
+    void moveGapTo (int position);
+    void ensureGap (int size);
+    void appendText (const juce::String& text, std::vector<juce::juce_wchar>& dest) const;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (NotesDocument)
+};
+
+//==============================================================================
+/**
+ * Multi-line editor for the session notes.
+ *
+ * Only the lines in view (plus a small margin) are shaped, and each shaped line
+ * is cached until it's edited or scrolls well out of view, so the cost of
+ * scrolling, typing and moving the caret follows the size of the window rather
+ * than the size of the notes.
+ *
+ * Long lines wrap at word boundaries. How many rows a line takes is only known
+ * once it's shaped, so lines that haven't been in view count with an estimate
+ * from their length, corrected as they come into view. Corrections above the
+ * view move the scroll position with them, so what's on screen stays put.
+ *
+ * A line is shaped in chunks of up to maxChunkCharacters, each starting a row
+ * of its own, so a single multi-megabyte line (e.g. minified logs) only has the
+ * chunks near the view shaped, while all of it can be drawn and edited.
+ *
+ * Text arrives through juce::TextInputTarget as well as key presses, so IMEs
+ * and dead keys compose into the notes, and an accessibility handler exposes
+ * the text, selection and caret to screen readers.
+ *
+ * Uses the juce::TextEditor colour IDs, so the look and feel's TextEditor
+ * colours apply unless they're set on the component.
+ */
+class NotesEditor : public juce::Component,
+                    public juce::TextInputTarget,
+                    private juce::ScrollBar::Listener,
+                    private juce::Timer
+{
+public:
+    NotesEditor();
+    ~NotesEditor() override;
+    
+    //==============================================================================
+    void setText (const juce::String& newText);
+    juce::String getText() const { return document.getText(); }
+    juce::String getTextInRange (const juce::Range<int>& range) const override { return document.getTextInRange (range); }
+    const NotesDocument& getDocument() const { return document; }
+    
+    void insertTextAtCaret (const juce::String& text) override;
+    int getCaretPosition() const override { return caretPosition; }
+    void moveCaretToEnd();
+    
+    // Selects the range and scrolls it into view
+    void setHighlightedRegion (const juce::Range<int>& range) override;
+    juce::Range<int> getHighlightedRegion() const override;
+    
+    // Extra ranges drawn behind the text, e.g. every search match. Sorted, non-overlapping.
+    void setHighlightedRanges (const juce::Array<juce::Range<int>>& ranges);
+    
+    void setTextToShowWhenEmpty (const juce::String& text, juce::Colour colour);
+    void setFont (const juce::Font& newFont);
+    
+    // On by default. Without it long lines scroll sideways.
+    void setWordWrap (bool shouldWrap);
+    
+    // Replaces a range without recording it, for replaying undo and redo
+    void applyEdit (juce::Range<int> range, const juce::String& text);
+    
+    // Edits made in the editor are recorded here, and Cmd/Ctrl+Z and the popup menu use it
+    void setUndoJournal (UndoJournal* journalToUse) { undoJournal = journalToUse; }
+    
+    // Called after every change, including applyEdit
+    std::function<void()> onTextChange;
+    std::function<void()> onFocusLost;
+    
+    //==============================================================================
+    // juce::TextInputTarget, for IMEs and dead keys. Bounds are in local coordinates,
+    // and only cover the lines in view.
+    bool isTextInputActive() const override { return isEnabled(); }
+    void setTemporaryUnderlining (const juce::Array<juce::Range<int>>& underlinedRegions) override;
+    juce::Rectangle<int> getCaretRectangleForCharIndex (int index) const override;
+    int getTotalNumChars() const override { return document.getLength(); }
+    int getCharIndexForPoint (juce::Point<int> point) const override;
+    juce::RectangleList<int> getTextBounds (juce::Range<int> textRange) const override;
+    
+    //==============================================================================
+    void paint (juce::Graphics&) override;
+    void resized() override;
+    bool keyPressed (const juce::KeyPress& key) override;
+    void mouseDown (const juce::MouseEvent& e) override;
+    void mouseDrag (const juce::MouseEvent& e) override;
+    void mouseDoubleClick (const juce::MouseEvent& e) override;
+    void mouseWheelMove (const juce::MouseEvent& e, const juce::MouseWheelDetails& wheel) override;
+    void focusGained (FocusChangeType) override;
+    void focusLost (FocusChangeType) override;
+    std::unique_ptr<juce::AccessibilityHandler> createAccessibilityHandler() override;
+    
+private:
+    class TextInterface;
+    
+    // Part of a line, shaped on its own. Columns inside a chunk are relative to its start.
+    struct LineChunk
+    {
+        int start = 0, numCharacters = 0; // columns of the line
+        int numRows = 1;                  // estimated until laid out, kept when released
+        bool isLaidOut = false;
+        
+        juce::GlyphArrangement glyphs;  // baseline of the first row at the font's ascent, x from 0
+        std::vector<float> xOffsets;    // left edge of each character within its row, plus one past the end
+        std::vector<int> rowStarts;     // first column of each row, always starts with 0
+        std::vector<float> rowWidths;
+        
+        int getRowEnd (int row) const { return row + 1 < (int) rowStarts.size() ? rowStarts[(size_t) row + 1] : numCharacters; }
+        int getRow (int column) const;
+        float getX (int row, int column) const; // column may be the row's end
+        void release();
+    };
+    
+    struct LineLayout
+    {
+        std::vector<LineChunk> chunks;  // at least one, an empty line has an empty chunk
+        std::vector<int> firstRows;     // row of the line each chunk starts on
+        int numCharacters = 0;
+        int numRows = 0;
+        
+        int getNumRows() const { return numRows; }
+        int getChunkForColumn (int column) const; // a chunk's start column belongs to it, not the one before
+        int getChunkForRow (int row) const;
+        void updateRows();
+    };
+    
+    // Chunks end after the last space within maxChunkCharacters / 16 of the limit, when
+    // there is one, so with word wrap the row a chunk forces mostly breaks between words
+    static constexpr int maxChunkCharacters = 4096;
+    static constexpr int tabSpaces = 4;
+    static constexpr int layoutMarginLines = 32;
+    static constexpr int textIndent = 4;
+    static constexpr int caretFlashIntervalMs = 500;
+    
+    NotesDocument document;
+    juce::Font font { 15.0f };
+    int lineHeight = 15;
+    float tabWidth = 0.0f;
+    float averageCharacterWidth = 8.0f; // for estimating rows
+    
+    bool wordWrap = true;
+    float wrapWidth = 0.0f; // 0 while not wrapping
+    
+    // Rows each line takes, measured for lines that have been laid out and estimated for
+    // the rest. rowTree is a Fenwick tree over the same counts, so the row a line starts
+    // on and the line at a given row are both log n, and a correction is a point update.
+    std::vector<int> lineRows;
+    std::vector<int> rowTree;
+    int totalRows = 1;
+    bool lineRowsChanged = false;
+    
+    int caretPosition = 0;
+    int selectionAnchor = 0;
+    float desiredCaretX = -1.0f; // kept while moving up and down through shorter lines
+    bool caretFlashState = true;
+    
+    juce::Array<juce::Range<int>> highlightedRanges;
+    juce::Array<juce::Range<int>> underlinedRanges; // text an IME is still composing
+    juce::String placeholderText;
+    juce::Colour placeholderColour;
+    
+    juce::ScrollBar verticalScrollBar { true }, horizontalScrollBar { false };
+    juce::Rectangle<int> textArea; // everything but the scrollbars
+    int scrollY = 0;
+    float scrollX = 0.0f;
+    float widestLaidOutLine = 0.0f; // only lines that have been in view are known
+    bool widestLineChanged = false;
+    
+    std::map<int, LineLayout> layoutCache;
+    
+    UndoJournal* undoJournal = nullptr;
+    
+    int getFirstVisibleLine() const;
+    int getLastVisibleLine() const;
+    
+    int estimateChunkRows (int numCharacters) const;
+    int estimateRows (int line) const;
+    void resetLineRows();
+    void rebuildRowTree();
+    void setLineRows (int line, int rows);
+    void replaceRows (int line, int firstRow, int oldRows, int newRows);
+    void updateLineRows (int firstLine, int lastLine, int newLastLine);
+    int getRowsBefore (int line) const;
+    int getLineAtRow (int row) const;
+    void updateWrapWidth();
+    
+    // Creates the line's chunks without laying them out, except a line's only chunk
+    const LineLayout& getLineLayout (int line);
+    const LineChunk& getLineChunk (int line, int chunk);
+    juce::Range<int> layoutChunksInView (int line);
+    void trimLayoutCache();
+    void invalidateLayout (int firstLine, int lastLine, bool lineCountChanged);
+    void layoutVisibleLines();
+    
+    // Laying out only fills caches, so the const queries of TextInputTarget and the
+    // accessibility interface go through this
+    NotesEditor& getLayoutOwner() const { return const_cast<NotesEditor&> (*this); }
+    
+    // Where a position is drawn, relative to the top left of the content
+    juce::Point<float> getCharacterPosition (int position);
+    int getColumnForX (const LineLayout& layout, int chunk, int row, float x) const;
+    int getPositionAt (juce::Point<int> point);
+    
+    // One rectangle per row a range covers on a line, relative to the content. Only
+    // chunks that are laid out are covered, which includes every chunk in view.
+    template <typename Callback>
+    void forEachRowSpan (int line, const LineLayout& layout, juce::Range<int> range, Callback&& callback) const;
+    
+    // Every edit made in the editor goes through replaceRange, which records it
+    void replaceRange (juce::Range<int> range, const juce::String& text);
+    juce::String performReplace (juce::Range<int> range, const juce::String& text);
+    void insertText (const juce::String& text);
+    void deleteBackwards (bool wholeWord);
+    void deleteForwards (bool wholeWord);
+    
+    void moveCaretTo (int position, bool extendSelection);
+    void moveCaretVertically (int rows, bool extendSelection);
+    int findWordBoundary (int position, bool forwards) const;
+    
+    void copy();
+    void cut();
+    void paste();
+    void selectAll();
+    void undoOrRedo (bool redo);
+    void closeUndoGroup();
+    void showPopupMenu();
+    
+    void setScrollPosition (float newScrollX, int newScrollY);
+    void scrollToKeepCaretOnScreen();
+    void updateScrollBars();
+    void scrollBarMoved (juce::ScrollBar* scrollBar, double newRangeStart) override;
+    void timerCallback() override;
+    void resetCaretFlash();
+    void selectionChanged();
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (NotesEditor)
+};
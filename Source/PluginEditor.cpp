@@ -13,22 +13,19 @@
 NotePadAudioProcessorEditor::NotePadAudioProcessorEditor (NotePadAudioProcessor& p)
     : AudioProcessorEditor (&p), audioProcessor (p)
 {
-    m1TextEditor.reset(new juce::TextEditor("new text editor"));
+    // Only the visible lines of the notes are laid out, so long notes stay responsive
+    m1TextEditor.reset(new NotesEditor());
     addAndMakeVisible(m1TextEditor.get());
-    m1TextEditor->addListener(this);
-    m1TextEditor->setMultiLine(true);
-    m1TextEditor->setReturnKeyStartsNewLine(true);
-    m1TextEditor->setReadOnly(false);
-    m1TextEditor->setScrollbarsShown(true);
-    m1TextEditor->setCaretVisible(true);
-    m1TextEditor->setPopupMenuEnabled(true);
-    m1TextEditor->setTabKeyUsedAsCharacter(true);
-    m1TextEditor->setWantsKeyboardFocus(true);
+    m1TextEditor->onTextChange = [this] { notesTextChanged(); };
+    m1TextEditor->onFocusLost = [this] { flushSessionText(); };
     m1TextEditor->setTextToShowWhenEmpty("Keep session notes here...", juce::Colours::white);
     // Load saved text from state - convert to string safely
     juce::var sessionTextVar = audioProcessor.treeState.state.getProperty("SessionText");
     juce::String sessionText = sessionTextVar.isString() ? sessionTextVar.toString() : juce::String();
     m1TextEditor->setText(sessionText);
+    m1TextEditor->setUndoJournal(&undoJournal);
+    // Index what the editor holds, its line endings may have been normalised
+    notesSearchIndex.update(m1TextEditor->getText());
     
     // Fullscreen buttons setup
     leftFullscreenButton.reset(new FullscreenButton("LeftFullscreen"));
@@ -36,6 +33,9 @@ NotePadAudioProcessorEditor::NotePadAudioProcessorEditor (NotePadAudioProcessor&
     leftFullscreenButton->addListener(this);
     leftFullscreenButton->setTooltip("Fullscreen notepad");
     
+    levelMiniMap.reset(new LevelMiniMap(audioProcessor.getLevelTimeline()));
+    addChildComponent(levelMiniMap.get());
+    
     rightFullscreenButton.reset(new FullscreenButton("RightFullscreen"));
     addAndMakeVisible(rightFullscreenButton.get());
     rightFullscreenButton->addListener(this);
@@ -70,7 +70,39 @@ NotePadAudioProcessorEditor::NotePadAudioProcessorEditor (NotePadAudioProcessor&
     todoInputField->setColour(juce::TextEditor::backgroundColourId, juce::Colour::fromFloatRGBA(40.0f, 40.0f, 40.0f, 0.10f));
     todoInputField->setColour(juce::TextEditor::textColourId, juce::Colour::fromFloatRGBA(251.0f, 251.0f, 251.0f, 1.0f));
     
+    // Search field setup - filters the todo list and finds matches in the notes
+    searchField.reset(new juce::TextEditor("search"));
+    addAndMakeVisible(searchField.get());
+    searchField->addListener(this);
+    searchField->setMultiLine(false);
+    searchField->setReturnKeyStartsNewLine(false);
+    searchField->setScrollbarsShown(false);
+    searchField->setCaretVisible(true);
+    searchField->setPopupMenuEnabled(true);
+    searchField->setWantsKeyboardFocus(true);
+    searchField->setTextToShowWhenEmpty("Search notes and todos...", juce::Colours::grey);
+    searchField->setColour(juce::TextEditor::backgroundColourId, juce::Colour::fromFloatRGBA(40.0f, 40.0f, 40.0f, 0.10f));
+    searchField->setColour(juce::TextEditor::textColourId, juce::Colour::fromFloatRGBA(251.0f, 251.0f, 251.0f, 1.0f));
+    
+    // Todo list setup - rows are recycled, so only the visible ones exist as components
+    todoListBox.reset(new juce::ListBox("todo list", this));
+    addAndMakeVisible(todoListBox.get());
+    todoListBox->setRowHeight(30);
+    todoListBox->setWantsKeyboardFocus(false); // keyboard navigation is handled in keyPressed
+    todoListBox->setColour(juce::ListBox::backgroundColourId, juce::Colours::transparentBlack);
+    todoListBox->setColour(juce::ListBox::outlineColourId, juce::Colours::transparentBlack);
+    
+    // Inline todo editor, moved into whichever row is being edited
+    todoItemEditor.reset(new juce::TextEditor("todo item editor"));
+    todoItemEditor->addListener(this);
+    todoItemEditor->setMultiLine(false);
+    todoItemEditor->setReturnKeyStartsNewLine(false);
+    todoItemEditor->setWantsKeyboardFocus(true);
+    todoItemEditor->setColour(juce::TextEditor::backgroundColourId, juce::Colour::fromFloatRGBA(40.0f, 40.0f, 40.0f, 0.10f));
+    todoItemEditor->setColour(juce::TextEditor::textColourId, juce::Colour::fromFloatRGBA(251.0f, 251.0f, 251.0f, 1.0f));
+    
     refreshTodoList();
+    updateUnreadableContentState();
     
     m1logo = juce::ImageCache::getFromMemory(BinaryData::mach1logo_png, BinaryData::mach1logo_pngSize);
     
@@ -80,20 +112,30 @@ NotePadAudioProcessorEditor::NotePadAudioProcessorEditor (NotePadAudioProcessor&
 
 NotePadAudioProcessorEditor::~NotePadAudioProcessorEditor()
 {
+    stopTimer();
+    
+    // An unfinished import keeps what it added so far
+    todoTransferTask = nullptr;
+    todoFileChooser = nullptr;
+    audioProcessor.setBulkChangeInProgress(false);
+    
     // Save final state before destroying the editor
     saveEditorStateToProcessor();
     
     // Clear editor pointer in processor
     audioProcessor.setEditor(nullptr);
     
+    todoFinder = nullptr;
+    sessionOverview = nullptr;
     m1TextEditor = nullptr;
     todoCheckbox = nullptr;
     todoInputField = nullptr;
+    searchField = nullptr;
     leftFullscreenButton = nullptr;
+    levelMiniMap = nullptr;
     rightFullscreenButton = nullptr;
-    todoItems.clear();
-    todoLabels.clear();
-    todoEditors.clear();
+    todoItemEditor = nullptr;
+    todoListBox = nullptr;
 }
 
 //==============================================================================
@@ -134,6 +176,13 @@ void NotePadAudioProcessorEditor::paintOverChildren (juce::Graphics& g)
         g.drawLine(static_cast<float>(dividerStartX), 0.0f, 
                    static_cast<float>(dividerStartX), static_cast<float>(componentHeight), 1.5f);
     }
+    
+    // Where a dragged todo will land, the list itself only changes on mouseUp
+    if (dragInsertionRow >= 0)
+    {
+        g.setColour(juce::Colours::lightblue);
+        g.fillRect(getDragIndicatorBounds());
+    }
 }
 
 void NotePadAudioProcessorEditor::resized()
@@ -172,17 +221,12 @@ void NotePadAudioProcessorEditor::resized()
         }
         
         // Position text editor to fill entire width (no button space needed)
-        m1TextEditor->setBounds(0, 0, notepadWidth, getHeight());
+        m1TextEditor->setBounds(0, 0, layoutLevelMiniMap(notepadWidth), getHeight());
         
         // Hide todo pane components
         todoInputField->setVisible(false);
-        for (int i = 0; i < todoItems.size(); ++i)
-        {
-            todoItems[i]->setVisible(false);
-            todoLabels[i]->setVisible(false);
-            if (todoEditors[i] != nullptr)
-                todoEditors[i]->setVisible(false);
-        }
+        searchField->setVisible(false);
+        todoListBox->setVisible(false);
     }
     else if (fullscreenMode == FullscreenMode::Right)
     {
@@ -195,6 +239,7 @@ void NotePadAudioProcessorEditor::resized()
         
         // Hide notepad components
         m1TextEditor->setVisible(false);
+        levelMiniMap->setVisible(false);
         
         // Position fullscreen button in top-right corner
         int buttonX = getWidth() - fullscreenButtonSize - fullscreenButtonMargin;
@@ -217,31 +262,21 @@ void NotePadAudioProcessorEditor::resized()
         // Leave space for the button plus some padding
         int buttonAreaStart = buttonX - 10; // Button area starts 10px before the button
         
-        // Position todo items (but avoid button area)
-        for (int i = 0; i < todoItems.size(); ++i)
-        {
-            int itemX = todoPaneX + 10;
-            // Make sure labels don't extend into button area
-            int maxItemWidth = buttonAreaStart - itemX - 30; // Leave space for checkbox (22px) and padding (8px)
-            // Ensure we don't go negative or too small
-            int itemWidth = juce::jmax(50, juce::jmin(todoPaneWidth - 20, maxItemWidth));
-            
-            todoItems[i]->setVisible(true);
-            todoItems[i]->setBounds(itemX, todoY, 22, 20);
-            
-            if (todoEditors[i] != nullptr && todoEditors[i]->isVisible())
-            {
-                todoEditors[i]->setVisible(true);
-                todoEditors[i]->setBounds(itemX + 30, todoY, itemWidth - 30, 20);
-            }
-            else
-            {
-                todoLabels[i]->setVisible(true);
-                todoLabels[i]->setBounds(itemX + 30, todoY, itemWidth - 30, 20);
-            }
-            
-            todoY += 30;
-        }
+        // Position the todo list (but avoid button area), rows are laid out by the ListBox
+        int itemX = todoPaneX + 10;
+        // Make sure labels don't extend into button area
+        int maxItemWidth = buttonAreaStart - itemX - 30; // Leave space for checkbox (22px) and padding (8px)
+        // Ensure we don't go negative or too small
+        int itemWidth = juce::jmax(50, juce::jmin(todoPaneWidth - 20, maxItemWidth));
+        
+        // Search field sits above the list
+        int searchFieldHeight = 24;
+        searchField->setBounds(itemX, todoY, itemWidth, searchFieldHeight);
+        searchField->setVisible(true);
+        todoY += searchFieldHeight + 6;
+        
+        todoListBox->setBounds(itemX, todoY, itemWidth, juce::jmax(0, inputFieldY - 10 - todoY));
+        todoListBox->setVisible(true);
         
         // Position input field at the bottom
         int inputFieldX = todoPaneX + 10;
@@ -272,7 +307,7 @@ void NotePadAudioProcessorEditor::resized()
         }
         
         // Position text editor in left pane (no button space needed)
-        m1TextEditor->setBounds(0, 0, notepadWidth, getHeight());
+        m1TextEditor->setBounds(0, 0, layoutLevelMiniMap(notepadWidth), getHeight());
         m1TextEditor->setVisible(true);
         
         // Right pane: Todo list
@@ -299,31 +334,21 @@ void NotePadAudioProcessorEditor::resized()
         // Leave space for the button plus some padding
         int buttonAreaStart = buttonX - 10; // Button area starts 10px before the button
         
-        // Position todo items in right pane (but avoid button area)
-        for (int i = 0; i < todoItems.size(); ++i)
-        {
-            int itemX = todoPaneX + 10;
-            // Make sure labels don't extend into button area
-            int maxItemWidth = buttonAreaStart - itemX - 30; // Leave space for checkbox (22px) and padding (8px)
-            // Ensure we don't go negative or too small
-            int itemWidth = juce::jmax(50, juce::jmin(todoPaneWidth - 20, maxItemWidth));
-            
-            todoItems[i]->setVisible(true);
-            todoItems[i]->setBounds(itemX, todoY, 22, 20);
-            
-            if (todoEditors[i] != nullptr && todoEditors[i]->isVisible())
-            {
-                todoEditors[i]->setVisible(true);
-                todoEditors[i]->setBounds(itemX + 30, todoY, itemWidth - 30, 20);
-            }
-            else
-            {
-                todoLabels[i]->setVisible(true);
-                todoLabels[i]->setBounds(itemX + 30, todoY, itemWidth - 30, 20);
-            }
-            
-            todoY += 30;
-        }
+        // Position the todo list in right pane (but avoid button area), rows are laid out by the ListBox
+        int itemX = todoPaneX + 10;
+        // Make sure labels don't extend into button area
+        int maxItemWidth = buttonAreaStart - itemX - 30; // Leave space for checkbox (22px) and padding (8px)
+        // Ensure we don't go negative or too small
+        int itemWidth = juce::jmax(50, juce::jmin(todoPaneWidth - 20, maxItemWidth));
+        
+        // Search field sits above the list
+        int searchFieldHeight = 24;
+        searchField->setBounds(itemX, todoY, itemWidth, searchFieldHeight);
+        searchField->setVisible(true);
+        todoY += searchFieldHeight + 6;
+        
+        todoListBox->setBounds(itemX, todoY, itemWidth, juce::jmax(0, inputFieldY - 10 - todoY));
+        todoListBox->setVisible(true);
         
         // Position input field at the bottom of todo pane
         int inputFieldX = todoPaneX + 10;
@@ -331,17 +356,90 @@ void NotePadAudioProcessorEditor::resized()
         todoInputField->setBounds(inputFieldX, inputFieldY, inputFieldWidth, inputFieldHeight);
         todoInputField->setVisible(true);
     }
+    
+    if (todoFinder != nullptr && todoFinder->isVisible())
+        todoFinder->setBounds(getLocalBounds().withSizeKeepingCentre(juce::jmin(480, getWidth() - 40), juce::jmin(320, getHeight() - 40)).withY(40));
+    
+    if (sessionOverview != nullptr && sessionOverview->isVisible())
+        sessionOverview->setBounds(getLocalBounds().reduced(20).withTrimmedTop(20));
 }
 
 void NotePadAudioProcessorEditor::textEditorTextChanged (juce::TextEditor &editor)
 {
-    // On key changes will save editor's string to property labeled/tagged "SessionText"
-    audioProcessor.treeState.state.setProperty("SessionText", editor.getText(), nullptr);
+    if (&editor == searchField.get())
+        applySearch();
+}
+
+void NotePadAudioProcessorEditor::notesTextChanged()
+{
+    // Only the notes editor feeds "SessionText". Copying the whole note on every keystroke
+    // makes typing O(document), so just mark it dirty and let the timer publish it
+    sessionTextDirty = true;
+    if (!isTimerRunning())
+        startTimer(sessionTextFlushIntervalMs);
+}
+
+void NotePadAudioProcessorEditor::timerCallback()
+{
+    flushSessionText();
+}
+
+void NotePadAudioProcessorEditor::flushSessionText()
+{
+    stopTimer();
+    
+    // The processor's content was replaced and the reload is still queued, this text
+    // belongs to what was replaced and is dropped by the reload
+    if (!sessionTextDirty || m1TextEditor == nullptr || audioProcessor.isEditorReloadPending())
+        return;
+    
+    sessionTextDirty = false;
+    auto text = m1TextEditor->getText();
+    audioProcessor.treeState.state.setProperty("SessionText", text, nullptr);
+    
+    // Only the edited lines are re-indexed
+    notesSearchIndex.update(text);
+    if (currentFilter.isNotEmpty())
+    {
+        notesMatches = notesSearchIndex.findMatches(currentFilter, maxNotesMatches);
+        currentNotesMatch = -1;
+        m1TextEditor->setHighlightedRanges(notesMatches);
+    }
+}
+
+//==============================================================================
+void NotePadAudioProcessorEditor::applySearch()
+{
+    // The notes index is refreshed when the text is published, so publish pending edits first
+    flushSessionText();
+    
+    auto query = searchField->getText();
+    filterItems(query);
+    
+    notesMatches = notesSearchIndex.findMatches(query, maxNotesMatches);
+    currentNotesMatch = -1;
+    m1TextEditor->setHighlightedRanges(notesMatches);
+    showNextNotesMatch();
+}
+
+void NotePadAudioProcessorEditor::showNextNotesMatch()
+{
+    if (notesMatches.isEmpty())
+        return;
+    
+    // Select the match in the notes, which also scrolls it into view
+    currentNotesMatch = (currentNotesMatch + 1) % notesMatches.size();
+    m1TextEditor->setHighlightedRegion(notesMatches.getReference(currentNotesMatch));
 }
 
 void NotePadAudioProcessorEditor::textEditorReturnKeyPressed(juce::TextEditor& editor)
 {
-    if (&editor == todoInputField.get())
+    if (&editor == searchField.get())
+    {
+        // Step through the matches in the notes
+        showNextNotesMatch();
+    }
+    else if (&editor == todoInputField.get())
     {
         juce::String text = todoInputField->getText().trim();
         if (text.isNotEmpty())
@@ -350,60 +448,49 @@ void NotePadAudioProcessorEditor::textEditorReturnKeyPressed(juce::TextEditor& e
             newItem.text = text;
             newItem.completed = false;
             addTodoItem(newItem);
-            updateTodoItemsState();
             todoInputField->setText("");
-            resized();
         }
     }
-    else if (editingIndex >= 0 && editingIndex < todoEditors.size())
+    else if (&editor == todoItemEditor.get() && juce::isPositiveAndBelow(editingIndex, todoData.size()))
     {
         // Finish editing a todo item
-        juce::String text = todoEditors[editingIndex]->getText().trim();
+        juce::String text = todoItemEditor->getText().trim();
         if (text.isNotEmpty())
         {
-            todoLabels[editingIndex]->setText(text, juce::dontSendNotification);
-            todoEditors[editingIndex]->setVisible(false);
-            todoLabels[editingIndex]->setVisible(true);
-            
-            // Update todoData to keep it in sync
-            if (editingIndex < todoData.size())
-            {
-                todoData.getReference(editingIndex).text = text;
-            }
-            
-            updateTodoItemsState();
-            updateVisualState(); // Update visual state to refresh strikethrough
+            todoData.getReference(editingIndex).text = text;
+            updateTodoItemState(editingIndex);
+            indexTodoItem(editingIndex);
         }
-        editingIndex = -1;
+        finishEditingTodoItem();
+        filterItems(currentFilter);
     }
 }
 
 void NotePadAudioProcessorEditor::editTodoItem(int index)
 {
-    if (index >= 0 && index < todoLabels.size())
+    int row = getRowForItemIndex(index);
+    if (row >= 0)
     {
         editingIndex = index;
-        todoLabels[index]->setVisible(false);
-        
-        if (todoEditors[index] == nullptr)
-        {
-            todoEditors.add(new juce::TextEditor());
-            addAndMakeVisible(todoEditors[index]);
-            todoEditors[index]->addListener(this);
-            todoEditors[index]->setMultiLine(false);
-            todoEditors[index]->setReturnKeyStartsNewLine(false);
-            todoEditors[index]->setWantsKeyboardFocus(true);
-            todoEditors[index]->setColour(juce::TextEditor::backgroundColourId, juce::Colour::fromFloatRGBA(40.0f, 40.0f, 40.0f, 0.10f));
-            todoEditors[index]->setColour(juce::TextEditor::textColourId, juce::Colour::fromFloatRGBA(251.0f, 251.0f, 251.0f, 1.0f));
-        }
+        todoItemEditor->setText(todoData[index].text, false);
         
-        todoEditors[index]->setText(todoLabels[index]->getText());
-        todoEditors[index]->setVisible(true);
-        todoEditors[index]->grabKeyboardFocus();
-        resized();
+        // The row showing editingIndex picks up the inline editor when it refreshes
+        todoListBox->scrollToEnsureRowIsOnscreen(row);
+        updateVisualState();
+        todoItemEditor->grabKeyboardFocus();
     }
 }
 
+void NotePadAudioProcessorEditor::finishEditingTodoItem()
+{
+    editingIndex = -1;
+    
+    if (auto* parent = todoItemEditor->getParentComponent())
+        parent->removeChildComponent(todoItemEditor.get());
+    
+    updateVisualState();
+}
+
 void NotePadAudioProcessorEditor::addTodoItem(const juce::String& text, bool checked)
 {
     // Create TodoItem and use the other addTodoItem function
@@ -416,83 +503,374 @@ void NotePadAudioProcessorEditor::addTodoItem(const juce::String& text, bool che
 
 void NotePadAudioProcessorEditor::deleteTodoItem(int index)
 {
-    if (index >= 0 && index < todoItems.size())
+    if (juce::isPositiveAndBelow(index, todoData.size()))
     {
-        todoItems.remove(index);
-        todoLabels.remove(index);
-        todoEditors.remove(index);
+        auto node = getTodoNode(index);
+        undoJournal.recordTodoRemoved(index, node.isValid() ? node : createTodoNode(todoData.getReference(index)));
+        if (node.isValid())
+            getTodoItemsTree().removeChild(node, nullptr);
         
-        if (index < todoData.size())
-            todoData.remove(index);
+        const auto& removed = todoData.getReference(index);
+        todoSearchIndex.removeDocument(removed.id);
+        removeMarker(removed.anchorTime, removed.id);
+        todoData.remove(index);
         
         if (editingIndex == index)
-            editingIndex = -1;
+            finishEditingTodoItem();
         else if (editingIndex > index)
             editingIndex--;
             
-        if (selectedIndex >= todoItems.size())
-            selectedIndex = todoItems.size() - 1;
+        if (selectedIndex >= todoData.size())
+            selectedIndex = todoData.size() - 1;
         else if (selectedIndex > index)
             selectedIndex--;
             
-        updateTodoItemsState();
-        updateVisualState();
-        resized();
+        filteredItemRemoved(index);
     }
 }
 
 void NotePadAudioProcessorEditor::moveSelection(int delta)
 {
-    if (todoItems.size() > 0)
+    // Move through the rows as shown, so a filtered list skips hidden items
+    int newRow = getRowForItemIndex(selectedIndex) + delta;
+    int newIndex = getItemIndexForRow(newRow);
+    if (newIndex >= 0)
     {
-        int newIndex = selectedIndex + delta;
-        if (newIndex >= 0 && newIndex < todoItems.size())
-        {
-            selectedIndex = newIndex;
-            updateVisualState();
-        }
+        selectedIndex = newIndex;
+        todoListBox->scrollToEnsureRowIsOnscreen(newRow);
+        updateVisualState();
     }
 }
 
-void NotePadAudioProcessorEditor::updateVisualState()
+void NotePadAudioProcessorEditor::showTodoFinder()
 {
-    for (int i = 0; i < todoLabels.size(); ++i)
+    if (todoFinder == nullptr)
     {
-        if (i >= todoData.size())
-            continue;
-            
-        const auto& item = todoData[i];
-        bool isSelected = (i == selectedIndex);
-        
-        // Update label colors and style
-        todoLabels[i]->setColour(juce::Label::textColourId,
-            item.completed ? juce::Colours::grey :
-            isSelected ? juce::Colours::lightblue :
-            getPriorityColour(item.priority));
-            
-        // Set strikethrough for completed items
-        todoLabels[i]->setStrikethrough(item.completed);
-        
-        // Set font (plain for all, strikethrough visual is handled separately)
-        todoLabels[i]->setFont(juce::Font(16.0f, juce::Font::plain));
+        todoFinder.reset(new TodoFinderComponent());
+        addChildComponent(todoFinder.get());
+        todoFinder->onItemChosen = [this](juce::int64 id) { jumpToTodo(id); };
+        todoFinder->onDismiss = [this] { hideTodoFinder(); };
+    }
+    
+    // Candidates are prepared once per opening, typing then only re-ranks them
+    juce::StringArray texts;
+    juce::Array<juce::int64> ids;
+    texts.ensureStorageAllocated(todoData.size());
+    ids.ensureStorageAllocated(todoData.size());
+    for (const auto& item : todoData)
+    {
+        texts.add(item.text);
+        ids.add(item.id);
+    }
+    todoFinder->setItems(texts, ids);
+    
+    todoFinder->setVisible(true);
+    todoFinder->toFront(false);
+    resized();
+    todoFinder->grabQueryFocus();
+}
+
+void NotePadAudioProcessorEditor::hideTodoFinder()
+{
+    if (todoFinder != nullptr)
+        todoFinder->setVisible(false);
+}
+
+void NotePadAudioProcessorEditor::showSessionOverview()
+{
+    if (sessionOverview == nullptr)
+    {
+        // Kept up to date by the registry from then on, hidden or not
+        sessionOverview.reset(new SessionOverviewComponent(audioProcessor.getSessionRegistry(), audioProcessor.getSessionRegistrySerial()));
+        addChildComponent(sessionOverview.get());
+        sessionOverview->onTodoChosen = [this](juce::int64 id) { jumpToTodo(id); };
+        sessionOverview->onDismiss = [this] { hideSessionOverview(); };
+    }
+    
+    hideTodoFinder();
+    sessionOverview->setVisible(true);
+    sessionOverview->toFront(false);
+    resized();
+    sessionOverview->grabQueryFocus();
+}
+
+void NotePadAudioProcessorEditor::hideSessionOverview()
+{
+    if (sessionOverview != nullptr)
+        sessionOverview->setVisible(false);
+}
+
+void NotePadAudioProcessorEditor::jumpToTodo(juce::int64 id)
+{
+    hideTodoFinder();
+    hideSessionOverview();
+    
+    int index = findItemIndex(id);
+    if (index < 0)
+        return;
+    
+    // The chosen item may be hidden by the search filter, show everything again
+    if (getRowForItemIndex(index) < 0)
+    {
+        searchField->clear();
+        filterItems(juce::String());
+    }
+    
+    selectedIndex = index;
+    todoListBox->scrollToEnsureRowIsOnscreen(getRowForItemIndex(index));
+    updateVisualState();
+    
+    // Keep focus in the todo pane so the arrow/space/delete shortcuts act on the selection
+    if (todoInputField->isShowing())
+        todoInputField->grabKeyboardFocus();
+}
+
+void NotePadAudioProcessorEditor::setTodoAnchor(int index, double timeSeconds)
+{
+    if (!juce::isPositiveAndBelow(index, todoData.size()))
+        return;
+    
+    auto& item = todoData.getReference(index);
+    removeMarker(item.anchorTime, item.id);
+    item.anchorTime = timeSeconds;
+    addMarker(item.anchorTime, item.id);
+    updateTodoItemState(index);
+    activeMarkerId = hasPlayhead && lastPlayhead.isPlaying ? findMarkerAt(lastPlayhead.timeSeconds) : 0;
+    updateVisualState();
+}
+
+void NotePadAudioProcessorEditor::rebuildMarkerIndex()
+{
+    markerIndex.clear();
+    for (const auto& item : todoData)
+        if (item.anchorTime >= 0.0)
+            markerIndex.emplace_back(item.anchorTime, item.id);
+    
+    std::sort(markerIndex.begin(), markerIndex.end());
+}
+
+void NotePadAudioProcessorEditor::addMarker(double timeSeconds, juce::int64 id)
+{
+    if (timeSeconds < 0.0)
+        return;
+    
+    auto marker = std::make_pair(timeSeconds, id);
+    markerIndex.insert(std::lower_bound(markerIndex.begin(), markerIndex.end(), marker), marker);
+}
+
+void NotePadAudioProcessorEditor::removeMarker(double timeSeconds, juce::int64 id)
+{
+    if (timeSeconds < 0.0)
+        return;
+    
+    auto marker = std::make_pair(timeSeconds, id);
+    auto found = std::lower_bound(markerIndex.begin(), markerIndex.end(), marker);
+    if (found != markerIndex.end() && *found == marker)
+        markerIndex.erase(found);
+}
+
+juce::int64 NotePadAudioProcessorEditor::findMarkerAt(double timeSeconds) const
+{
+    // The marker that applies is the last one at or before the playhead
+    auto next = std::upper_bound(markerIndex.begin(), markerIndex.end(), timeSeconds,
+                                 [](double time, const std::pair<double, juce::int64>& marker) { return time < marker.first; });
+    return next == markerIndex.begin() ? 0 : std::prev(next)->second;
+}
+
+void NotePadAudioProcessorEditor::updatePlayhead()
+{
+    NotePadAudioProcessor::PlayheadState latest;
+    if (!audioProcessor.readLatestPlayhead(latest))
+        return;
+    
+    lastPlayhead = latest;
+    hasPlayhead = true;
+    
+    // Only follow the timeline while the host is playing, a stopped transport leaves the list alone
+    if (!latest.isPlaying || markerIndex.empty())
+        return;
+    
+    auto markerId = findMarkerAt(latest.timeSeconds);
+    if (markerId == activeMarkerId)
+        return;
+    
+    activeMarkerId = markerId;
+    
+    // The host can't be moved from a plugin, so following the playhead means bringing
+    // the todo it has reached into view
+    if (markerId != 0 && editingIndex < 0)
+    {
+        int row = getRowForItemIndex(findItemIndex(markerId));
+        if (row >= 0)
+            todoListBox->scrollToEnsureRowIsOnscreen(row);
+    }
+    
+    updateVisualState();
+}
+
+int NotePadAudioProcessorEditor::layoutLevelMiniMap(int notepadWidth)
+{
+    // The strip sits under the fullscreen button at the right edge of the notes, which
+    // keep their full width until a track has actually been played
+    if (audioProcessor.getLevelTimeline().isEmpty())
+    {
+        levelMiniMap->setVisible(false);
+        return notepadWidth;
     }
+    
+    int stripWidth = 24;
+    int margin = 5;
+    int stripY = stripWidth + margin * 2;
+    levelMiniMap->setBounds(notepadWidth - stripWidth - margin, stripY, stripWidth, juce::jmax(0, getHeight() - stripY - margin));
+    levelMiniMap->setVisible(true);
+    return notepadWidth - stripWidth - margin * 2;
+}
+
+void NotePadAudioProcessorEditor::updateLevelMiniMap()
+{
+    const auto& timeline = audioProcessor.getLevelTimeline();
+    
+    // First levels of the session, make room for the strip
+    if (!levelMiniMap->isVisible() && !timeline.isEmpty() && fullscreenMode != FullscreenMode::Right)
+        resized();
+    
+    levelMiniMap->update(audioProcessor.getLevelTimelineVersion(), hasPlayhead ? lastPlayhead.timeSeconds : -1.0);
+}
+
+void NotePadAudioProcessorEditor::captureClip()
+{
+    // Stamp with where the playhead was when the clip was asked for, not when it's ready
+    juce::String stamp = hasPlayhead ? "[" + NotePadAudioProcessor::formatTimelinePosition(lastPlayhead.timeSeconds) + "] " : juce::String();
+    juce::Component::SafePointer<NotePadAudioProcessorEditor> safeThis(this);
+    
+    audioProcessor.captureClip(NotePadAudioProcessor::maxClipSeconds, [safeThis, stamp](const juce::File& file)
+    {
+        if (safeThis == nullptr || !file.existsAsFile())
+            return;
+        
+        auto* notes = safeThis->m1TextEditor.get();
+        auto caret = notes->getCaretPosition();
+        bool atLineStart = caret == 0 || notes->getTextInRange({ caret - 1, caret }) == "\n";
+        notes->insertTextAtCaret((atLineStart ? "" : "\n") + stamp + "Clip: " + file.getFullPathName() + "\n");
+    });
+}
+
+void NotePadAudioProcessorEditor::updateVisualState()
+{
+    // Selection, editing, completion and the playhead change how rows look but not how
+    // many there are, so the rows on screen are updated in place. Each compares against
+    // what it last showed, so e.g. a selection change repaints just the two rows involved.
+    auto* viewport = todoListBox->getViewport();
+    int rowHeight = todoListBox->getRowHeight();
+    if (viewport == nullptr || rowHeight <= 0)
+        return;
+    
+    int firstRow = viewport->getViewPositionY() / rowHeight;
+    int lastRow = juce::jmin(getNumRows() - 1, firstRow + viewport->getViewHeight() / rowHeight + 1);
+    
+    for (int row = firstRow; row <= lastRow; ++row)
+        if (auto* rowComponent = dynamic_cast<TodoRowComponent*>(todoListBox->getComponentForRowNumber(row)))
+            rowComponent->update(getItemIndexForRow(row));
 }
 
 bool NotePadAudioProcessorEditor::keyPressed(const juce::KeyPress& key)
 {
-    // Todo keyboard shortcuts work when focus is in todo area
-    // Check if focus is on todo input field or a todo item
-    bool isTodoFocused = todoInputField->hasKeyboardFocus(true);
-    for (int i = 0; i < todoEditors.size(); ++i)
+    // Cmd/Ctrl+F jumps to the search field from anywhere in the editor
+    if (key == juce::KeyPress('f', juce::ModifierKeys::commandModifier, 0))
+    {
+        if (searchField->isShowing())
+            searchField->grabKeyboardFocus();
+        return true;
+    }
+    
+    // Cmd/Ctrl+Z and Cmd/Ctrl+Shift+Z (or Cmd/Ctrl+Y) step through the plugin's own history,
+    // the host's undo is left to the session
+    if (key == juce::KeyPress('z', juce::ModifierKeys::commandModifier, 0))
+    {
+        undoJournal.undo();
+        return true;
+    }
+    
+    if (key == juce::KeyPress('z', juce::ModifierKeys::commandModifier | juce::ModifierKeys::shiftModifier, 0)
+        || key == juce::KeyPress('y', juce::ModifierKeys::commandModifier, 0))
+    {
+        undoJournal.redo();
+        return true;
+    }
+    
+    // Cmd/Ctrl+T stamps the current playhead position: into the notes at the caret,
+    // or onto the selected todo as its anchor. Cmd/Ctrl+Shift+T removes the anchor.
+    if (key == juce::KeyPress('t', juce::ModifierKeys::commandModifier, 0)
+        || key == juce::KeyPress('t', juce::ModifierKeys::commandModifier | juce::ModifierKeys::shiftModifier, 0))
     {
-        if (todoEditors[i] != nullptr && todoEditors[i]->hasKeyboardFocus(true))
+        bool clearAnchor = key.getModifiers().isShiftDown();
+        
+        if (!clearAnchor && m1TextEditor->hasKeyboardFocus(true))
+        {
+            if (hasPlayhead)
+                m1TextEditor->insertTextAtCaret("[" + NotePadAudioProcessor::formatTimelinePosition(lastPlayhead.timeSeconds) + "] ");
+        }
+        else if (juce::isPositiveAndBelow(selectedIndex, todoData.size()))
         {
-            isTodoFocused = true;
-            break;
+            if (clearAnchor)
+                setTodoAnchor(selectedIndex, -1.0);
+            else if (hasPlayhead)
+                setTodoAnchor(selectedIndex, lastPlayhead.timeSeconds);
         }
+        return true;
+    }
+    
+    // Cmd/Ctrl+Shift+R switches reference clip capture on or off, Cmd/Ctrl+R grabs the
+    // last 30 seconds of input and attaches the clip to the notes at the caret
+    if (key == juce::KeyPress('r', juce::ModifierKeys::commandModifier | juce::ModifierKeys::shiftModifier, 0))
+    {
+        audioProcessor.setClipCaptureEnabled(!audioProcessor.isClipCaptureEnabled());
+        return true;
+    }
+    
+    if (key == juce::KeyPress('r', juce::ModifierKeys::commandModifier, 0))
+    {
+        if (audioProcessor.isClipCaptureEnabled())
+            captureClip();
+        return true;
+    }
+    
+    // Cmd/Ctrl+Shift+E exports the todo list, Cmd/Ctrl+Shift+I imports one
+    if (key == juce::KeyPress('e', juce::ModifierKeys::commandModifier | juce::ModifierKeys::shiftModifier, 0))
+    {
+        exportTodoList();
+        return true;
+    }
+    
+    if (key == juce::KeyPress('i', juce::ModifierKeys::commandModifier | juce::ModifierKeys::shiftModifier, 0))
+    {
+        importTodoList();
+        return true;
+    }
+    
+    // Cmd/Ctrl+Shift+O shows or hides every track's notes and open todos
+    if (key == juce::KeyPress('o', juce::ModifierKeys::commandModifier | juce::ModifierKeys::shiftModifier, 0))
+    {
+        if (sessionOverview != nullptr && sessionOverview->isVisible())
+            hideSessionOverview();
+        else
+            showSessionOverview();
+        return true;
+    }
+    
+    // Cmd/Ctrl+P opens the quick-open finder over the todos
+    if (key == juce::KeyPress('p', juce::ModifierKeys::commandModifier, 0))
+    {
+        showTodoFinder();
+        return true;
     }
     
-    if (isTodoFocused || selectedIndex >= 0)
+    // Todo keyboard shortcuts work when focus is in todo area
+    // Check if focus is on todo input field or a todo item
+    bool isTodoFocused = todoInputField->hasKeyboardFocus(true) || todoItemEditor->hasKeyboardFocus(true);
+    bool hasSelection = juce::isPositiveAndBelow(selectedIndex, todoData.size());
+    
+    if (isTodoFocused || hasSelection)
     {
         if (key == juce::KeyPress::upKey)
         {
@@ -504,17 +882,17 @@ bool NotePadAudioProcessorEditor::keyPressed(const juce::KeyPress& key)
             moveSelection(1);
             return true;
         }
-        else if (key == juce::KeyPress::spaceKey && selectedIndex >= 0)
+        else if (key == juce::KeyPress::spaceKey && hasSelection)
         {
-            todoItems[selectedIndex]->setToggleState(!todoItems[selectedIndex]->getToggleState(), juce::sendNotification);
+            setTodoCompleted(selectedIndex, !todoData[selectedIndex].completed);
             return true;
         }
-        else if (key == juce::KeyPress::returnKey && selectedIndex >= 0)
+        else if (key == juce::KeyPress::returnKey && hasSelection)
         {
             editTodoItem(selectedIndex);
             return true;
         }
-        else if (key == juce::KeyPress::deleteKey && selectedIndex >= 0)
+        else if (key == juce::KeyPress::deleteKey && hasSelection)
         {
             deleteTodoItem(selectedIndex);
             return true;
@@ -549,254 +927,506 @@ void NotePadAudioProcessorEditor::buttonClicked(juce::Button* button)
         else
             toggleFullscreen(FullscreenMode::Right); // Fullscreen right pane
     }
-    else
+}
+
+void NotePadAudioProcessorEditor::setTodoCompleted(int index, bool completed)
+{
+    if (juce::isPositiveAndBelow(index, todoData.size()))
     {
-        // Check if it's one of the todo checkboxes
-        for (int i = 0; i < todoItems.size(); ++i)
-        {
-            if (button == todoItems[i])
-            {
-                selectedIndex = i;
-                // Update the todoData completed state to match the checkbox
-                if (i < todoData.size())
-                {
-                    todoData.getReference(i).completed = todoItems[i]->getToggleState();
-                }
-                updateVisualState();
-                updateTodoItemsState();
-                break;
-            }
-        }
+        selectedIndex = index;
+        todoData.getReference(index).completed = completed;
+        updateVisualState();
+        updateTodoItemState(index);
     }
 }
 
 void NotePadAudioProcessorEditor::refreshTodoList()
 {
     // Clear existing items
-    todoItems.clear();
-    todoLabels.clear();
-    todoEditors.clear();
-    todoData.clear();
+    if (editingIndex >= 0)
+        finishEditingTodoItem();
+    todoData.clearQuick();
+    todoSearchIndex.clear();
     
     // Load from state
-    auto todoArray = audioProcessor.treeState.state.getChildWithName("TodoItems");
-    if (todoArray.isValid() && todoArray.getNumChildren() > 0)
+    auto todoArray = getTodoItemsTree();
+    juce::Array<juce::ValueTree> emptyNodes;
+    
+    if (todoArray.getNumChildren() > 0)
     {
+        todoData.ensureStorageAllocated(todoArray.getNumChildren());
+        
         for (int i = 0; i < todoArray.getNumChildren(); ++i)
         {
             auto todoItem = todoArray.getChild(i);
             if (todoItem.isValid())
             {
-                // Get text property - handle both string and var types
-                juce::var textVar = todoItem.getProperty("Text");
-                juce::String text = textVar.isString() ? textVar.toString() : juce::String();
+                auto newItem = getTodoItemFromNode(todoItem);
                 
-                // Get checked property - handle boolean conversion properly
-                juce::var checkedVar = todoItem.getProperty("Checked");
-                bool checked = false;
-                if (checkedVar.isBool())
-                    checked = static_cast<bool>(checkedVar);
-                else if (checkedVar.isInt())
-                    checked = static_cast<bool>(static_cast<int>(checkedVar));
-                else if (checkedVar.isDouble())
-                    checked = static_cast<bool>(static_cast<int>(static_cast<double>(checkedVar)));
-                else if (checkedVar.isString())
+                // Only add if text is not empty
+                if (newItem.text.isNotEmpty())
                 {
-                    // Handle string "true"/"false"
-                    juce::String str = checkedVar.toString().toLowerCase();
-                    checked = (str == "true" || str == "1");
+                    // Items saved before ids existed get one now, so later edits can target them
+                    if (newItem.id <= 0)
+                    {
+                        newItem.id = allocateTodoId();
+                        todoItem.setProperty("Id", newItem.id, nullptr);
+                    }
+                    
+                    todoData.add(newItem);
                 }
-                
-                // Only add if text is not empty
-                if (text.isNotEmpty())
+                else
                 {
-                    TodoItem newItem;
-                    newItem.text = text;
-                    newItem.completed = checked;
-                    addTodoItem(newItem);
+                    emptyNodes.add(todoItem);
                 }
             }
         }
     }
     
+    // Keep the tree aligned with todoData, empty items were never shown
+    for (auto& node : emptyNodes)
+        todoArray.removeChild(node, nullptr);
+    
+    for (int i = 0; i < todoData.size(); ++i)
+        indexTodoItem(i);
+    
+    rebuildMarkerIndex();
+    
+    // Select the last item, as adding them one by one used to
+    selectedIndex = todoData.size() - 1;
+    
     // Ensure visual state is updated after loading all items
-    updateVisualState();
+    filterItems(currentFilter);
 }
 
 void NotePadAudioProcessorEditor::updateTodoItemsState()
 {
-    // Get the actual number of todo items from UI - they should be the same size
-    int numItems = todoItems.size();
-    if (todoLabels.size() != numItems)
-        numItems = juce::jmax(todoItems.size(), todoLabels.size());
-    
-    // Create a new TodoItems ValueTree with all children
-    juce::ValueTree newTodoArray("TodoItems");
-    
-    // Add each todo item to the new array
-    for (int i = 0; i < numItems; ++i)
-    {
-        // Make sure we have valid UI elements for this index
-        if (i < todoLabels.size() && i < todoItems.size())
-        {
-            juce::String text = todoLabels[i]->getText().trim();
-            bool checked = todoItems[i]->getToggleState();
-            
-            // Create ValueTree node for this todo item
-            juce::ValueTree todoItem("TodoItem");
-            todoItem.setProperty("Text", text, nullptr);
-            // Explicitly save as boolean to ensure proper type
-            todoItem.setProperty("Checked", juce::var(checked), nullptr);
-            
-            // Append to the new array
-            newTodoArray.appendChild(todoItem, nullptr);
-        }
-    }
-    
-    // Now replace the old TodoItems child with the new one
-    // First, remove the old one if it exists
-    auto oldTodoArray = audioProcessor.treeState.state.getChildWithName("TodoItems");
-    if (oldTodoArray.isValid())
-    {
-        audioProcessor.treeState.state.removeChild(oldTodoArray, nullptr);
-    }
-    
-    // Add the new one
-    audioProcessor.treeState.state.appendChild(newTodoArray, nullptr);
+    // Rewrites every node from todoData, only needed when the whole list is replaced.
+    // Single edits go through updateTodoItemState() and the targeted add/remove/move calls
+    auto todoArray = getTodoItemsTree();
+    todoArray.removeAllChildren(nullptr);
     
-    // Also sync todoData for consistency (used by other parts of the code)
-    todoData.clear();
-    for (int i = 0; i < numItems; ++i)
-    {
-        if (i < todoLabels.size() && i < todoItems.size())
-        {
-            TodoItem item;
-            item.text = todoLabels[i]->getText();
-            item.completed = todoItems[i]->getToggleState();
-            todoData.add(item);
-        }
-    }
+    for (const auto& item : todoData)
+        todoArray.appendChild(createTodoNode(item), nullptr);
 }
 
-void NotePadAudioProcessorEditor::mouseDoubleClick(const juce::MouseEvent& e)
+void NotePadAudioProcessorEditor::updateTodoItemState(int index)
 {
-    // Don't handle mouse events if clicking on fullscreen buttons
-    if (leftFullscreenButton != nullptr && leftFullscreenButton->isVisible() && 
-        leftFullscreenButton->getBounds().contains(e.getPosition()))
-        return;
-    if (rightFullscreenButton != nullptr && rightFullscreenButton->isVisible() && 
-        rightFullscreenButton->getBounds().contains(e.getPosition()))
+    if (!juce::isPositiveAndBelow(index, todoData.size()))
         return;
     
-    // Only handle double-click in todo area (right pane)
-    int dividerX = (fullscreenMode == FullscreenMode::None) ? getWidth() / 2 : 0;
-    if (fullscreenMode == FullscreenMode::Right || (fullscreenMode == FullscreenMode::None && e.getPosition().x > dividerX))
+    // Only the properties that differ fire listeners, the rest of the list is untouched
+    const auto& item = todoData.getReference(index);
+    auto node = getTodoNode(index);
+    if (node.isValid())
     {
-        for (int i = 0; i < todoLabels.size(); ++i)
-        {
-            if (todoLabels[i]->isVisible() && todoLabels[i]->getBounds().contains(e.getPosition()))
-            {
-                editTodoItem(i);
-                break;
-            }
-        }
+        auto before = node.createCopy();
+        
+        node.setProperty("Text", item.text.trim(), nullptr);
+        // Explicitly save as boolean to ensure proper type
+        node.setProperty("Checked", juce::var(item.completed), nullptr);
+        
+        if (item.priority != Priority::Low)
+            node.setProperty("Priority", static_cast<int>(item.priority), nullptr);
+        else
+            node.removeProperty("Priority", nullptr);
+        
+        if (item.dueDate.toMilliseconds() != 0)
+            node.setProperty("DueDate", item.dueDate.toMilliseconds(), nullptr);
+        else
+            node.removeProperty("DueDate", nullptr);
+        
+        if (item.tags.isNotEmpty())
+            node.setProperty("Tags", item.tags, nullptr);
+        else
+            node.removeProperty("Tags", nullptr);
+        
+        if (item.anchorTime >= 0.0)
+            node.setProperty("AnchorTime", item.anchorTime, nullptr);
+        else
+            node.removeProperty("AnchorTime", nullptr);
+        
+        undoJournal.recordTodoChanged(before, node.createCopy());
     }
 }
 
-void NotePadAudioProcessorEditor::mouseDown(const juce::MouseEvent& e)
+juce::ValueTree NotePadAudioProcessorEditor::getTodoItemsTree()
+{
+    return audioProcessor.treeState.state.getOrCreateChildWithName("TodoItems", nullptr);
+}
+
+juce::ValueTree NotePadAudioProcessorEditor::getTodoNode(int index)
+{
+    auto todoArray = getTodoItemsTree();
+    auto id = todoData[index].id;
+    
+    // Nodes are kept in todoData order, so the same index is almost always the right one
+    auto node = todoArray.getChild(index);
+    if (node.isValid() && static_cast<juce::int64>(node.getProperty("Id")) == id)
+        return node;
+    
+    return todoArray.getChildWithProperty("Id", id);
+}
+
+juce::ValueTree NotePadAudioProcessorEditor::createTodoNode(const TodoItem& item) const
+{
+    // Create ValueTree node for this todo item
+    juce::ValueTree todoItem("TodoItem");
+    todoItem.setProperty("Id", item.id, nullptr);
+    todoItem.setProperty("Text", item.text.trim(), nullptr);
+    // Explicitly save as boolean to ensure proper type
+    todoItem.setProperty("Checked", juce::var(item.completed), nullptr);
+    // Optional properties are only written when set, so plain todos stay small
+    if (item.priority != Priority::Low)
+        todoItem.setProperty("Priority", static_cast<int>(item.priority), nullptr);
+    if (item.dueDate.toMilliseconds() != 0)
+        todoItem.setProperty("DueDate", item.dueDate.toMilliseconds(), nullptr);
+    if (item.tags.isNotEmpty())
+        todoItem.setProperty("Tags", item.tags, nullptr);
+    if (item.anchorTime >= 0.0)
+        todoItem.setProperty("AnchorTime", item.anchorTime, nullptr);
+    return todoItem;
+}
+
+NotePadAudioProcessorEditor::TodoItem NotePadAudioProcessorEditor::getTodoItemFromNode(const juce::ValueTree& node) const
+{
+    TodoItem item;
+    
+    // Get text property - handle both string and var types
+    juce::var textVar = node.getProperty("Text");
+    item.text = textVar.isString() ? textVar.toString() : juce::String();
+    
+    // Get checked property - handle boolean conversion properly
+    juce::var checkedVar = node.getProperty("Checked");
+    if (checkedVar.isBool())
+        item.completed = static_cast<bool>(checkedVar);
+    else if (checkedVar.isInt())
+        item.completed = static_cast<bool>(static_cast<int>(checkedVar));
+    else if (checkedVar.isDouble())
+        item.completed = static_cast<bool>(static_cast<int>(static_cast<double>(checkedVar)));
+    else if (checkedVar.isString())
+    {
+        // Handle string "true"/"false"
+        juce::String str = checkedVar.toString().toLowerCase();
+        item.completed = (str == "true" || str == "1");
+    }
+    
+    item.priority = static_cast<Priority>(juce::jlimit(0, 2, static_cast<int>(node.getProperty("Priority", 0))));
+    item.dueDate = juce::Time(static_cast<juce::int64>(node.getProperty("DueDate", 0)));
+    item.tags = node.getProperty("Tags").toString();
+    item.anchorTime = static_cast<double>(node.getProperty("AnchorTime", -1.0));
+    item.id = node.hasProperty("Id") ? static_cast<juce::int64>(node.getProperty("Id")) : 0;
+    return item;
+}
+
+juce::int64 NotePadAudioProcessorEditor::allocateTodoId()
+{
+    // The next free id is kept on the "TodoItems" node so ids are never reused
+    auto todoArray = getTodoItemsTree();
+    auto nextId = static_cast<juce::int64>(todoArray.getProperty("NextId", 0));
+    
+    if (nextId <= 0)
+    {
+        nextId = 1;
+        for (const auto& child : todoArray)
+            nextId = juce::jmax(nextId, static_cast<juce::int64>(child.getProperty("Id", 0)) + 1);
+    }
+    
+    todoArray.setProperty("NextId", nextId + 1, nullptr);
+    return nextId;
+}
+
+void NotePadAudioProcessorEditor::exportTodoList()
+{
+    if (todoTransferTask != nullptr)
+        return;
+    
+    if (editingIndex >= 0)
+        finishEditingTodoItem();
+    
+    // The published snapshot is never modified, so the writer thread reads it in place
+    audioProcessor.flushPendingUpdates();
+    auto todoItems = audioProcessor.getStateSnapshot()->state.getChildWithName("TodoItems");
+    
+    auto defaultFile = juce::File::getSpecialLocation(juce::File::userDocumentsDirectory).getChildFile("Todos.md");
+    todoFileChooser = std::make_unique<juce::FileChooser>("Export todos", defaultFile, "*.md;*.json;*.csv");
+    
+    juce::Component::SafePointer<NotePadAudioProcessorEditor> safeThis(this);
+    auto flags = juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::canSelectFiles
+                 | juce::FileBrowserComponent::warnAboutOverwriting;
+    
+    todoFileChooser->launchAsync(flags, [safeThis, todoItems](const juce::FileChooser& chooser)
+    {
+        auto file = chooser.getResult();
+        if (safeThis == nullptr || file == juce::File() || safeThis->todoTransferTask != nullptr)
+            return;
+        
+        if (file.getFileExtension().isEmpty())
+            file = file.withFileExtension("md");
+        
+        auto* task = new TodoExportTask(todoItems, file, safeThis.getComponent());
+        safeThis->todoTransferTask.reset(task);
+        
+        task->onFinished = [safeThis, file](bool succeeded, bool cancelled)
+        {
+            if (safeThis == nullptr)
+                return;
+            
+            safeThis->todoTransferTask = nullptr;
+            
+            if (!succeeded && !cancelled)
+                juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "Export failed",
+                                                       "Couldn't write " + file.getFullPathName(), {}, safeThis.getComponent());
+        };
+        
+        task->launchThread();
+    });
+}
+
+void NotePadAudioProcessorEditor::importTodoList()
 {
-    // Don't handle mouse events if clicking on fullscreen buttons
-    if (leftFullscreenButton != nullptr && leftFullscreenButton->isVisible() && 
-        leftFullscreenButton->getBounds().contains(e.getPosition()))
+    if (todoTransferTask != nullptr || audioProcessor.isContentUnreadable())
         return;
-    if (rightFullscreenButton != nullptr && rightFullscreenButton->isVisible() && 
-        rightFullscreenButton->getBounds().contains(e.getPosition()))
+    
+    auto startDirectory = juce::File::getSpecialLocation(juce::File::userDocumentsDirectory);
+    todoFileChooser = std::make_unique<juce::FileChooser>("Import todos", startDirectory, "*.md;*.markdown;*.txt;*.json;*.csv");
+    
+    juce::Component::SafePointer<NotePadAudioProcessorEditor> safeThis(this);
+    todoFileChooser->launchAsync(juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles,
+                                 [safeThis](const juce::FileChooser& chooser)
+    {
+        auto file = chooser.getResult();
+        if (safeThis != nullptr && file.existsAsFile() && safeThis->todoTransferTask == nullptr)
+            safeThis->startTodoImport(file);
+    });
+}
+
+void NotePadAudioProcessorEditor::startTodoImport(const juce::File& file)
+{
+    if (editingIndex >= 0)
+        finishEditingTodoItem();
+    
+    // Items are appended after everything already there, so the undo history's
+    // indices stay valid without recording the import itself
+    int startSize = todoData.size();
+    
+    // One snapshot (and journal entry) for the whole import rather than one per batch
+    audioProcessor.setBulkChangeInProgress(true);
+    
+    auto* task = new TodoImportTask(file, this);
+    todoTransferTask.reset(task);
+    
+    // The task is owned by the editor, so it never calls back into a deleted one
+    task->onItems = [this](const std::vector<juce::ValueTree>& items) { appendImportedItems(items); };
+    task->onFinished = [this, startSize](bool cancelled)
+    {
+        // A cancelled import takes back what it had added
+        if (cancelled)
+            removeTodoItemsFrom(startSize);
+        
+        audioProcessor.setBulkChangeInProgress(false);
+        todoTransferTask = nullptr;
+    };
+    
+    task->launchThread();
+}
+
+void NotePadAudioProcessorEditor::appendImportedItems(const std::vector<juce::ValueTree>& items)
+{
+    auto todoArray = getTodoItemsTree();
+    bool anyAnchored = false;
+    
+    todoData.ensureStorageAllocated(todoData.size() + (int) items.size());
+    
+    for (const auto& node : items)
+    {
+        auto item = getTodoItemFromNode(node);
+        if (item.text.isEmpty())
+            continue;
+        
+        item.id = allocateTodoId();
+        todoData.add(item);
+        todoArray.appendChild(createTodoNode(item), nullptr);
+        indexTodoItem(todoData.size() - 1);
+        anyAnchored = anyAnchored || item.anchorTime >= 0.0;
+    }
+    
+    if (anyAnchored)
+        rebuildMarkerIndex();
+    
+    // Rows are recycled by the ListBox, only the row count changes here
+    filterItems(currentFilter);
+}
+
+void NotePadAudioProcessorEditor::removeTodoItemsFrom(int index)
+{
+    if (!juce::isPositiveAndBelow(index, todoData.size()))
         return;
     
+    if (editingIndex >= index)
+        finishEditingTodoItem();
+    
+    auto todoArray = getTodoItemsTree();
+    bool anyAnchored = false;
+    
+    // From the back, so neither the nodes nor todoData shift on each removal
+    for (int i = todoData.size(); --i >= index;)
+    {
+        const auto& item = todoData.getReference(i);
+        todoSearchIndex.removeDocument(item.id);
+        anyAnchored = anyAnchored || item.anchorTime >= 0.0;
+        todoArray.removeChild(i, nullptr);
+    }
+    
+    todoData.removeRange(index, todoData.size() - index);
+    
+    if (selectedIndex >= todoData.size())
+        selectedIndex = todoData.size() - 1;
+    
+    if (anyAnchored)
+        rebuildMarkerIndex();
+    
+    filterItems(currentFilter);
+}
+
+int NotePadAudioProcessorEditor::getItemIndexAt(const juce::MouseEvent& e) const
+{
+    if (todoListBox == nullptr || !todoListBox->isVisible())
+        return -1;
+    
+    // Rows have a fixed height, so the ListBox maps the position straight to a row
+    auto position = e.getEventRelativeTo(todoListBox.get()).getPosition();
+    if (!todoListBox->getLocalBounds().contains(position))
+        return -1;
+    
+    return getItemIndexForRow(todoListBox->getRowContainingPosition(position.x, position.y));
+}
+
+void NotePadAudioProcessorEditor::mouseDoubleClick(const juce::MouseEvent& e)
+{
+    // Only todo labels forward their mouse events here
+    int index = getItemIndexAt(e);
+    if (index >= 0)
+        editTodoItem(index);
+}
+
+void NotePadAudioProcessorEditor::mouseDown(const juce::MouseEvent& e)
+{
     // Set up drag start index for todo item reordering
-    int dividerX = (fullscreenMode == FullscreenMode::None) ? getWidth() / 2 : 0;
-    if (fullscreenMode == FullscreenMode::Right || (fullscreenMode == FullscreenMode::None && e.getPosition().x > dividerX))
+    int index = getItemIndexAt(e);
+    if (index >= 0)
     {
-        for (int i = 0; i < todoLabels.size(); ++i)
-        {
-            if (todoLabels[i]->isVisible() && todoLabels[i]->getBounds().contains(e.getPosition()))
-            {
-                dragStartIndex = i;
-                selectedIndex = i;
-                updateVisualState();
-                break;
-            }
-        }
+        dragStartIndex = index;
+        selectedIndex = index;
+        updateVisualState();
     }
 }
 
 void NotePadAudioProcessorEditor::addTodoItem(const TodoItem& item)
 {
-    todoData.add(item);
+    TodoItem newItem(item);
+    if (newItem.id <= 0)
+        newItem.id = allocateTodoId();
     
-    int index = todoData.size() - 1;
+    insertTodoItem(todoData.size(), newItem);
     
-    // Create checkbox
-    auto* checkbox = new juce::ToggleButton("");
-    todoItems.add(checkbox);
-    addAndMakeVisible(checkbox);
-    checkbox->addListener(this);
-    checkbox->setToggleState(item.completed, juce::dontSendNotification);
-    checkbox->setVisible(true); // Always visible in todo area
+    int row = getRowForItemIndex(selectedIndex);
+    if (row >= 0)
+        todoListBox->scrollToEnsureRowIsOnscreen(row);
+}
+
+void NotePadAudioProcessorEditor::insertTodoItem(int index, const TodoItem& item)
+{
+    index = juce::jlimit(0, todoData.size(), index);
     
-    // Create label with priority and category indicators
-    auto* label = new StrikethroughLabel("", item.text);
-    todoLabels.add(label);
-    addAndMakeVisible(label);
-    label->setColour(juce::Label::textColourId, getPriorityColour(item.priority));
-    label->setVisible(true); // Always visible in todo area
-    label->addMouseListener(this, false);
-    label->setStrikethrough(item.completed);
+    todoData.insert(index, item);
+    auto node = createTodoNode(item);
+    getTodoItemsTree().addChild(node, index, nullptr);
+    undoJournal.recordTodoAdded(index, node.createCopy());
+    indexTodoItem(index);
+    addMarker(item.anchorTime, item.id);
     
-    // Set initial bounds
-    checkbox->setBounds(10, 10 + index * 30, 22, 20);
-    label->setBounds(40, 10 + index * 30, getWidth() - 50, 20);
+    if (editingIndex >= index)
+        editingIndex++;
     
     // Update selection
     selectedIndex = index;
-    updateVisualState();
-    updateTodoItemsState();
+    filteredItemInserted(index);
 }
 
 void NotePadAudioProcessorEditor::mouseDrag(const juce::MouseEvent& e)
 {
     // Allow dragging in todo area (right pane)
-    int dividerX = getWidth() / 2;
-    if (e.getPosition().x > dividerX && dragStartIndex >= 0)
+    if (dragStartIndex < 0 || todoListBox == nullptr)
+        return;
+    
+    if (!isDragging)
     {
-        isDragging = true;
-        int currentIndex = -1;
+        if (e.getDistanceFromDragStart() < 4)
+            return;
         
-        // Find which item we're dragging over
-        for (int i = 0; i < todoLabels.size(); ++i)
-        {
-            if (todoLabels[i]->getBounds().contains(e.getPosition()))
-            {
-                currentIndex = i;
-                break;
-            }
-        }
+        isDragging = true;
         
-        if (currentIndex >= 0 && currentIndex != dragStartIndex)
-        {
-            reorderItems(dragStartIndex, currentIndex);
-            dragStartIndex = currentIndex;
-        }
+        // Keeps mouseDrag coming while the mouse rests near an edge, so the list keeps scrolling
+        juce::Component::beginDragAutoRepeat(40);
     }
+    
+    // Only the preview moves while dragging, the todo tree is written once on mouseUp
+    auto* viewport = todoListBox->getViewport();
+    auto viewportPosition = e.getEventRelativeTo(viewport).getPosition();
+    viewport->autoScroll(viewportPosition.x, viewportPosition.y, 20, 10);
+    
+    auto listPosition = e.getEventRelativeTo(todoListBox.get()).getPosition();
+    setDragInsertionRow(todoListBox->getInsertionIndexForPosition(listPosition.x, listPosition.y));
 }
 
 void NotePadAudioProcessorEditor::mouseUp(const juce::MouseEvent& e)
 {
-    if (isDragging)
+    juce::ignoreUnused(e);
+    
+    int fromIndex = dragStartIndex;
+    int insertionRow = dragInsertionRow;
+    bool wasDragging = isDragging;
+    
+    dragStartIndex = -1;
+    isDragging = false;
+    setDragInsertionRow(-1);
+    juce::Component::beginDragAutoRepeat(0);
+    
+    if (!wasDragging || fromIndex < 0 || insertionRow < 0)
+        return;
+    
+    // The gap below the dragged row's own position is one row further on than where it ends up
+    int fromRow = getRowForItemIndex(fromIndex);
+    int toRow = insertionRow > fromRow ? insertionRow - 1 : insertionRow;
+    int toIndex = getItemIndexForRow(toRow);
+    
+    if (fromRow >= 0 && toIndex >= 0 && toIndex != fromIndex)
+        reorderItems(fromIndex, toIndex);
+}
+
+juce::Rectangle<int> NotePadAudioProcessorEditor::getDragIndicatorBounds() const
+{
+    if (dragInsertionRow < 0 || todoListBox == nullptr)
+        return {};
+    
+    auto listBounds = todoListBox->getBounds();
+    int y = listBounds.getY() + dragInsertionRow * todoListBox->getRowHeight() - todoListBox->getViewport()->getViewPositionY();
+    y = juce::jlimit(listBounds.getY(), listBounds.getBottom(), y);
+    return { listBounds.getX(), y - 1, listBounds.getWidth(), 2 };
+}
+
+void NotePadAudioProcessorEditor::setDragInsertionRow(int row)
+{
+    // Also called as the list autoscrolls under a resting mouse, so the position moves on screen
+    auto oldBounds = getDragIndicatorBounds();
+    dragInsertionRow = row;
+    auto newBounds = getDragIndicatorBounds();
+    
+    if (newBounds != oldBounds)
     {
-        isDragging = false;
-        dragStartIndex = -1;
-        updateVisualState();
+        repaint(oldBounds);
+        repaint(newBounds);
     }
 }
 
@@ -805,33 +1435,317 @@ void NotePadAudioProcessorEditor::reorderItems(int fromIndex, int toIndex)
     if (fromIndex >= 0 && fromIndex < todoData.size() && 
         toIndex >= 0 && toIndex < todoData.size())
     {
+        auto node = getTodoNode(fromIndex);
+        auto todoArray = getTodoItemsTree();
+        if (node.isValid())
+            todoArray.moveChild(todoArray.indexOf(node), toIndex, nullptr);
+        
         todoData.move(fromIndex, toIndex);
-        todoItems.move(fromIndex, toIndex);
-        todoLabels.move(fromIndex, toIndex);
-        todoEditors.move(fromIndex, toIndex);
+        undoJournal.recordTodoMoved(fromIndex, toIndex);
         
         if (editingIndex == fromIndex)
             editingIndex = toIndex;
+        else if (fromIndex < editingIndex && editingIndex <= toIndex)
+            editingIndex--;
+        else if (toIndex <= editingIndex && editingIndex < fromIndex)
+            editingIndex++;
             
         selectedIndex = toIndex;
-        updateTodoItemsState();
-        resized();
+        filterItems(currentFilter);
+    }
+}
+
+void NotePadAudioProcessorEditor::applyNotesEdit(int position, int lengthToRemove, const juce::String& textToInsert)
+{
+    m1TextEditor->applyEdit({ position, position + lengthToRemove }, textToInsert);
+}
+
+void NotePadAudioProcessorEditor::applyTodoInsert(int index, const juce::ValueTree& item)
+{
+    // A fresh node goes into the tree, the journal keeps its own copy
+    insertTodoItem(index, getTodoItemFromNode(item));
+}
+
+void NotePadAudioProcessorEditor::applyTodoRemove(int index)
+{
+    deleteTodoItem(index);
+}
+
+void NotePadAudioProcessorEditor::applyTodoMove(int fromIndex, int toIndex)
+{
+    reorderItems(fromIndex, toIndex);
+}
+
+void NotePadAudioProcessorEditor::applyTodoChange(const juce::ValueTree& item)
+{
+    auto restored = getTodoItemFromNode(item);
+    auto i = findItemIndex(restored.id);
+    if (i < 0)
+        return;
+    
+    if (editingIndex == i)
+        finishEditingTodoItem();
+    
+    auto& current = todoData.getReference(i);
+    if (current.anchorTime != restored.anchorTime)
+    {
+        removeMarker(current.anchorTime, current.id);
+        addMarker(restored.anchorTime, restored.id);
     }
+    
+    current = restored;
+    updateTodoItemState(i);
+    indexTodoItem(i);
+    
+    selectedIndex = i;
+    filteredItemChanged(i);
+}
+
+int NotePadAudioProcessorEditor::findItemIndex(juce::int64 id) const
+{
+    auto isAt = [this, id](int index) { return juce::isPositiveAndBelow(index, todoData.size()) && todoData.getReference(index).id == id; };
+    
+    auto cached = itemIndexById.find(id);
+    if (cached != itemIndexById.end() && isAt(cached->second))
+        return cached->second;
+    
+    // Inserts, removals and moves leave entries behind, the first miss after them maps
+    // the list again and lookups are direct until the next one
+    itemIndexById.clear();
+    for (int i = 0; i < todoData.size(); ++i)
+        itemIndexById[todoData.getReference(i).id] = i;
+    
+    cached = itemIndexById.find(id);
+    return cached != itemIndexById.end() ? cached->second : -1;
 }
 
 void NotePadAudioProcessorEditor::filterItems(const juce::String& searchText)
 {
-    for (int i = 0; i < todoLabels.size(); ++i)
+    currentFilter = searchText;
+    filteredIndices.clearQuick();
+    
+    if (searchText.isNotEmpty())
     {
-        const auto& item = todoData[i];
-        bool matches = searchText.isEmpty() ||
-                      item.text.containsIgnoreCase(searchText) ||
-                      item.tags.containsIgnoreCase(searchText);
-                      
-        todoItems[i]->setVisible(matches); // Always visible when matching
-        todoLabels[i]->setVisible(matches); // Always visible when matching
+        // The index narrows the candidates, the list order still comes from todoData
+        auto matches = todoSearchIndex.search(searchText);
+        std::unordered_set<juce::int64> matchingIds(matches.begin(), matches.end());
+        
+        for (int i = 0; i < todoData.size(); ++i)
+            if (matchingIds.count(todoData.getReference(i).id) > 0)
+                filteredIndices.add(i);
     }
-    resized();
+    
+    showFilteredRows();
+}
+
+bool NotePadAudioProcessorEditor::itemMatchesFilter(int index) const
+{
+    // Same test as SearchIndex::search, on the one document
+    return todoSearchIndex.getLowerCaseText(todoData.getReference(index).id).contains(currentFilter.toLowerCase());
+}
+
+void NotePadAudioProcessorEditor::filteredItemInserted(int index)
+{
+    if (currentFilter.isNotEmpty())
+    {
+        auto position = (int) (std::lower_bound(filteredIndices.begin(), filteredIndices.end(), index) - filteredIndices.begin());
+        for (int i = position; i < filteredIndices.size(); ++i)
+            filteredIndices.getReference(i)++;
+        
+        if (itemMatchesFilter(index))
+            filteredIndices.insert(position, index);
+    }
+    
+    showFilteredRows();
+}
+
+void NotePadAudioProcessorEditor::filteredItemRemoved(int index)
+{
+    if (currentFilter.isNotEmpty())
+    {
+        auto position = (int) (std::lower_bound(filteredIndices.begin(), filteredIndices.end(), index) - filteredIndices.begin());
+        if (position < filteredIndices.size() && filteredIndices.getUnchecked(position) == index)
+            filteredIndices.remove(position);
+        
+        for (int i = position; i < filteredIndices.size(); ++i)
+            filteredIndices.getReference(i)--;
+    }
+    
+    showFilteredRows();
+}
+
+void NotePadAudioProcessorEditor::filteredItemChanged(int index)
+{
+    if (currentFilter.isNotEmpty())
+    {
+        auto position = (int) (std::lower_bound(filteredIndices.begin(), filteredIndices.end(), index) - filteredIndices.begin());
+        bool shown = position < filteredIndices.size() && filteredIndices.getUnchecked(position) == index;
+        bool matches = itemMatchesFilter(index);
+        
+        if (shown && !matches)
+            filteredIndices.remove(position);
+        else if (!shown && matches)
+            filteredIndices.insert(position, index);
+    }
+    
+    showFilteredRows();
+}
+
+void NotePadAudioProcessorEditor::showFilteredRows()
+{
+    // The number of rows changed, not just how they look
+    todoListBox->updateContent();
+    updateVisualState();
+}
+
+void NotePadAudioProcessorEditor::indexTodoItem(int index)
+{
+    const auto& item = todoData.getReference(index);
+    todoSearchIndex.setDocument(item.id, item.tags.isEmpty() ? item.text : item.text + "\n" + item.tags);
+}
+
+int NotePadAudioProcessorEditor::getItemIndexForRow(int row) const
+{
+    if (currentFilter.isEmpty())
+        return juce::isPositiveAndBelow(row, todoData.size()) ? row : -1;
+    
+    return juce::isPositiveAndBelow(row, filteredIndices.size()) ? filteredIndices.getUnchecked(row) : -1;
+}
+
+int NotePadAudioProcessorEditor::getRowForItemIndex(int index) const
+{
+    if (!juce::isPositiveAndBelow(index, todoData.size()))
+        return -1;
+    
+    if (currentFilter.isEmpty())
+        return index;
+    
+    // Filtered indices are in list order
+    auto found = std::lower_bound(filteredIndices.begin(), filteredIndices.end(), index);
+    return found != filteredIndices.end() && *found == index ? (int) (found - filteredIndices.begin()) : -1;
+}
+
+//==============================================================================
+int NotePadAudioProcessorEditor::getNumRows()
+{
+    return currentFilter.isEmpty() ? todoData.size() : filteredIndices.size();
+}
+
+void NotePadAudioProcessorEditor::paintListBoxItem(int rowNumber, juce::Graphics& g, int width, int height, bool rowIsSelected)
+{
+    // Rows are drawn by their TodoRowComponent
+    juce::ignoreUnused(rowNumber, g, width, height, rowIsSelected);
+}
+
+juce::Component* NotePadAudioProcessorEditor::refreshComponentForRow(int rowNumber, bool isRowSelected, juce::Component* existingComponentToUpdate)
+{
+    juce::ignoreUnused(isRowSelected);
+    
+    auto* row = dynamic_cast<TodoRowComponent*>(existingComponentToUpdate);
+    if (row == nullptr)
+    {
+        delete existingComponentToUpdate;
+        row = new TodoRowComponent(*this);
+    }
+    
+    row->update(getItemIndexForRow(rowNumber));
+    return row;
+}
+
+//==============================================================================
+TodoRowComponent::TodoRowComponent(NotePadAudioProcessorEditor& editor)
+    : owner(editor)
+{
+    addAndMakeVisible(checkbox);
+    checkbox.onClick = [this] { owner.setTodoCompleted(itemIndex, checkbox.getToggleState()); };
+    
+    addAndMakeVisible(label);
+    // Selection, double-click editing and drag reordering are handled by the editor
+    label.addMouseListener(&owner, false);
+}
+
+const juce::Font& TodoRowComponent::getRowFont()
+{
+    static const juce::Font rowFont(16.0f, juce::Font::plain);
+    return rowFont;
+}
+
+void TodoRowComponent::update(int newItemIndex)
+{
+    itemIndex = newItemIndex;
+    
+    Appearance next;
+    next.isValid = juce::isPositiveAndBelow(itemIndex, owner.todoData.size());
+    next.isEditing = next.isValid && itemIndex == owner.editingIndex;
+    
+    if (next.isValid)
+    {
+        const auto& item = owner.todoData.getReference(itemIndex);
+        bool isSelected = (itemIndex == owner.selectedIndex);
+        bool isAtPlayhead = item.id == owner.activeMarkerId;
+        
+        next.text = item.text;
+        next.anchorTime = item.anchorTime;
+        next.completed = item.completed;
+        next.highlight = owner.currentFilter;
+        next.colour = item.completed ? juce::Colours::grey :
+                      isSelected ? juce::Colours::lightblue :
+                      isAtPlayhead ? juce::Colours::orange :
+                      owner.getPriorityColour(item.priority);
+    }
+    
+    // Rows are recycled and re-updated all the time, most of those changes nothing
+    if (hasShown && next == shown)
+        return;
+    
+    shown = next;
+    hasShown = true;
+    
+    auto* itemEditor = owner.todoItemEditor.get();
+    bool isValid = next.isValid;
+    bool isEditing = next.isEditing;
+    
+    // Only the row showing the item being edited hosts the inline editor
+    if (isEditing)
+    {
+        addAndMakeVisible(itemEditor);
+        resized();
+    }
+    else if (itemEditor != nullptr && itemEditor->getParentComponent() == this)
+    {
+        removeChildComponent(itemEditor);
+    }
+    
+    checkbox.setVisible(isValid);
+    label.setVisible(isValid && !isEditing);
+    
+    if (!isValid)
+        return;
+    
+    checkbox.setToggleState(next.completed, juce::dontSendNotification);
+    label.setText(next.anchorTime >= 0.0 ? "[" + NotePadAudioProcessor::formatTimelinePosition(next.anchorTime) + "] " + next.text
+                                         : next.text,
+                  juce::dontSendNotification);
+    label.setHighlightedText(next.highlight);
+    
+    // Update label colors and style
+    label.setColour(juce::Label::textColourId, next.colour);
+        
+    // Set strikethrough for completed items
+    label.setStrikethrough(next.completed);
+    
+    // Set font (plain for all, strikethrough visual is handled separately)
+    label.setFont(getRowFont());
+}
+
+void TodoRowComponent::resized()
+{
+    checkbox.setBounds(0, 0, 22, 20);
+    label.setBounds(30, 0, juce::jmax(0, getWidth() - 30), 20);
+    
+    auto* itemEditor = owner.todoItemEditor.get();
+    if (itemEditor != nullptr && itemEditor->getParentComponent() == this)
+        itemEditor->setBounds(label.getBounds());
 }
 juce::Colour NotePadAudioProcessorEditor::getPriorityColour(Priority p) const
 {
@@ -847,15 +1761,57 @@ juce::Colour NotePadAudioProcessorEditor::getPriorityColour(Priority p) const
 
 void NotePadAudioProcessorEditor::saveEditorStateToProcessor()
 {
-    // Save the text editor content to processor state
-    if (m1TextEditor != nullptr)
-    {
-        juce::String currentText = m1TextEditor->getText();
-        audioProcessor.treeState.state.setProperty("SessionText", currentText, nullptr);
-    }
+    // Publish any notes edits that are still waiting for the flush timer.
+    // Todo items are written to the processor state as soon as they change.
+    flushSessionText();
+}
+
+void NotePadAudioProcessorEditor::offerSessionRecovery()
+{
+    juce::Component::SafePointer<NotePadAudioProcessorEditor> safeThis(this);
+    
+    juce::AlertWindow::showOkCancelBox(juce::MessageBoxIconType::QuestionIcon,
+                                       "Recover unsaved notes?",
+                                       "Notes and todos were edited after this project was last saved, and the host closed before they were saved. Restore them?",
+                                       "Restore", "Keep saved version", this,
+                                       juce::ModalCallbackFunction::create([safeThis](int result)
+                                       {
+                                           if (safeThis == nullptr)
+                                               return;
+                                           
+                                           if (result == 0)
+                                               safeThis->audioProcessor.discardRecoveredSession();
+                                           else if (safeThis->audioProcessor.restoreRecoveredSession())
+                                               safeThis->reloadContentFromState();
+                                       }));
+}
+
+void NotePadAudioProcessorEditor::reloadContentFromState()
+{
+    // Whatever was waiting to be published belonged to the content being replaced
+    stopTimer();
+    sessionTextDirty = false;
+    
+    juce::var sessionTextVar = audioProcessor.treeState.state.getProperty("SessionText");
+    m1TextEditor->setText(sessionTextVar.isString() ? sessionTextVar.toString() : juce::String());
+    notesSearchIndex.update(m1TextEditor->getText());
     
-    // Save all todo items to processor state
-    updateTodoItemsState();
+    // The history refers to positions and items that are gone
+    undoJournal.clear();
+    refreshTodoList();
+    applySearch();
+    updateUnreadableContentState();
+}
+
+void NotePadAudioProcessorEditor::updateUnreadableContentState()
+{
+    // The saved content couldn't be decoded and is kept as it was, edits made here would
+    // never be saved, so the panes stay locked instead of looking empty and editable
+    bool unreadable = audioProcessor.isContentUnreadable();
+    m1TextEditor->setEnabled(!unreadable);
+    todoInputField->setEnabled(!unreadable);
+    m1TextEditor->setTextToShowWhenEmpty(unreadable ? "The notes saved with this project couldn't be read. They are kept unchanged in the project."
+                                                    : "Keep session notes here...", juce::Colours::white);
 }
 
 void NotePadAudioProcessorEditor::toggleFullscreen(FullscreenMode mode)
@@ -10,10 +10,19 @@
 
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
+#include "SearchIndex.h"
+#include "FuzzyFinder.h"
+#include "NotesEditor.h"
+#include "UndoJournal.h"
+#include "TodoTransfer.h"
 
 //==============================================================================
 /**
  * Custom Label that supports strikethrough text
+ *
+ * The text is laid out once into a cached glyph arrangement, along with its width,
+ * the strikethrough line and the search highlight boxes. Paints just replay that,
+ * and the layout is only redone when the text, font, size or highlight changes.
  */
 class StrikethroughLabel : public juce::Label
 {
@@ -33,50 +42,131 @@ public:
     
     bool getStrikethrough() const { return hasStrikethrough; }
     
+    // Marks every case-insensitive occurrence of the given text, e.g. the current search
+    void setHighlightedText(const juce::String& newHighlight)
+    {
+        if (highlightedText != newHighlight)
+        {
+            highlightedText = newHighlight;
+            layoutValid = false;
+            repaint();
+        }
+    }
+    
+    void paint(juce::Graphics& g) override
+    {
+        // The inline editor (if ever shown) draws itself, let the Label handle that case
+        if (isBeingEdited())
+        {
+            juce::Label::paint(g);
+            return;
+        }
+        
+        // setFont has no hook, so a font change is picked up here
+        if (!layoutValid || layoutFont != getFont())
+            updateLayout();
+        
+        g.fillAll(findColour(backgroundColourId));
+        
+        // Draw search highlights behind the text
+        if (!highlightRects.isEmpty())
+        {
+            g.setColour(juce::Colours::yellow.withAlpha(0.3f));
+            g.fillRectList(highlightRects);
+        }
+        
+        g.setColour(findColour(textColourId).withMultipliedAlpha(isEnabled() ? 1.0f : 0.5f));
+        glyphs.draw(g);
+        
+        g.setColour(findColour(outlineColourId));
+        g.drawRect(getLocalBounds());
+    }
+    
     void paintOverChildren(juce::Graphics& g) override
     {
         // Draw strikethrough line on top of the text
-        if (hasStrikethrough)
+        if (hasStrikethrough && glyphs.getNumGlyphs() > 0)
         {
-            auto bounds = getLocalBounds();
-            auto labelFont = getFont();
-            auto labelText = getText();
-            
-            if (labelText.isNotEmpty())
-            {
-                // Get the text area (accounting for border)
-                auto labelBorder = getBorderSize();
-                auto textArea = labelBorder.subtractedFrom(bounds).toFloat();
-                
-                // For left-aligned text (default for labels), calculate text position
-                float textWidth = static_cast<float>(labelFont.getStringWidth(labelText));
-                float textX = static_cast<float>(textArea.getX());
-                float textY = static_cast<float>(textArea.getY());
-                
-                // Get justification to determine text position
-                auto labelJustification = getJustificationType();
-                if (labelJustification.testFlags(juce::Justification::right))
-                {
-                    textX = textArea.getRight() - textWidth;
-                }
-                else if (labelJustification.testFlags(juce::Justification::horizontallyCentred))
-                {
-                    textX = textArea.getCentreX() - textWidth / 2.0f;
-                }
-                
-                // Calculate strikethrough Y position - centre of the text line
-                // Font metrics: ascent is above baseline, descent is below
-                float lineY = textY + labelFont.getHeight() / 2.0f;
-                
-                // Draw strikethrough line across the text width
-                g.setColour(findColour(textColourId));
-                g.drawLine(textX, lineY, textX + textWidth, lineY, 2.0f);
-            }
+            g.setColour(findColour(textColourId));
+            g.drawLine(strikethroughLine, 2.0f);
         }
     }
     
+    void resized() override
+    {
+        juce::Label::resized();
+        layoutValid = false;
+    }
+    
+protected:
+    void textWasChanged() override
+    {
+        layoutValid = false;
+    }
+    
 private:
     bool hasStrikethrough;
+    juce::String highlightedText;
+    
+    // Layout cache, valid for layoutFont and the current text, bounds and highlight
+    bool layoutValid = false;
+    juce::Font layoutFont;
+    juce::GlyphArrangement glyphs;
+    juce::Line<float> strikethroughLine;
+    juce::RectangleList<float> highlightRects;
+    
+    void updateLayout()
+    {
+        layoutValid = true;
+        layoutFont = getFont();
+        glyphs.clear();
+        highlightRects.clear();
+        strikethroughLine = {};
+        
+        auto labelText = getText();
+        if (labelText.isEmpty())
+            return;
+        
+        // Same fitting as LookAndFeel_V4::drawLabel, so the text lands where it always has
+        auto textArea = getBorderSize().subtractedFrom(getLocalBounds()).toFloat();
+        int maxLines = juce::jmax(1, (int) (textArea.getHeight() / layoutFont.getHeight()));
+        glyphs.addFittedText(layoutFont, labelText, textArea.getX(), textArea.getY(),
+                             textArea.getWidth(), textArea.getHeight(),
+                             getJustificationType(), maxLines, getMinimumHorizontalScale());
+        
+        auto textBounds = glyphs.getBoundingBox(0, -1, true);
+        
+        // Centre of the first line, across the width the text actually takes up
+        float lineY = textBounds.getY() + layoutFont.getHeight() / 2.0f;
+        strikethroughLine = { textBounds.getX(), lineY, textBounds.getRight(), lineY };
+        
+        if (highlightedText.isEmpty())
+            return;
+        
+        auto lowerText = labelText.toLowerCase();
+        auto lowerHighlight = highlightedText.toLowerCase();
+        
+        // Glyphs line up with characters unless the text had to be truncated, in which
+        // case the highlights are measured from the font instead
+        bool glyphPerCharacter = glyphs.getNumGlyphs() == labelText.length();
+        
+        for (int found = lowerText.indexOf(lowerHighlight); found >= 0;
+             found = lowerText.indexOf(found + 1, lowerHighlight))
+        {
+            if (glyphPerCharacter)
+            {
+                auto box = glyphs.getBoundingBox(found, lowerHighlight.length(), false);
+                highlightRects.add(box.withY(textArea.getY()).withHeight(textArea.getHeight()));
+            }
+            else
+            {
+                float x = textArea.getX() + layoutFont.getStringWidthFloat(labelText.substring(0, found));
+                float w = layoutFont.getStringWidthFloat(labelText.substring(found, found + lowerHighlight.length()));
+                highlightRects.add({ x, textArea.getY(), w, textArea.getHeight() });
+            }
+        }
+    }
+    
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StrikethroughLabel)
 };
 
@@ -146,12 +236,172 @@ private:
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(FullscreenButton)
 };
 
+//==============================================================================
+/**
+ * Narrow strip beside the notes showing the track's peak and level along the
+ * timeline, top to bottom, with the playhead on it. Each pixel row reads one bin
+ * of the coarsest level that's still fine enough, so painting never walks more
+ * bins than the strip is tall. Stereo bins are drawn as two lanes, left and right.
+ */
+class LevelMiniMap : public juce::Component
+{
+public:
+    LevelMiniMap(const LevelTimeline& timelineToShow) : timeline(timelineToShow)
+    {
+        setInterceptsMouseClicks(false, false);
+    }
+    
+    // Repaints only when there are new levels or the playhead moved to another pixel row
+    void update(juce::uint32 timelineVersion, double newPlayheadSeconds)
+    {
+        bool playheadMoved = getRowFor(newPlayheadSeconds) != getRowFor(playheadSeconds);
+        playheadSeconds = newPlayheadSeconds;
+        
+        if (timelineVersion != shownVersion || playheadMoved)
+        {
+            shownVersion = timelineVersion;
+            repaint();
+        }
+    }
+    
+    void paint(juce::Graphics& g) override
+    {
+        auto bounds = getLocalBounds();
+        g.setColour(juce::Colour::fromFloatRGBA(0.2f, 0.2f, 0.2f, 0.8f));
+        g.fillRoundedRectangle(bounds.toFloat(), 3.0f);
+        
+        auto length = getDisplayedLength();
+        if (timeline.isEmpty() || bounds.getHeight() <= 0)
+            return;
+        
+        int level = LevelTimeline::getLevelFor(length, bounds.getHeight());
+        double binSeconds = LevelTimeline::getBinSeconds(level);
+        int numBins = juce::jmin(LevelTimeline::binsPerLevel, (int) std::ceil(length / binSeconds));
+        float width = (float) bounds.getWidth() - 4.0f;
+        
+        for (int index = 0; index < numBins; ++index)
+        {
+            const auto& bin = timeline.getBin(level, index);
+            if (bin.isEmpty())
+                continue;
+            
+            float top = (float) (index * binSeconds / length * bounds.getHeight());
+            float height = juce::jmax(1.0f, (float) (binSeconds / length * bounds.getHeight()));
+            float laneWidth = width / (float) bin.numChannels;
+            auto colour = getLevelColour(timeline.getShortTermDecibels(level, index));
+            
+            for (int ch = 0; ch < bin.numChannels; ++ch)
+            {
+                float left = 2.0f + (float) ch * laneWidth;
+                float peakWidth = laneWidth * getProportion(juce::Decibels::gainToDecibels(bin.peak[(size_t) ch]));
+                float levelWidth = laneWidth * getProportion(juce::Decibels::powerToDecibels(bin.getMeanSquare(ch)));
+                
+                g.setColour(colour.withAlpha(0.35f));
+                g.fillRect(left, top, peakWidth, height);
+                g.setColour(colour);
+                g.fillRect(left, top, levelWidth, height);
+            }
+        }
+        
+        if (playheadSeconds >= 0.0)
+        {
+            g.setColour(juce::Colours::orange);
+            g.fillRect(0.0f, (float) getRowFor(playheadSeconds), (float) bounds.getWidth(), 1.0f);
+        }
+    }
+    
+private:
+    static constexpr float floorDecibels = -60.0f;
+    
+    const LevelTimeline& timeline;
+    juce::uint32 shownVersion = 0;
+    double playheadSeconds = -1.0;
+    
+    // A little past the end so the playhead has somewhere to go while recording on
+    double getDisplayedLength() const { return juce::jmax(1.0, timeline.getEndTime() * 1.05); }
+    
+    int getRowFor(double timeSeconds) const
+    {
+        return timeSeconds < 0.0 ? -1 : (int) (timeSeconds / getDisplayedLength() * getHeight());
+    }
+    
+    static float getProportion(float decibels)
+    {
+        return juce::jlimit(0.0f, 1.0f, (decibels - floorDecibels) / -floorDecibels);
+    }
+    
+    static juce::Colour getLevelColour(float shortTermDecibels)
+    {
+        if (shortTermDecibels > -9.0f)  return juce::Colours::red;
+        if (shortTermDecibels > -18.0f) return juce::Colours::yellow;
+        return juce::Colours::limegreen;
+    }
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LevelMiniMap)
+};
+
+//==============================================================================
+class NotePadAudioProcessorEditor;
+
+/**
+ * One row of the todo list. The ListBox only keeps as many of these as fit in the
+ * viewport and points them at whichever items are scrolled into view.
+ */
+class TodoRowComponent : public juce::Component
+{
+public:
+    explicit TodoRowComponent(NotePadAudioProcessorEditor& editor);
+    
+    // Shows the todo at the given index of the editor's todoData. Does nothing
+    // (and repaints nothing) if the row would look the same as it already does.
+    void update(int newItemIndex);
+    int getItemIndex() const { return itemIndex; }
+    
+    void resized() override;
+    
+    // Shared by every row so updates never construct a font
+    static const juce::Font& getRowFont();
+    
+private:
+    NotePadAudioProcessorEditor& owner;
+    juce::ToggleButton checkbox;
+    StrikethroughLabel label;
+    int itemIndex = -1;
+    
+    // Everything the row's appearance depends on, as of the last update
+    struct Appearance
+    {
+        bool isValid = false;
+        bool isEditing = false;
+        juce::String text;
+        double anchorTime = -1.0;
+        bool completed = false;
+        juce::Colour colour;
+        juce::String highlight;
+        
+        bool operator== (const Appearance& other) const
+        {
+            return isValid == other.isValid && isEditing == other.isEditing && text == other.text
+                && anchorTime == other.anchorTime && completed == other.completed
+                && colour == other.colour && highlight == other.highlight;
+        }
+    };
+    
+    Appearance shown;
+    bool hasShown = false;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TodoRowComponent)
+};
+
 //==============================================================================
 /**
 */
 class NotePadAudioProcessorEditor  : public juce::AudioProcessorEditor, 
                                     public juce::TextEditor::Listener,
-                                    public juce::Button::Listener
+                                    public juce::Button::Listener,
+                                    public juce::ListBoxModel,
+                                    private juce::Timer,
+                                    private UndoJournal::Target
 {
 public:
     enum class Priority { Low, Medium, High };
@@ -159,11 +409,13 @@ public:
     
     struct TodoItem
     {
+        juce::int64 id = 0; // stable across edits and reordering, matches the node's "Id"
         juce::String text;
-        bool completed;
-        Priority priority;
+        bool completed = false;
+        Priority priority = Priority::Low;
         juce::Time dueDate;
         juce::String tags;
+        double anchorTime = -1.0; // seconds on the host timeline, negative when not anchored
     };
     
     NotePadAudioProcessorEditor (NotePadAudioProcessor&);
@@ -182,41 +434,113 @@ public:
     bool keyPressed(const juce::KeyPress& key) override;
     void addTodoItem(const TodoItem& item);
     void addTodoItem(const juce::String& text, bool checked);
+    void insertTodoItem(int index, const TodoItem& item);
     void mouseDrag(const juce::MouseEvent& e) override;
     void mouseUp(const juce::MouseEvent& e) override;
     void refreshTodoList();
     void updateTodoItemsState();
+    void updateTodoItemState(int index);
     void editTodoItem(int index);
     void deleteTodoItem(int index);
     void moveSelection(int delta);
-    void updateVisualState();
+    void updateVisualState(); // re-reads the visible rows, only rows that changed repaint
     void reorderItems(int fromIndex, int toIndex);
     void filterItems(const juce::String& searchText);
+    void setTodoCompleted(int index, bool completed);
+    
+    // ListBoxModel - rows are recycled TodoRowComponents
+    int getNumRows() override;
+    void paintListBoxItem(int rowNumber, juce::Graphics& g, int width, int height, bool rowIsSelected) override;
+    juce::Component* refreshComponentForRow(int rowNumber, bool isRowSelected, juce::Component* existingComponentToUpdate) override;
+    
+    // Map between list rows and todoData indices, they differ while a filter is active
+    int getItemIndexForRow(int row) const;
+    int getRowForItemIndex(int index) const;
+    int getItemIndexAt(const juce::MouseEvent& e) const;
+    
+    // Cmd/Ctrl+Shift+E and Cmd/Ctrl+Shift+I: the todo list to and from Markdown, JSON or
+    // CSV, by file extension. Both run on a background thread behind a progress window.
     void exportTodoList();
     void importTodoList();
     
     // Public so processor can call it before saving state
     void saveEditorStateToProcessor();
     
-    std::unique_ptr<juce::TextEditor> m1TextEditor;
+    // Publishes pending notes text to the processor's "SessionText" property
+    void flushSessionText();
+    
+    // Asks whether to restore the notes and todos the processor found in its crash journal
+    void offerSessionRecovery();
+    
+    // Shows the processor's notes and todos again after they were replaced
+    void reloadContentFromState();
+    void updateUnreadableContentState();
+    
+    // Undo and redo for the notes and todos, kept here rather than in the host's history
+    UndoJournal undoJournal { *this };
+    
+    std::unique_ptr<NotesEditor> m1TextEditor;
     std::unique_ptr<juce::ToggleButton> todoCheckbox;
     std::unique_ptr<juce::TextEditor> todoInputField;
     std::unique_ptr<juce::ComboBox> priorityCombo;
     std::unique_ptr<juce::TextEditor> searchField;
     std::unique_ptr<FullscreenButton> leftFullscreenButton;
     std::unique_ptr<FullscreenButton> rightFullscreenButton;
-    juce::OwnedArray<juce::ToggleButton> todoItems;
-    juce::OwnedArray<StrikethroughLabel> todoLabels;
-    juce::OwnedArray<juce::TextEditor> todoEditors;
+    std::unique_ptr<juce::ListBox> todoListBox;
+    std::unique_ptr<juce::TextEditor> todoItemEditor; // moved into whichever row is being edited
+    std::unique_ptr<TodoFinderComponent> todoFinder; // created on first Cmd/Ctrl+P
+    std::unique_ptr<SessionOverviewComponent> sessionOverview; // created on first Cmd/Ctrl+Shift+O
+    std::unique_ptr<LevelMiniMap> levelMiniMap; // only shown once there are levels to draw
+    std::unique_ptr<juce::FileChooser> todoFileChooser;
+    std::unique_ptr<juce::ThreadWithProgressWindow> todoTransferTask; // at most one import or export at a time
     juce::Array<TodoItem> todoData;
+    juce::Array<int> filteredIndices; // sorted, only used while currentFilter is set
+    juce::String currentFilter;
+    
+    // Where each todo id was last seen in todoData, checked on every lookup
+    mutable std::unordered_map<juce::int64, int> itemIndexById;
+    int findItemIndex(juce::int64 id) const; // -1 if there's no such item
+    
+    // Single inserts, removals and changes patch filteredIndices instead of searching again
+    bool itemMatchesFilter(int index) const;
+    void filteredItemInserted(int index);
+    void filteredItemRemoved(int index);
+    void filteredItemChanged(int index);
+    void showFilteredRows();
+    
+    // Search indexes over todo text/tags (keyed by todo id) and the notes (by line)
+    SearchIndex todoSearchIndex;
+    NotesSearchIndex notesSearchIndex;
+    juce::Array<juce::Range<int>> notesMatches;
+    int currentNotesMatch = -1;
+    static constexpr int maxNotesMatches = 10000;
     
     int editingIndex = -1;
     int selectedIndex = -1;
     int dragStartIndex = -1;
     bool isDragging = false;
+    int dragInsertionRow = -1; // gap the dragged item would drop into, previewed until mouseUp
     FullscreenMode fullscreenMode = FullscreenMode::None;
     
-
+    // Notes edits are coalesced and published at most this often while typing
+    static constexpr int sessionTextFlushIntervalMs = 250;
+    bool sessionTextDirty = false;
+    
+    // Todos anchored to the timeline, sorted by time so the one that applies at the
+    // playhead is a binary search. Single anchors are patched in and out, bulk changes rebuild it.
+    std::vector<std::pair<double, juce::int64>> markerIndex;
+    juce::int64 activeMarkerId = 0; // anchored todo the playhead is currently in, 0 when none
+    NotePadAudioProcessor::PlayheadState lastPlayhead;
+    bool hasPlayhead = false;
+    
+    void rebuildMarkerIndex();
+    void addMarker(double timeSeconds, juce::int64 id);    // ignores unanchored times
+    void removeMarker(double timeSeconds, juce::int64 id);
+    juce::int64 findMarkerAt(double timeSeconds) const;
+    void setTodoAnchor(int index, double timeSeconds);
+    void captureClip();
+    
+    
 private:
     NotePadAudioProcessor& audioProcessor;
     juce::Image m1logo;
@@ -224,7 +548,47 @@ private:
     void updatePriorityColors();
     juce::Colour getPriorityColour(Priority p) const;
     void toggleFullscreen(FullscreenMode mode);
-
+    int layoutLevelMiniMap(int notepadWidth);
+    juce::Rectangle<int> getDragIndicatorBounds() const;
+    void setDragInsertionRow(int row);
+    void timerCallback() override;
+    void notesTextChanged();
+    void finishEditingTodoItem();
+    void indexTodoItem(int index);
+    void applySearch();
+    void showNextNotesMatch();
+    void showTodoFinder();
+    void hideTodoFinder();
+    void showSessionOverview();
+    void hideSessionOverview();
+    void jumpToTodo(juce::int64 id);
+    
+    // "TodoItems" nodes mirror todoData one to one, in the same order
+    juce::ValueTree getTodoItemsTree();
+    juce::ValueTree getTodoNode(int index);
+    juce::ValueTree createTodoNode(const TodoItem& item) const;
+    TodoItem getTodoItemFromNode(const juce::ValueTree& node) const; // id is 0 when the node has none
+    juce::int64 allocateTodoId();
+    
+    // Imports append in batches as they're parsed, without recording them for undo
+    void startTodoImport(const juce::File& file);
+    void appendImportedItems(const std::vector<juce::ValueTree>& items);
+    void removeTodoItemsFrom(int index);
+    
+    // Drains the processor's playhead stream once per display frame
+    void updatePlayhead();
+    void updateLevelMiniMap();
+    juce::VBlankAttachment playheadAttachment { this, [this] { updatePlayhead(); updateLevelMiniMap(); } };
+    
+    // UndoJournal::Target
+    void applyNotesEdit(int position, int lengthToRemove, const juce::String& textToInsert) override;
+    void applyTodoInsert(int index, const juce::ValueTree& item) override;
+    void applyTodoRemove(int index) override;
+    void applyTodoMove(int fromIndex, int toIndex) override;
+    void applyTodoChange(const juce::ValueTree& item) override;
+    
+    friend class TodoRowComponent;
+    
 private:
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (NotePadAudioProcessorEditor)
 };
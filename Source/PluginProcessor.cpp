@@ -8,6 +8,7 @@
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "StateChunk.h"
 
 //==============================================================================
 NotePadAudioProcessor::NotePadAudioProcessor()
@@ -20,9 +21,16 @@ NotePadAudioProcessor::NotePadAudioProcessor()
                        .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
                      #endif
                        ),
-treeState (*this, nullptr /* undomanager */, "TreeState", {std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("gain", 1), "Gain", -48.0f, 0.0f, -15.0f) })
+treeState (*this, nullptr /* undomanager */, "TreeState", {std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("gain", 1), "Gain", -48.0f, 0.0f, -15.0f),
+                                                            // Off by default so existing sessions (saved with "gain" at -15 dB) keep passing audio at unity
+                                                            std::make_unique<juce::AudioParameterBool>(juce::ParameterID("gainEnabled", 2), "Gain Enabled", false),
+                                                            std::make_unique<juce::AudioParameterChoice>(juce::ParameterID("midiCues", 2), "MIDI Cues", juce::StringArray { "Off", "Markers", "Controllers" }, 0) })
 #endif
 {
+    gainParameter = treeState.getRawParameterValue("gain");
+    gainEnabledParameter = treeState.getRawParameterValue("gainEnabled");
+    midiCueModeParameter = treeState.getRawParameterValue("midiCues");
+    
     // Initialize default properties only if they don't exist
     // (They will be loaded from saved state if available via setStateInformation)
     if (!treeState.state.hasProperty("SessionText"))
@@ -34,10 +42,31 @@ treeState (*this, nullptr /* undomanager */, "TreeState", {std::make_unique<juce
     // Initialize todo mode property (only if it doesn't exist)
     if (!treeState.state.hasProperty("TodoMode"))
         treeState.state.setProperty("TodoMode", false, nullptr);
+    
+    // Every instance journals under its own id, kept in the state so a restored
+    // instance finds what it journaled before a crash
+    treeState.state.setProperty("InstanceId", sessionJournal.setInstance(juce::Uuid().toString(), 0, false), nullptr);
+    
+    sessionRegistrySerial = sessionRegistry->addInstance();
+    
+    startTimerHz (levelTimelineUpdateHz);
+    
+    // Republish the save snapshot whenever anything in the tree changes
+    treeState.state.addListener(this);
+    publishStateSnapshot();
 }
 
 NotePadAudioProcessor::~NotePadAudioProcessor()
 {
+    stopTimer();
+    treeState.state.removeListener(this);
+    cancelPendingUpdate();
+    sessionRegistry->removeInstance(sessionRegistrySerial);
+    
+    // Audio has stopped by now, so the audio thread's schedule can go too
+    collectRetiredCueSchedules();
+    delete pendingCueSchedule.exchange(nullptr);
+    delete activeCueSchedule;
 }
 
 //==============================================================================
@@ -46,6 +75,12 @@ const juce::String NotePadAudioProcessor::getName() const
     return JucePlugin_Name;
 }
 
+void NotePadAudioProcessor::updateTrackProperties(const TrackProperties& properties)
+{
+    // Hosts may call this from any thread, the registry only queues the name
+    sessionRegistry->setInstanceName(sessionRegistrySerial, properties.name);
+}
+
 bool NotePadAudioProcessor::acceptsMidi() const
 {
    #if JucePlugin_WantsMidiInput
@@ -105,12 +140,259 @@ void NotePadAudioProcessor::changeProgramName (int index, const juce::String& ne
 //==============================================================================
 void NotePadAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
+    // Layout changes always go through prepareToPlay, so these stay valid for every block
+    numInputChannels  = getTotalNumInputChannels();
+    numOutputChannels = getTotalNumOutputChannels();
+    
+    // Gain ramps are computed into these, hosts sending bigger blocks get them in slices.
+    // Both precisions get one, some hosts switch precision without preparing again
+    gainRampSize = juce::jmax (1, samplesPerBlock);
+    floatGainRamp.allocate ((size_t) gainRampSize, false);
+    doubleGainRamp.allocate ((size_t) gainRampSize, false);
+    
+    smoothedGain.reset (sampleRate, gainSmoothingSeconds);
+    smoothedGain.setCurrentAndTargetValue (getTargetGain());
+    
+    cueCursorValid = false;
+    
+    // The callback is stopped here, but the ring is still only handed over, never swapped in place
+    updateCaptureRing (sampleRate);
+}
+
+float NotePadAudioProcessor::getTargetGain() const
+{
+    if (gainEnabledParameter->load() < 0.5f)
+        return 1.0f;
+    
+    return juce::Decibels::decibelsToGain (gainParameter->load(), -100.0f);
 }
 
+template <>
+float* NotePadAudioProcessor::getGainRamp<float>() { return floatGainRamp.get(); }
+
+template <>
+double* NotePadAudioProcessor::getGainRamp<double>() { return doubleGainRamp.get(); }
+
 void NotePadAudioProcessor::releaseResources()
 {
 }
 
+//==============================================================================
+void NotePadAudioProcessor::setClipCaptureEnabled (bool shouldBeEnabled)
+{
+    treeState.state.setProperty ("ClipCaptureEnabled", shouldBeEnabled, nullptr);
+    
+    if (clipCaptureEnabled.exchange (shouldBeEnabled) == shouldBeEnabled)
+        return;
+    
+    // Allocated here while the audio keeps running, it only picks up the finished ring
+    updateCaptureRing (getSampleRate());
+}
+
+void NotePadAudioProcessor::updateCaptureRing (double sampleRate)
+{
+    const juce::ScopedLock sl (captureBufferLock);
+    
+    auto enabled = clipCaptureEnabled.load() && sampleRate > 0.0;
+    auto numChannels = enabled ? juce::jlimit (1, maxCaptureChannels, getTotalNumInputChannels()) : 0;
+    auto numSamples = enabled ? (int) std::ceil ((maxClipSeconds + captureMarginSeconds) * sampleRate) : 0;
+    
+    // Same shape and rate, the ring in use carries on
+    if (currentCaptureRing != nullptr && currentCaptureRing->sampleRate == sampleRate
+        && currentCaptureRing->buffer.getNumChannels() == numChannels
+        && currentCaptureRing->buffer.getNumSamples() == numSamples)
+        return;
+    
+    CaptureRing::Ptr ring = new CaptureRing (numChannels, numSamples, sampleRate);
+    ownedCaptureRings.add (ring);
+    currentCaptureRing = ring;
+    
+    // A ring the audio thread never picked up was never used, it can go straight away
+    if (auto* skipped = pendingCaptureRing.exchange (ring.get()))
+        ownedCaptureRings.removeObject (skipped);
+}
+
+void NotePadAudioProcessor::collectRetiredCaptureRings()
+{
+    auto numReady = retiredCaptureFifo.getNumReady();
+    if (numReady == 0)
+        return;
+    
+    const juce::ScopedLock sl (captureBufferLock);
+    const auto scope = retiredCaptureFifo.read (numReady);
+    scope.forEach ([this] (int index)
+    {
+        // A clip still being copied from it holds its own reference
+        ownedCaptureRings.removeObject (retiredCaptureRings[(size_t) index]);
+        retiredCaptureRings[(size_t) index] = nullptr;
+    });
+}
+
+template <typename SampleType>
+void NotePadAudioProcessor::writeCapture (const juce::AudioBuffer<SampleType>& buffer)
+{
+    // Take over a newly published ring, the old one goes back to the message thread.
+    // If that queue is full the swap waits a block rather than freeing memory here.
+    if (retiredCaptureFifo.getFreeSpace() > 0)
+    {
+        if (auto* next = pendingCaptureRing.exchange (nullptr))
+        {
+            if (activeCaptureRing != nullptr)
+            {
+                const auto scope = retiredCaptureFifo.write (1);
+                retiredCaptureRings[(size_t) scope.startIndex1] = activeCaptureRing;
+            }
+            
+            activeCaptureRing = next;
+        }
+    }
+    
+    if (activeCaptureRing == nullptr || !clipCaptureEnabled.load (std::memory_order_relaxed))
+        return;
+    
+    auto& captureRing = activeCaptureRing->buffer;
+    auto& captureWritePosition = activeCaptureRing->writePosition;
+    auto ringLength = captureRing.getNumSamples();
+    if (ringLength == 0)
+        return;
+    
+    // A block longer than the whole ring only needs its last ringLength samples
+    auto numSamples = juce::jmin (buffer.getNumSamples(), ringLength);
+    auto sourceOffset = buffer.getNumSamples() - numSamples;
+    auto numChannels = juce::jmin (captureRing.getNumChannels(), buffer.getNumChannels());
+    
+    auto position = captureWritePosition.load (std::memory_order_relaxed);
+    auto start = (int) (position % ringLength);
+    auto firstPart = juce::jmin (numSamples, ringLength - start);
+    
+    auto copy = [] (float* dest, const SampleType* source, int num)
+    {
+        if constexpr (std::is_same<SampleType, float>::value)
+            juce::FloatVectorOperations::copy (dest, source, num);
+        else
+            juce::FloatVectorOperations::convert (dest, source, num);
+    };
+    
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        copy (captureRing.getWritePointer (ch, start), buffer.getReadPointer (ch, sourceOffset), firstPart);
+        if (numSamples > firstPart)
+            copy (captureRing.getWritePointer (ch), buffer.getReadPointer (ch, sourceOffset + firstPart), numSamples - firstPart);
+    }
+    
+    // Publishing the new position is the only synchronisation with the reader
+    captureWritePosition.store (position + numSamples, std::memory_order_release);
+}
+
+void NotePadAudioProcessor::captureClip (double seconds, std::function<void(const juce::File&)> onCaptured)
+{
+    CaptureRing::Ptr ring;
+    {
+        const juce::ScopedLock sl (captureBufferLock);
+        ring = currentCaptureRing;
+    }
+    
+    if (ring == nullptr)
+    {
+        juce::MessageManager::callAsync ([onCaptured] { if (onCaptured != nullptr) onCaptured ({}); });
+        return;
+    }
+    
+    clipEncoderPool->addJob ([ring, seconds, onCaptured]
+    {
+        auto file = writeClip (*ring, seconds);
+        juce::MessageManager::callAsync ([onCaptured, file]
+        {
+            if (onCaptured != nullptr)
+                onCaptured (file);
+        });
+    });
+}
+
+juce::File NotePadAudioProcessor::getClipsDirectory()
+{
+    return juce::File::getSpecialLocation (juce::File::userApplicationDataDirectory)
+               .getChildFile ("Mach1").getChildFile ("M1-Notepad").getChildFile ("Clips");
+}
+
+juce::File NotePadAudioProcessor::writeClip (const CaptureRing& ring, double seconds)
+{
+    juce::AudioBuffer<float> clip;
+    auto sampleRate = ring.sampleRate;
+    
+    {
+        // The ring is kept alive by the caller's reference, even if it was replaced meanwhile
+        const auto& captureRing = ring.buffer;
+        const auto& captureWritePosition = ring.writePosition;
+        
+        auto ringLength = (juce::int64) captureRing.getNumSamples();
+        if (ringLength == 0 || sampleRate <= 0.0)
+            return {};
+        
+        auto end = captureWritePosition.load (std::memory_order_acquire);
+        auto marginSamples = (juce::int64) (captureMarginSeconds * sampleRate);
+        auto wanted = juce::jmin ((juce::int64) (seconds * sampleRate), end, ringLength - marginSamples);
+        if (wanted <= 0)
+            return {};
+        
+        clip.setSize (captureRing.getNumChannels(), (int) wanted);
+        auto start = (int) ((end - wanted) % ringLength);
+        auto firstPart = (int) juce::jmin (wanted, ringLength - start);
+        
+        for (int ch = 0; ch < clip.getNumChannels(); ++ch)
+        {
+            clip.copyFrom (ch, 0, captureRing, ch, start, firstPart);
+            if (wanted > firstPart)
+                clip.copyFrom (ch, firstPart, captureRing, ch, 0, (int) wanted - firstPart);
+        }
+        
+        // The audio thread kept writing while we copied. If it got further than the margin
+        // it has overwritten the oldest part of what we took, so that part is dropped.
+        auto written = captureWritePosition.load (std::memory_order_acquire) - end;
+        auto overwritten = (int) juce::jmax ((juce::int64) 0, written - (ringLength - wanted));
+        if (overwritten >= clip.getNumSamples())
+            return {};
+        
+        if (overwritten > 0)
+        {
+            juce::AudioBuffer<float> trimmed (clip.getNumChannels(), clip.getNumSamples() - overwritten);
+            for (int ch = 0; ch < clip.getNumChannels(); ++ch)
+                trimmed.copyFrom (ch, 0, clip, ch, overwritten, trimmed.getNumSamples());
+            clip = std::move (trimmed);
+        }
+    }
+    
+    auto directory = getClipsDirectory();
+    if (!directory.createDirectory())
+        return {};
+    
+    auto file = directory.getNonexistentChildFile ("Clip " + juce::Time::getCurrentTime().formatted ("%Y-%m-%d %H-%M-%S"), ".flac", false);
+    
+    std::unique_ptr<juce::OutputStream> stream (new juce::FileOutputStream (file));
+    if (static_cast<juce::FileOutputStream*> (stream.get())->failedToOpen())
+        return {};
+    
+    juce::FlacAudioFormat flac;
+    std::unique_ptr<juce::AudioFormatWriter> writer (flac.createWriterFor (stream.get(), sampleRate, (unsigned int) clip.getNumChannels(), 24, {}, 0));
+    if (writer == nullptr)
+    {
+        stream = nullptr;
+        file.deleteFile();
+        return {};
+    }
+    
+    stream.release(); // the writer owns it now
+    
+    if (!writer->writeFromAudioSampleBuffer (clip, 0, clip.getNumSamples()))
+    {
+        writer = nullptr;
+        file.deleteFile();
+        return {};
+    }
+    
+    return file;
+}
+
 #ifndef JucePlugin_PreferredChannelConfigurations
 bool NotePadAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
 {
@@ -122,46 +404,308 @@ bool NotePadAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts)
     if (layouts.getMainInputChannelSet()  == juce::AudioChannelSet::disabled()
      || layouts.getMainOutputChannelSet() == juce::AudioChannelSet::disabled())
         return false;
- 
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-        && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo()
-        && layouts.getMainOutputChannelSet().size() != juce::AudioChannelSet::createLCR().size()
-        && layouts.getMainOutputChannelSet().size() != juce::AudioChannelSet::quadraphonic().size()
-        && layouts.getMainOutputChannelSet().size() != juce::AudioChannelSet::create5point0().size()
-        && layouts.getMainOutputChannelSet().size() != juce::AudioChannelSet::create5point1().size()
-        && layouts.getMainOutputChannelSet().size() != juce::AudioChannelSet::create7point0().size()
-        && layouts.getMainOutputChannelSet().size() != juce::AudioChannelSet::create7point1().size())
+    
+    // Audio passes through in place, so the input and output always match
+    if (layouts.getMainInputChannelSet() != layouts.getMainOutputChannelSet())
         return false;
-
-    return layouts.getMainInputChannelSet() == layouts.getMainOutputChannelSet();
+    
+    const auto& set = layouts.getMainOutputChannelSet();
+    
+    // Ambisonics of any order JUCE knows about (1st to 7th, 4 to 64 channels)
+    if (set.getAmbisonicOrder() >= 1)
+        return true;
+    
+    // Mono to 7.1, Mach1 Spatial (8, 12, 14 and 16) and discrete wide buses (36 and 64),
+    // in whichever named or discrete set the host offers at that width
+    switch (set.size())
+    {
+        case 1: case 2: case 3: case 4: case 5: case 6: case 7: case 8:
+        case 12: case 14: case 16: case 36: case 64:
+            return true;
+        default:
+            return false;
+    }
   #endif
 }
 #endif
 
 void NotePadAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
-    juce::ScopedNoDenormals noDenormals;
-    auto totalNumInputChannels  = getTotalNumInputChannels();
-    auto totalNumOutputChannels = getTotalNumOutputChannels();
+    processSamples (buffer, midiMessages);
+}
 
-    bool audioPassThrough = isAudioPassThrough();
+void NotePadAudioProcessor::processBlock (juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
+{
+    processSamples (buffer, midiMessages);
+}
 
-    if (!audioPassThrough)
+template <typename SampleType>
+void NotePadAudioProcessor::processSamples (juce::AudioBuffer<SampleType>& buffer, juce::MidiBuffer& midiMessages)
+{
+    // Runs on every track, so nothing here may allocate, lock or block.
+    // Benchmarks/RealtimeSafety.cpp checks this for every supported layout.
+    juce::ScopedNoDenormals noDenormals;
+    
+    PlayheadState position;
+    auto hasPosition = getHostPosition (position);
+    if (hasPosition)
+        publishPlayhead (position);
+    
+    emitCues (midiMessages, hasPosition ? &position : nullptr, buffer.getNumSamples());
+    
+    // isAudioPassThrough() is a compile-time constant, so this branch folds away
+    if (!isAudioPassThrough())
     {
         // Mute: clear all output channels
         buffer.clear();
+        return;
+    }
+    
+    // The audio already passes through in place (input is already in output channels),
+    // so the cost doesn't grow with the channel count. isBusesLayoutSupported only
+    // accepts matching layouts, so there are normally no extra outputs to clear here.
+    auto numChannels = juce::jmin (numOutputChannels, buffer.getNumChannels());
+    auto numSamples = buffer.getNumSamples();
+    for (auto i = numInputChannels; i < numChannels; ++i)
+        buffer.clear (i, 0, numSamples);
+    
+    // Reference clips are of the input, before the trim stage
+    writeCapture (buffer);
+    
+    applyGain (buffer, numChannels);
+    
+    // Levels are of what leaves the plugin, and only mean something against the timeline
+    if (hasPosition && position.isPlaying)
+        measureLevels (buffer, numChannels, position);
+}
+
+template <typename SampleType>
+void NotePadAudioProcessor::applyGain (juce::AudioBuffer<SampleType>& buffer, int numChannels)
+{
+    auto numSamples = buffer.getNumSamples();
+    
+    // Optional trim stage. At unity (or disabled) and not ramping, this is the only cost
+    smoothedGain.setTargetValue (getTargetGain());
+    
+    if (!smoothedGain.isSmoothing())
+    {
+        auto gain = (SampleType) smoothedGain.getCurrentValue();
+        if (gain != SampleType (1))
+            for (int ch = 0; ch < numChannels; ++ch)
+                juce::FloatVectorOperations::multiply (buffer.getWritePointer (ch), gain, numSamples);
+        return;
+    }
+    
+    // Ramping: the per-sample gain is computed once and applied to every channel
+    auto* ramp = getGainRamp<SampleType>();
+    jassert (ramp != nullptr); // prepareToPlay allocates a ramp for both precisions
+    
+    for (int offset = 0; offset < numSamples; offset += gainRampSize)
+    {
+        auto length = juce::jmin (gainRampSize, numSamples - offset);
+        for (int i = 0; i < length; ++i)
+            ramp[i] = (SampleType) smoothedGain.getNextValue();
+        
+        for (int ch = 0; ch < numChannels; ++ch)
+            juce::FloatVectorOperations::multiply (buffer.getWritePointer (ch, offset), ramp, length);
+    }
+}
+
+namespace
+{
+    // Four independent sums so the compiler can keep them in vector lanes
+    template <typename SampleType>
+    double getSumOfSquares (const SampleType* samples, int numSamples)
+    {
+        SampleType sums[4] = {};
+        int i = 0;
+        
+        for (; i + 4 <= numSamples; i += 4)
+            for (int lane = 0; lane < 4; ++lane)
+                sums[lane] += samples[i + lane] * samples[i + lane];
+        
+        for (; i < numSamples; ++i)
+            sums[0] += samples[i] * samples[i];
+        
+        return (double) sums[0] + (double) sums[1] + (double) sums[2] + (double) sums[3];
+    }
+}
+
+template <typename SampleType>
+void NotePadAudioProcessor::measureLevels (const juce::AudioBuffer<SampleType>& buffer, int numChannels, const PlayheadState& position)
+{
+    auto numSamples = buffer.getNumSamples();
+    if (numSamples <= 0 || numChannels <= 0)
+        return;
+    
+    // Channels past the main pair fold onto it by parity, see LevelTimeline
+    constexpr auto maxChannels = LevelTimeline::maxChannels;
+    std::array<SampleType, maxChannels> peaks {};
+    std::array<double, maxChannels> sumsOfSquares {};
+    std::array<int, maxChannels> numFolded {};
+    
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        auto slot = (size_t) (ch % maxChannels);
+        auto* samples = buffer.getReadPointer (ch);
+        auto range = juce::FloatVectorOperations::findMinAndMax (samples, numSamples);
+        peaks[slot] = juce::jmax (peaks[slot], -range.getStart(), range.getEnd());
+        sumsOfSquares[slot] += getSumOfSquares (samples, numSamples);
+        ++numFolded[slot];
+    }
+    
+    // Dropped if the message thread has fallen behind, the summary just has a gap
+    const auto scope = levelFifo.write (1);
+    if (scope.blockSize1 <= 0)
+        return;
+    
+    auto& block = levelBlocks[(size_t) scope.startIndex1];
+    block.timeSeconds = position.timeSeconds;
+    block.numSamples = numSamples;
+    block.numChannels = juce::jmin (numChannels, maxChannels);
+    
+    for (size_t slot = 0; slot < (size_t) block.numChannels; ++slot)
+    {
+        block.peaks[slot] = (float) peaks[slot];
+        block.meanSquares[slot] = (float) (sumsOfSquares[slot] / ((double) numSamples * numFolded[slot]));
+    }
+}
+
+void NotePadAudioProcessor::timerCallback()
+{
+    if (! recoveryOffered && currentEditor != nullptr && sessionJournal.isRecoveryAvailable())
+        offerRecoveredSession();
+    
+    if (captureRingDirty.exchange (false))
+        updateCaptureRing (getSampleRate());
+    
+    collectRetiredCaptureRings();
+    
+    auto numReady = levelFifo.getNumReady();
+    if (numReady == 0)
+        return;
+    
+    const auto scope = levelFifo.read (numReady);
+    scope.forEach ([this] (int index)
+    {
+        const auto& block = levelBlocks[(size_t) index];
+        levelTimeline.addBlock (block.timeSeconds, block.numSamples, block.numChannels, block.peaks, block.meanSquares);
+    });
+    
+    ++levelTimelineVersion;
+}
+
+bool NotePadAudioProcessor::getHostPosition (PlayheadState& state) const
+{
+    auto* playHead = getPlayHead();
+    if (playHead == nullptr)
+        return false;
+    
+    auto position = playHead->getPosition();
+    if (!position.hasValue())
+        return false;
+    
+    if (auto seconds = position->getTimeInSeconds())
+        state.timeSeconds = *seconds;
+    else if (auto samples = position->getTimeInSamples(); samples.hasValue() && getSampleRate() > 0.0)
+        state.timeSeconds = (double) *samples / getSampleRate();
+    else
+        return false;
+    
+    if (auto ppq = position->getPpqPosition())
+    {
+        state.ppqPosition = *ppq;
+        state.hasPpqPosition = true;
+    }
+    
+    if (auto bar = position->getBarCount())
+    {
+        state.bar = *bar;
+        state.hasBar = true;
+    }
+    
+    state.isPlaying = position->getIsPlaying();
+    return true;
+}
+
+void NotePadAudioProcessor::publishPlayhead (const PlayheadState& state)
+{
+    const auto scope = playheadFifo.write (1);
+    if (scope.blockSize1 > 0)
+        playheadStates[(size_t) scope.startIndex1] = state;
+}
+
+void NotePadAudioProcessor::emitCues (juce::MidiBuffer& midiMessages, const PlayheadState* position, int numSamples)
+{
+    // Take over a newly published schedule, the old one goes back to the message thread.
+    // If that queue is full the swap waits a block rather than freeing memory here.
+    if (retiredCueFifo.getFreeSpace() > 0)
+    {
+        if (auto* next = pendingCueSchedule.exchange (nullptr))
+        {
+            if (activeCueSchedule != nullptr)
+            {
+                const auto scope = retiredCueFifo.write (1);
+                retiredCueSchedules[(size_t) scope.startIndex1] = activeCueSchedule;
+            }
+            
+            activeCueSchedule = next;
+            cueCursorValid = false;
+        }
     }
-    // If audioPassThrough is true, the audio already passes through (input is already in output channels)
     
-    // In case we have more outputs than inputs, clear any output
-    // channels that didn't contain input data (only needed when pass-through is enabled)
-    if (audioPassThrough)
+    auto mode = juce::roundToInt (midiCueModeParameter->load());
+    auto sampleRate = getSampleRate();
+    
+    if (mode == midiCuesOff || activeCueSchedule == nullptr || position == nullptr || !position->isPlaying
+        || numSamples <= 0 || sampleRate <= 0.0)
     {
-        for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
+        cueCursorValid = false;
+        return;
+    }
+    
+    const auto& times = activeCueSchedule->times;
+    auto blockStart = position->timeSeconds;
+    auto blockEnd = blockStart + numSamples / sampleRate;
+    
+    // Continuous playback carries on from the cursor, anything else (starting, seeking,
+    // looping) finds its place again with a binary search
+    if (!cueCursorValid || std::abs (blockStart - nextCueBlockStart) > cueSeekToleranceSeconds)
+        cueCursor = (size_t) (std::lower_bound (times.begin(), times.end(), blockStart) - times.begin());
+    
+    // MidiBuffer only allocates if it runs out of space, hosts size theirs well above this
+    for (int emitted = 0; cueCursor < times.size() && times[cueCursor] < blockEnd && emitted < maxCuesPerBlock; ++emitted)
+    {
+        auto sampleOffset = juce::jlimit (0, numSamples - 1, (int) ((times[cueCursor] - blockStart) * sampleRate));
+        const auto& cue = activeCueSchedule->cues[cueCursor];
+        
+        if (mode == midiCuesMarkers)
+        {
+            midiMessages.addEvent (activeCueSchedule->markerBytes.data() + cue.markerOffset, cue.markerSize, sampleOffset);
+        }
+        else
         {
-            buffer.clear (i, 0, buffer.getNumSamples());
+            const juce::uint8 controller[] = { (juce::uint8) (0xb0 | (cueMidiChannel - 1)), cueController, cue.controllerValue };
+            midiMessages.addEvent (controller, (int) sizeof (controller), sampleOffset);
         }
+        
+        ++cueCursor;
     }
+    
+    cueCursorValid = true;
+    nextCueBlockStart = blockEnd;
+}
+
+bool NotePadAudioProcessor::readLatestPlayhead(PlayheadState& latest)
+{
+    auto numReady = playheadFifo.getNumReady();
+    if (numReady == 0)
+        return false;
+    
+    const auto scope = playheadFifo.read(numReady);
+    latest = scope.blockSize2 > 0 ? playheadStates[(size_t) (scope.startIndex2 + scope.blockSize2 - 1)]
+                                  : playheadStates[(size_t) (scope.startIndex1 + scope.blockSize1 - 1)];
+    return true;
 }
 
 //==============================================================================
@@ -172,8 +716,13 @@ bool NotePadAudioProcessor::hasEditor() const
 
 juce::AudioProcessorEditor* NotePadAudioProcessor::createEditor()
 {
+    // The editor reads the notes and todos straight away
+    ensureContentHydrated();
+    
     NotePadAudioProcessorEditor* editor = new NotePadAudioProcessorEditor (*this);
     currentEditor = editor;
+    editorReloadPending = false; // the new editor reads the current content anyway
+    recoveryOffered = false; // a recovery left unanswered in a closed editor is asked again
     return editor;
 }
 
@@ -184,43 +733,484 @@ void NotePadAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
     // You could do that either as raw data, or use the XML or ValueTree classes
     // as intermediaries to make it easy to save and load complex data.
     
-    // If editor exists, save its current state before saving
-    // This ensures we capture the latest changes even if the editor hasn't been destroyed yet
-    if (currentEditor != nullptr)
+    // Some hosts save from a background thread, so only the published snapshot is read here.
+    // When we are on the message thread it is safe to fold in notes edits the editor is still
+    // coalescing and refresh the snapshot first
+    if (juce::MessageManager::existsAndIsCurrentThread())
     {
-        currentEditor->saveEditorStateToProcessor();
+        if (currentEditor != nullptr)
+            currentEditor->saveEditorStateToProcessor();
+        
+        if (isUpdatePending())
+            publishStateSnapshot();
     }
     
-    // Save the entire tree state to include todo items and session text
-    auto state = treeState.copyState();
-    std::unique_ptr<juce::XmlElement> xml(state.createXml());
-    copyXmlToBinary(*xml, destData);
+    auto snapshot = getStateSnapshot();
+    
+    const juce::ScopedLock sl(stateCacheLock);
+    
+    // Nothing changed since the last save, hand back the same chunk
+    if (hasCachedStateChunk && cachedStateGeneration == snapshot->generation
+        && cachedHeadGeneration == snapshot->headGeneration)
+    {
+        ++stateCacheHits;
+        destData = cachedStateChunk;
+        return;
+    }
+    
+    // Content that was never hydrated goes back out exactly as it was loaded. Otherwise the
+    // notes and todos are only encoded again when they changed, not for a new head
+    const juce::MemoryBlock* content = nullptr;
+    if (snapshot->storedContent != nullptr)
+    {
+        ++stateCacheHits;
+        content = &snapshot->storedContent->data;
+    }
+    else
+    {
+        if (hasCachedContentSection && cachedContentGeneration == snapshot->generation)
+        {
+            ++stateCacheHits;
+        }
+        else
+        {
+            ++stateCacheMisses;
+            StateChunk::writeContent(snapshot->state, cachedContentSection);
+            cachedContentGeneration = snapshot->generation;
+            hasCachedContentSection = true;
+        }
+        
+        content = &cachedContentSection;
+    }
+    
+    StateChunk::write(snapshot->state, *content, cachedStateChunk);
+    cachedStateGeneration = snapshot->generation;
+    cachedHeadGeneration = snapshot->headGeneration;
+    hasCachedStateChunk = true;
+    destData = cachedStateChunk;
 }
 
 void NotePadAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
     // You should use this method to restore your parameters from this memory block,
     // whose contents will have been created by the getStateInformation() call.
-
+    
     // Load the entire tree state
-    std::unique_ptr<juce::XmlElement> xmlState(getXmlFromBinary(data, sizeInBytes));
+    juce::ValueTree newState;
+    StoredContent::Ptr newStoredContent;
     
-    if (xmlState.get() != nullptr)
+    if (StateChunk::getVersion(data, sizeInBytes) >= 2)
+    {
+        // Only the small head (parameters, flags) is parsed during project load,
+        // the notes and todos are decoded by ensureContentHydrated()
+        newStoredContent = new StoredContent();
+        newState = StateChunk::readHead(data, sizeInBytes, newStoredContent->data);
+    }
+    else if (StateChunk::isStateChunk(data, sizeInBytes))
+    {
+        newState = StateChunk::read(data, sizeInBytes);
+    }
+    else
+    {
+        // Projects saved before the binary format store the state as XML
+        std::unique_ptr<juce::XmlElement> xmlState(getXmlFromBinary(data, sizeInBytes));
+        
+        // Don't check tag name as it might vary
+        if (xmlState.get() != nullptr)
+            newState = juce::ValueTree::fromXml(*xmlState);
+    }
+    
+    if (newState.isValid())
     {
-        // Try to restore the state from XML - don't check tag name as it might vary
-        juce::ValueTree newState = juce::ValueTree::fromXml(*xmlState);
-        if (newState.isValid())
         {
-            treeState.replaceState(newState);
-            
-            // Ensure required properties and child nodes exist after loading
-            if (!treeState.state.hasProperty("SessionText"))
-                treeState.state.setProperty("SessionText", "", nullptr);
-            treeState.state.getOrCreateChildWithName("TodoItems", nullptr);
-            if (!treeState.state.hasProperty("TodoMode"))
-                treeState.state.setProperty("TodoMode", false, nullptr);
+            const juce::ScopedLock sl(hydrationLock);
+            storedContent = newStoredContent;
+        }
+        contentUnreadable = false;
+        
+        // Generations carry on from the restored state, so the journal can tell which of
+        // its records came after it was saved
+        auto restoredRevision = static_cast<juce::uint64>(static_cast<juce::int64>(newState.getProperty("Revision", 0)));
+        newState.removeProperty("Revision", nullptr);
+        if (contentGeneration.load() < restoredRevision)
+            contentGeneration = restoredRevision;
+        
+        treeState.replaceState(newState);
+        
+        // Ensure required properties and child nodes exist after loading
+        if (!treeState.state.hasProperty("SessionText"))
+            treeState.state.setProperty("SessionText", "", nullptr);
+        treeState.state.getOrCreateChildWithName("TodoItems", nullptr);
+        if (!treeState.state.hasProperty("TodoMode"))
+            treeState.state.setProperty("TodoMode", false, nullptr);
+        
+        // Only the flag changes here, the timer builds the ring so loading a project or
+        // preset never allocates a ring on the host's loading thread
+        clipCaptureEnabled = static_cast<bool>(treeState.state.getProperty("ClipCaptureEnabled", false));
+        captureRingDirty = true;
+        
+        // Only the first restore is the project being opened, later ones (presets, host
+        // undo) replace content this instance journaled itself
+        auto instanceId = sessionJournal.setInstance(treeState.state.getProperty("InstanceId").toString(), restoredRevision, !hasRestoredState);
+        treeState.state.setProperty("InstanceId", instanceId, nullptr);
+        hasRestoredState = true;
+        recoveryOffered = false;
+        
+        // An open editor is showing the content, so it can't stay in stored form. Its todo
+        // list, pending notes text and undo history still refer to what was replaced
+        if (currentEditor != nullptr)
+        {
+            ensureContentHydrated();
+            editorReloadPending = true;
         }
+        
+        // Publish straight away so a save that follows immediately sees the loaded state
+        publishStateSnapshot();
+        
+        // Hosts may restore from another thread, the editor then reloads from handleAsyncUpdate
+        if (editorReloadPending)
+        {
+            if (juce::MessageManager::existsAndIsCurrentThread())
+                reloadEditorContent();
+            else
+                triggerAsyncUpdate();
+        }
+    }
+}
+
+void NotePadAudioProcessor::reloadEditorContent()
+{
+    if (editorReloadPending.exchange(false) && currentEditor != nullptr)
+        currentEditor->reloadContentFromState();
+}
+
+void NotePadAudioProcessor::ensureContentHydrated()
+{
+    // Already failed for this state, decoding it again won't help
+    if (contentUnreadable)
+        return;
+    
+    StoredContent::Ptr content;
+    
+    {
+        const juce::ScopedLock sl(hydrationLock);
+        std::swap(content, storedContent);
     }
+    
+    if (content == nullptr)
+        return;
+    
+    if (!StateChunk::readContent(content->data, treeState.state))
+    {
+        // Put the bytes back: saves keep writing them as they were, and since the content
+        // still counts as stored the journal never takes the empty tree as its base
+        {
+            const juce::ScopedLock sl(hydrationLock);
+            storedContent = content;
+        }
+        
+        if (!contentUnreadable)
+            juce::Logger::writeToLog("M1-Notepad: the saved notes and todos could not be read, they are kept unchanged in the project");
+        
+        contentUnreadable = true;
+        return;
+    }
+    
+    treeState.state.getOrCreateChildWithName("TodoItems", nullptr);
+    
+    publishStateSnapshot();
+}
+
+//==============================================================================
+NotePadAudioProcessor::StateSnapshot::Ptr NotePadAudioProcessor::getStateSnapshot() const
+{
+    const juce::SpinLock::ScopedLockType lock(stateSnapshotLock);
+    return stateSnapshot;
+}
+
+void NotePadAudioProcessor::publishStateSnapshot()
+{
+    cancelPendingUpdate();
+    
+    // Build the copy outside the lock, the lock only guards the pointer swap.
+    // The generation is read first, so a change that lands during the copy bumps it
+    // again and gets its own snapshot
+    auto generation = contentGeneration.load();
+    auto headGen = headGeneration.load();
+    
+    StoredContent::Ptr content;
+    {
+        const juce::ScopedLock sl(hydrationLock);
+        content = storedContent;
+    }
+    
+    auto state = treeState.copyState();
+    state.setProperty("Revision", static_cast<juce::int64>(generation), nullptr);
+    
+    // The journal and the registry only keep the notes and todos, a snapshot taken for a
+    // parameter change alone has nothing new for them
+    auto previous = getStateSnapshot();
+    if (previous == nullptr || previous->generation != generation || previous->storedContent != content)
+    {
+        // Content still in stored form is exactly what was restored, there is nothing to journal
+        if (content == nullptr)
+            sessionJournal.submit(state, generation);
+        
+        // Stored content is shared with the registry and decoded by its own thread, the
+        // message thread never does it
+        sessionRegistry->submit(sessionRegistrySerial, state, generation, content);
+    }
+    
+    StateSnapshot::Ptr newSnapshot = new StateSnapshot(state, generation, headGen, content);
+    
+    {
+        const juce::SpinLock::ScopedLockType lock(stateSnapshotLock);
+        std::swap(stateSnapshot, newSnapshot);
+    }
+    
+    // newSnapshot now holds the previous one, released here rather than under the lock
+}
+
+namespace
+{
+    // The content of the state, see StateChunk. What the cue schedule is built from is
+    // a part of it, see rebuildCueSchedule()
+    const juce::Identifier sessionTextId ("SessionText");
+    const juce::Identifier todoItemsId ("TodoItems");
+    const juce::Identifier todoItemId ("TodoItem");
+    const juce::Identifier anchorTimeId ("AnchorTime");
+    const juce::Identifier textId ("Text");
+}
+
+void NotePadAudioProcessor::contentChanged(bool affectsCues)
+{
+    ++contentGeneration;
+    
+    if (affectsCues)
+        cueScheduleDirty = true;
+    
+    triggerAsyncUpdate();
+}
+
+void NotePadAudioProcessor::headChanged()
+{
+    ++headGeneration;
+    triggerAsyncUpdate();
+}
+
+void NotePadAudioProcessor::valueTreePropertyChanged(juce::ValueTree& tree, const juce::Identifier& property)
+{
+    if (tree == treeState.state && property == sessionTextId)
+        contentChanged(true);
+    else if (tree.hasType(todoItemId))
+        contentChanged(property == anchorTimeId || property == textId);
+    else if (tree.hasType(todoItemsId))
+        contentChanged(false);
+    else
+        headChanged();
+}
+
+void NotePadAudioProcessor::valueTreeChildAdded(juce::ValueTree& parent, juce::ValueTree& child)
+{
+    if (parent.hasType(todoItemsId) || child.hasType(todoItemsId))
+        contentChanged(true);
+    else
+        headChanged();
+}
+
+void NotePadAudioProcessor::valueTreeChildRemoved(juce::ValueTree& parent, juce::ValueTree& child, int)
+{
+    if (parent.hasType(todoItemsId) || child.hasType(todoItemsId))
+        contentChanged(true);
+    else
+        headChanged();
+}
+
+void NotePadAudioProcessor::valueTreeChildOrderChanged(juce::ValueTree& parent, int, int)
+{
+    if (parent.hasType(todoItemsId))
+        contentChanged(true);
+    else
+        headChanged();
+}
+
+void NotePadAudioProcessor::setBulkChangeInProgress(bool inProgress)
+{
+    bulkChangeInProgress = inProgress;
+    
+    auto snapshot = getStateSnapshot();
+    if (!inProgress && (snapshot->generation != contentGeneration.load() || snapshot->headGeneration != headGeneration.load()))
+        triggerAsyncUpdate();
+}
+
+void NotePadAudioProcessor::handleAsyncUpdate()
+{
+    reloadEditorContent();
+    
+    // Picked up again when the bulk change ends
+    if (bulkChangeInProgress)
+        return;
+    
+    publishStateSnapshot();
+    collectRetiredCueSchedules();
+    
+    // Cues are only worth building (and content only worth decoding) when they're switched on
+    if (juce::roundToInt(midiCueModeParameter->load()) != midiCuesOff && cueScheduleDirty.exchange(false))
+    {
+        ensureContentHydrated();
+        rebuildCueSchedule();
+    }
+}
+
+//==============================================================================
+void NotePadAudioProcessor::offerRecoveredSession()
+{
+    recoveryOffered = true;
+    
+    // Nothing to ask about if the restored content already matches
+    ensureContentHydrated();
+    SessionJournal::Recovery recovery;
+    if (!sessionJournal.getRecovery(recovery)
+        || (recovery.sessionText == treeState.state.getProperty("SessionText").toString()
+            && recovery.todoItems.isEquivalentTo(treeState.state.getChildWithName("TodoItems"))))
+    {
+        discardRecoveredSession();
+        return;
+    }
+    
+    currentEditor->offerSessionRecovery();
+}
+
+bool NotePadAudioProcessor::restoreRecoveredSession()
+{
+    SessionJournal::Recovery recovery;
+    if (!sessionJournal.getRecovery(recovery))
+        return false;
+    
+    ensureContentHydrated();
+    treeState.state.setProperty("SessionText", recovery.sessionText, nullptr);
+    treeState.state.getOrCreateChildWithName("TodoItems", nullptr).copyPropertiesAndChildrenFrom(recovery.todoItems, nullptr);
+    
+    sessionJournal.recoveryResolved();
+    return true;
+}
+
+void NotePadAudioProcessor::discardRecoveredSession()
+{
+    sessionJournal.recoveryResolved();
+}
+
+//==============================================================================
+void NotePadAudioProcessor::rebuildCueSchedule()
+{
+    std::vector<std::pair<double, juce::String>> entries;
+    
+    for (const auto& todo : treeState.state.getChildWithName("TodoItems"))
+        if (todo.hasProperty("AnchorTime"))
+            entries.emplace_back(static_cast<double>(todo.getProperty("AnchorTime")), todo.getProperty("Text").toString());
+    
+    // Lines in the notes that carry a "[m:ss.s]" stamp are cues too
+    auto notes = treeState.state.getProperty("SessionText").toString();
+    for (auto p = notes.getCharPointer(); !p.isEmpty();)
+    {
+        auto lineStart = p;
+        while (!p.isEmpty() && *p != '\n')
+            ++p;
+        
+        juce::String line(lineStart, p);
+        if (!p.isEmpty())
+            ++p;
+        
+        for (int open = line.indexOfChar('['); open >= 0; open = line.indexOfChar(open + 1, '['))
+        {
+            auto close = line.indexOfChar(open + 1, ']');
+            double time = 0.0;
+            if (close > open && parseTimelinePosition(line.substring(open + 1, close), time))
+            {
+                auto text = (line.substring(0, open) + line.substring(close + 1)).trim();
+                entries.emplace_back(time, text);
+            }
+        }
+    }
+    
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const auto& a, const auto& b) { return a.first < b.first; });
+    
+    auto* schedule = new CueSchedule();
+    schedule->times.reserve(entries.size());
+    schedule->cues.reserve(entries.size());
+    
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        // Marker SysEx messages are laid out back to back so the audio thread only copies bytes
+        std::vector<juce::uint8> payload(std::begin(cueSysExHeader), std::end(cueSysExHeader));
+        for (auto c : entries[i].second.substring(0, maxCueTextLength))
+            payload.push_back((juce::uint8) (c < 0x20 || c > 0x7e ? '?' : c));
+        
+        auto marker = juce::MidiMessage::createSysExMessage(payload.data(), (int) payload.size());
+        CueSchedule::Cue cue;
+        cue.markerOffset = (int) schedule->markerBytes.size();
+        cue.markerSize = marker.getRawDataSize();
+        cue.controllerValue = (juce::uint8) (i % 127 + 1);
+        schedule->markerBytes.insert(schedule->markerBytes.end(), marker.getRawData(), marker.getRawData() + marker.getRawDataSize());
+        
+        schedule->times.push_back(entries[i].first);
+        schedule->cues.push_back(cue);
+    }
+    
+    // A schedule the audio thread never picked up can be freed here directly
+    delete pendingCueSchedule.exchange(schedule);
+}
+
+void NotePadAudioProcessor::collectRetiredCueSchedules()
+{
+    auto numReady = retiredCueFifo.getNumReady();
+    if (numReady == 0)
+        return;
+    
+    const auto scope = retiredCueFifo.read(numReady);
+    scope.forEach ([this] (int index)
+    {
+        delete retiredCueSchedules[(size_t) index];
+        retiredCueSchedules[(size_t) index] = nullptr;
+    });
+}
+
+juce::String NotePadAudioProcessor::formatTimelinePosition(double timeSeconds)
+{
+    auto totalTenths = juce::roundToInt(juce::jmax(0.0, timeSeconds) * 10.0);
+    auto hours = totalTenths / 36000;
+    auto minutes = (totalTenths / 600) % 60;
+    auto seconds = (totalTenths / 10) % 60;
+    auto tenths = totalTenths % 10;
+    
+    juce::String result;
+    if (hours > 0)
+        result << hours << ":" << juce::String(minutes).paddedLeft('0', 2);
+    else
+        result << minutes;
+    
+    result << ":" << juce::String(seconds).paddedLeft('0', 2) << "." << tenths;
+    return result;
+}
+
+bool NotePadAudioProcessor::parseTimelinePosition(const juce::String& text, double& timeSeconds)
+{
+    // Accepts what formatTimelinePosition writes: "m:ss.s" or "h:mm:ss.s"
+    auto parts = juce::StringArray::fromTokens(text.trim(), ":", "");
+    if (parts.size() < 2 || parts.size() > 3)
+        return false;
+    
+    for (const auto& part : parts)
+        if (part.isEmpty() || !part.containsOnly("0123456789."))
+            return false;
+    
+    auto seconds = parts[parts.size() - 1].getDoubleValue();
+    auto minutes = parts[parts.size() - 2].getIntValue();
+    auto hours = parts.size() == 3 ? parts[0].getIntValue() : 0;
+    
+    timeSeconds = hours * 3600.0 + minutes * 60.0 + seconds;
+    return true;
 }
 
 //==============================================================================
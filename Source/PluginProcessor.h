@@ -9,6 +9,10 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "LevelTimeline.h"
+#include "SessionJournal.h"
+#include "SessionRegistry.h"
+#include "StateChunk.h"
 
 //==============================================================================
 // Forward declaration
@@ -18,7 +22,10 @@ class NotePadAudioProcessorEditor;
 /**
 */
 
-class NotePadAudioProcessor  : public juce::AudioProcessor
+class NotePadAudioProcessor  : public juce::AudioProcessor,
+                               private juce::ValueTree::Listener,
+                               private juce::AsyncUpdater,
+                               private juce::Timer
 {
 public:
     //==============================================================================
@@ -34,6 +41,10 @@ public:
    #endif
 
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
+    
+    // Hosts with 64-bit mix engines can hand us their buffers without converting
+    bool supportsDoublePrecisionProcessing() const override { return true; }
 
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
@@ -41,6 +52,9 @@ public:
 
     //==============================================================================
     const juce::String getName() const override;
+    
+    // Track names are passed on to the session overview
+    void updateTrackProperties(const TrackProperties& properties) override;
 
     bool acceptsMidi() const override;
     bool producesMidi() const override;
@@ -72,8 +86,328 @@ public:
      NotePadAudioProcessorEditor* currentEditor = nullptr;
      
      void setEditor(NotePadAudioProcessorEditor* editor) { currentEditor = editor; }
+     
+     //==============================================================================
+     // Notes and todos restored from a project are kept in their stored form until
+     // something actually needs them, most instances never have their editor opened.
+     // Call this before reading "SessionText" or "TodoItems" from treeState.
+     void ensureContentHydrated();
+     
+     // Set when the restored content section couldn't be decoded. It is then kept and saved
+     // back verbatim, nothing journaled or saved replaces it with an empty state.
+     bool isContentUnreadable() const { return contentUnreadable; }
+     
+     // Set from a state restore made while the editor is open until the editor has
+     // reloaded. Edits the editor still holds belong to the replaced content.
+     bool isEditorReloadPending() const { return editorReloadPending; }
+     
+     // Content section of a restored chunk, written back verbatim while it is untouched
+     using StoredContent = StateChunk::StoredContent;
+     
+     //==============================================================================
+     // Immutable copy of treeState, republished by the message thread whenever the
+     // tree changes. Hosts may save from any thread, so getStateInformation only
+     // ever serializes one of these instead of reading the live tree or the editor.
+     struct StateSnapshot : public juce::ReferenceCountedObject
+     {
+         using Ptr = juce::ReferenceCountedObjectPtr<StateSnapshot>;
+         
+         StateSnapshot(juce::ValueTree s, juce::uint64 gen, juce::uint64 headGen, StoredContent::Ptr content)
+             : state(std::move(s)), generation(gen), headGeneration(headGen), storedContent(std::move(content)) {}
+         
+         const juce::ValueTree state;
+         const juce::uint64 generation;     // of the notes and todos
+         const juce::uint64 headGeneration; // of everything else: parameters and flags
+         const StoredContent::Ptr storedContent; // non-null while the content isn't hydrated
+     };
+     
+     StateSnapshot::Ptr getStateSnapshot() const;
+    
+     // Bumped on every change to the notes or todos, from whichever thread made it.
+     // Parameters and flags count towards a separate head generation.
+     juce::uint64 getContentGeneration() const { return contentGeneration.load(); }
+    
+     // How often getStateInformation could reuse the encoded notes and todos of an earlier
+     // save instead of encoding them again
+     struct StateCacheStats
+     {
+         juce::int64 hits = 0;
+         juce::int64 misses = 0;
+     };
+     
+     StateCacheStats getStateCacheStats() const { return { stateCacheHits.load(), stateCacheMisses.load() }; }
+     
+     //==============================================================================
+     // Host transport as processBlock last saw it. Published every block through a
+     // wait-free single producer/single consumer fifo, the editor drains it at display rate.
+     struct PlayheadState
+     {
+         double timeSeconds = 0.0;
+         double ppqPosition = 0.0;
+         juce::int64 bar = 0;
+         bool isPlaying = false;
+         bool hasPpqPosition = false;
+         bool hasBar = false;
+     };
+     
+     // Message thread only: consumes everything published since the last call and
+     // hands back the newest, returns false if nothing new arrived
+     bool readLatestPlayhead(PlayheadState& latest);
+     
+     // Timeline stamps as written into notes and shown on anchored todos, e.g. "1:23.4"
+     static juce::String formatTimelinePosition(double timeSeconds);
+     static bool parseTimelinePosition(const juce::String& text, double& timeSeconds);
+     
+     // Values of the "midiCues" parameter
+     enum { midiCuesOff = 0, midiCuesMarkers = 1, midiCuesControllers = 2 };
+     
+     //==============================================================================
+     // Reference clips: while capture is on, processBlock keeps the last maxClipSeconds
+     // of input (up to maxCaptureChannels channels) in a ring buffer. captureClip() copies
+     // the tail out and writes a FLAC file on a background thread, then calls back on the
+     // message thread with the file, or an invalid File if nothing could be captured.
+     static constexpr double maxClipSeconds = 30.0;
+     static constexpr int maxCaptureChannels = 8; // FLAC's limit
+     
+     bool isClipCaptureEnabled() const { return clipCaptureEnabled.load(); }
+     void setClipCaptureEnabled(bool shouldBeEnabled);
+     void captureClip(double seconds, std::function<void(const juce::File&)> onCaptured);
+     static juce::File getClipsDirectory();
+     
+     //==============================================================================
+     // Peak and level of the output along the timeline, measured by processBlock while
+     // the host plays. The version moves on whenever new blocks have been added.
+     const LevelTimeline& getLevelTimeline() const { return levelTimeline; }
+     juce::uint32 getLevelTimelineVersion() const { return levelTimelineVersion; }
+     
+     //==============================================================================
+     // Notes and todos from a session that crashed after this state was saved, found in
+     // the instance's journal when the state was restored. The editor asks whether to
+     // restore them once it is open, until then nothing more is journaled.
+     bool restoreRecoveredSession();
+     void discardRecoveredSession();
+     
+     // Message thread: does the work queued by content changes (snapshot, cue schedule)
+     // right away instead of on the next message loop pass. For headless tools.
+     void flushPendingUpdates() { handleUpdateNowIfNeeded(); }
+     
+     // Message thread: while set, content changes are only counted and the snapshot (and
+     // journal) catch up once it is cleared. For imports that add thousands of todos in batches.
+     void setBulkChangeInProgress(bool inProgress);
+     
+     // Every instance in the process, for views across the whole session
+     SessionRegistry& getSessionRegistry() { return *sessionRegistry; }
+     int getSessionRegistrySerial() const { return sessionRegistrySerial; }
 
 private:
-    //==============================================================================    
+    //==============================================================================
+    StateSnapshot::Ptr stateSnapshot;
+    juce::SpinLock stateSnapshotLock; // only ever held to swap or copy the pointer
+    
+    std::atomic<juce::uint64> contentGeneration { 0 }, headGeneration { 0 };
+    bool bulkChangeInProgress = false;
+    
+    StoredContent::Ptr storedContent;
+    bool contentUnreadable = false;
+    juce::CriticalSection hydrationLock; // only ever held to swap or copy the pointer
+    
+    // Last chunk written by getStateInformation, reused until either generation moves on.
+    // Its content section is kept apart as well, so a change to parameters alone (every
+    // automation step) only writes a new head in front of it
+    juce::MemoryBlock cachedStateChunk;
+    juce::uint64 cachedStateGeneration = 0, cachedHeadGeneration = 0;
+    bool hasCachedStateChunk = false;
+    juce::MemoryBlock cachedContentSection;
+    juce::uint64 cachedContentGeneration = 0;
+    bool hasCachedContentSection = false;
+    juce::CriticalSection stateCacheLock; // only taken by host save/load calls
+    std::atomic<juce::int64> stateCacheHits { 0 }, stateCacheMisses { 0 };
+    
+    // Every published snapshot is journaled, so edits survive a crash before the next save.
+    // The snapshot's generation is saved with the state as its "Revision".
+    SessionJournal sessionJournal;
+    bool hasRestoredState = false;
+    bool recoveryOffered = false;
+    std::atomic<bool> editorReloadPending { false };
+    
+    void reloadEditorContent();
+    
+    void offerRecoveredSession();
+    
+    // Every published snapshot also goes to the registry, which keeps the session-wide
+    // index and overview. It lives as long as any instance in the process does.
+    juce::SharedResourcePointer<SessionRegistry> sessionRegistry;
+    int sessionRegistrySerial = 0;
+    
+    // Bus channel counts, read once in prepareToPlay so processBlock doesn't query the buses
+    int numInputChannels = 0;
+    int numOutputChannels = 0;
+    
+    // Trim stage driven by the "gain" and "gainEnabled" parameters
+    std::atomic<float>* gainParameter = nullptr;
+    std::atomic<float>* gainEnabledParameter = nullptr;
+    juce::SmoothedValue<float, juce::ValueSmoothingTypes::Multiplicative> smoothedGain { 1.0f };
+    static constexpr double gainSmoothingSeconds = 0.05;
+    juce::HeapBlock<float> floatGainRamp;
+    juce::HeapBlock<double> doubleGainRamp;
+    int gainRampSize = 0;
+    
+    float getTargetGain() const;
+    
+    // Written only by the audio thread and read only by the message thread. When nobody
+    // drains it (no editor open) new positions are dropped rather than blocking.
+    static constexpr int playheadFifoSize = 256; // a few frames of 32-sample blocks
+    juce::AbstractFifo playheadFifo { playheadFifoSize };
+    std::array<PlayheadState, playheadFifoSize> playheadStates;
+    
+    bool getHostPosition (PlayheadState& state) const;
+    void publishPlayhead (const PlayheadState& state);
+    
+    //==============================================================================
+    // While the "midiCues" parameter is on, crossing an anchored todo or a stamped notes
+    // line during playback sends a marker SysEx carrying its text (or a controller on channel 16).
+    // Meta events only exist in MIDI files, on the wire their 0xFF status is a System Reset.
+    // Schedules are built on the message thread, never change once published, and are
+    // handed over with an atomic exchange. The audio thread sends the one it replaces
+    // back through retiredCueFifo so it is never the one freeing memory.
+    struct CueSchedule
+    {
+        struct Cue
+        {
+            int markerOffset = 0;   // into markerBytes
+            int markerSize = 0;
+            juce::uint8 controllerValue = 1;
+        };
+        
+        std::vector<double> times; // sorted, searched by the audio thread
+        std::vector<Cue> cues;     // same order as times
+        std::vector<juce::uint8> markerBytes;
+    };
+    
+    std::atomic<float>* midiCueModeParameter = nullptr;
+    std::atomic<CueSchedule*> pendingCueSchedule { nullptr };
+    std::atomic<bool> cueScheduleDirty { true };
+    
+    static constexpr int retiredCueFifoSize = 16;
+    juce::AbstractFifo retiredCueFifo { retiredCueFifoSize };
+    std::array<CueSchedule*, retiredCueFifoSize> retiredCueSchedules {};
+    
+    // Audio thread only
+    CueSchedule* activeCueSchedule = nullptr;
+    size_t cueCursor = 0;
+    double nextCueBlockStart = 0.0;
+    bool cueCursorValid = false;
+    
+    static constexpr int maxCuesPerBlock = 16;
+    static constexpr int maxCueTextLength = 120;
+    static constexpr double cueSeekToleranceSeconds = 0.005;
+    static constexpr int cueMidiChannel = 16;
+    static constexpr juce::uint8 cueController = 102;
+    
+    // F0 7D 'M' '1' 01 <text> F7: the non-commercial manufacturer id, a tag and the cue's
+    // text in 7-bit ASCII, anything outside it sent as '?'
+    static constexpr juce::uint8 cueSysExHeader[] = { 0x7d, 'M', '1', 0x01 };
+    
+    void emitCues (juce::MidiBuffer& midiMessages, const PlayheadState* position, int numSamples);
+    
+    //==============================================================================
+    // Rings are allocated off the audio path and handed over like cue schedules: published
+    // with an atomic exchange, picked up at the start of a block, and the replaced one sent
+    // back through retiredCaptureFifo. The audio thread never allocates, frees or waits.
+    // Rings are reference counted so a clip being copied keeps its ring alive, the last
+    // reference always goes on the message thread or the encoder thread.
+    struct CaptureRing : public juce::ReferenceCountedObject
+    {
+        using Ptr = juce::ReferenceCountedObjectPtr<CaptureRing>;
+        
+        CaptureRing(int numChannels, int numSamples, double rate)
+            : buffer(numChannels, numSamples), sampleRate(rate) { buffer.clear(); }
+        
+        juce::AudioBuffer<float> buffer; // no channels while capture is off
+        const double sampleRate;
+        std::atomic<juce::int64> writePosition { 0 }; // total samples written
+    };
+    
+    std::atomic<bool> clipCaptureEnabled { false };
+    std::atomic<bool> captureRingDirty { false }; // rebuilt by the timer, e.g. after a state load
+    std::atomic<CaptureRing*> pendingCaptureRing { nullptr };
+    
+    static constexpr int retiredCaptureFifoSize = 8;
+    juce::AbstractFifo retiredCaptureFifo { retiredCaptureFifoSize };
+    std::array<CaptureRing*, retiredCaptureFifoSize> retiredCaptureRings {};
+    
+    // Every ring that is published or in use, and the newest one for captureClip()
+    juce::ReferenceCountedArray<CaptureRing> ownedCaptureRings;
+    CaptureRing::Ptr currentCaptureRing;
+    juce::CriticalSection captureBufferLock; // never taken by the audio thread
+    
+    CaptureRing* activeCaptureRing = nullptr; // audio thread only
+    static constexpr double captureMarginSeconds = 2.0; // headroom for writes during a copy
+    
+    void updateCaptureRing (double sampleRate);
+    void collectRetiredCaptureRings();
+    static juce::File writeClip (const CaptureRing& ring, double seconds);
+    
+    template <typename SampleType>
+    void writeCapture (const juce::AudioBuffer<SampleType>& buffer);
+    
+    //==============================================================================
+    // One entry per played block, written by the audio thread and folded into
+    // levelTimeline by timerCallback on the message thread
+    struct LevelBlock
+    {
+        double timeSeconds = 0.0;
+        int numSamples = 0;
+        int numChannels = 0;
+        LevelTimeline::ChannelLevels peaks {};
+        LevelTimeline::ChannelLevels meanSquares {};
+    };
+    
+    static constexpr int levelFifoSize = 1024;
+    static constexpr int levelTimelineUpdateHz = 15;
+    juce::AbstractFifo levelFifo { levelFifoSize };
+    std::array<LevelBlock, levelFifoSize> levelBlocks;
+    LevelTimeline levelTimeline;
+    juce::uint32 levelTimelineVersion = 0;
+    
+    template <typename SampleType>
+    void applyGain (juce::AudioBuffer<SampleType>& buffer, int numChannels);
+    
+    template <typename SampleType>
+    void measureLevels (const juce::AudioBuffer<SampleType>& buffer, int numChannels, const PlayheadState& position);
+    
+    void timerCallback() override;
+    
+    // Clip encoding for every instance in the process, one thread between them. A job
+    // only holds the ring it copies from and its callback, never the instance itself.
+    struct ClipEncoderPool : public juce::ThreadPool
+    {
+        ClipEncoderPool() : juce::ThreadPool (1) {}
+    };
+    
+    juce::SharedResourcePointer<ClipEncoderPool> clipEncoderPool;
+    void rebuildCueSchedule();
+    void collectRetiredCueSchedules();
+    
+    template <typename SampleType>
+    SampleType* getGainRamp();
+    
+    template <typename SampleType>
+    void processSamples (juce::AudioBuffer<SampleType>& buffer, juce::MidiBuffer& midiMessages);
+    
+    void publishStateSnapshot();
+    void contentChanged(bool affectsCues);
+    void headChanged();
+    void handleAsyncUpdate() override;
+    
+    // Parameter flushes from treeState land here on every automation step as well. They
+    // only move the head generation, and only the notes and the todos' anchors and text
+    // mark the cue schedule for a rebuild
+    void valueTreePropertyChanged(juce::ValueTree& tree, const juce::Identifier& property) override;
+    void valueTreeChildAdded(juce::ValueTree& parent, juce::ValueTree& child) override;
+    void valueTreeChildRemoved(juce::ValueTree& parent, juce::ValueTree& child, int) override;
+    void valueTreeChildOrderChanged(juce::ValueTree& parent, int, int) override;
+    void valueTreeRedirected(juce::ValueTree&) override { contentChanged(true); }
+    
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (NotePadAudioProcessor)
 };
\ No newline at end of file
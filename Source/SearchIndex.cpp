@@ -0,0 +1,232 @@
+/*
+  ==============================================================================
+
+    Incrementally maintained trigram index used by the search bar.
+
+  ==============================================================================
+*/
+
+#include "SearchIndex.h"
+#include <algorithm>
+
+//==============================================================================
+std::vector<SearchIndex::Gram> SearchIndex::getGrams (const juce::String& lowerText)
+{
+    std::vector<Gram> grams;
+    
+    auto p = lowerText.getCharPointer();
+    juce::juce_wchar a = 0, b = 0;
+    int count = 0;
+    
+    while (! p.isEmpty())
+    {
+        auto c = p.getAndAdvance();
+        
+        if (count >= 2)
+            grams.push_back (((Gram) (juce::uint32) a << 42) | ((Gram) (juce::uint32) b << 21) | (Gram) (juce::uint32) c);
+        
+        a = b;
+        b = c;
+        ++count;
+    }
+    
+    std::sort (grams.begin(), grams.end());
+    grams.erase (std::unique (grams.begin(), grams.end()), grams.end());
+    return grams;
+}
+
+void SearchIndex::unlink (Key key, const Document& document)
+{
+    for (auto gram : document.grams)
+    {
+        auto posting = postings.find (gram);
+        if (posting != postings.end())
+        {
+            posting->second.erase (key);
+            if (posting->second.empty())
+                postings.erase (posting);
+        }
+    }
+}
+
+void SearchIndex::setDocument (Key key, const juce::String& text)
+{
+    auto lowerText = text.toLowerCase();
+    auto existing = documents.find (key);
+    
+    if (existing != documents.end())
+    {
+        if (existing->second.lowerText == lowerText)
+            return;
+        
+        unlink (key, existing->second);
+    }
+    
+    auto& document = documents[key];
+    document.lowerText = lowerText;
+    document.grams = getGrams (lowerText);
+    
+    for (auto gram : document.grams)
+        postings[gram].insert (key);
+}
+
+void SearchIndex::removeDocument (Key key)
+{
+    auto existing = documents.find (key);
+    if (existing == documents.end())
+        return;
+    
+    unlink (key, existing->second);
+    documents.erase (existing);
+}
+
+void SearchIndex::clear()
+{
+    documents.clear();
+    postings.clear();
+}
+
+std::vector<SearchIndex::Key> SearchIndex::search (const juce::String& query) const
+{
+    std::vector<Key> results;
+    auto lowerQuery = query.toLowerCase();
+    
+    if (lowerQuery.isEmpty())
+        return results;
+    
+    auto queryGrams = getGrams (lowerQuery);
+    
+    if (queryGrams.empty())
+    {
+        // Too short to have a gram, a scan over one or two characters is cheap anyway
+        for (const auto& document : documents)
+            if (document.second.lowerText.contains (lowerQuery))
+                results.push_back (document.first);
+        
+        return results;
+    }
+    
+    // Start from the rarest gram, every match has to be in its posting set
+    const std::unordered_set<Key>* rarest = nullptr;
+    for (auto gram : queryGrams)
+    {
+        auto posting = postings.find (gram);
+        if (posting == postings.end())
+            return results;
+        
+        if (rarest == nullptr || posting->second.size() < rarest->size())
+            rarest = &posting->second;
+    }
+    
+    for (auto key : *rarest)
+    {
+        auto document = documents.find (key);
+        if (document != documents.end() && document->second.lowerText.contains (lowerQuery))
+            results.push_back (key);
+    }
+    
+    return results;
+}
+
+juce::String SearchIndex::getLowerCaseText (Key key) const
+{
+    auto document = documents.find (key);
+    return document != documents.end() ? document->second.lowerText : juce::String();
+}
+
+//==============================================================================
+void NotesSearchIndex::update (const juce::String& newText)
+{
+    std::vector<juce::String> newLines;
+    
+    for (auto p = newText.getCharPointer();;)
+    {
+        auto end = p;
+        while (! end.isEmpty() && *end != '\n')
+            ++end;
+        
+        newLines.push_back (juce::String (p, end));
+        
+        if (end.isEmpty())
+            break;
+        
+        p = end + 1;
+    }
+    
+    // Unchanged lines at either end keep their keys, only the middle is re-indexed
+    size_t prefix = 0;
+    while (prefix < lines.size() && prefix < newLines.size() && lines[prefix] == newLines[prefix])
+        ++prefix;
+    
+    size_t suffix = 0;
+    while (suffix < lines.size() - prefix && suffix < newLines.size() - prefix
+           && lines[lines.size() - 1 - suffix] == newLines[newLines.size() - 1 - suffix])
+        ++suffix;
+    
+    for (size_t i = prefix; i < lines.size() - suffix; ++i)
+        index.removeDocument (lineKeys[i]);
+    
+    std::vector<SearchIndex::Key> newKeys;
+    newKeys.reserve (newLines.size());
+    newKeys.insert (newKeys.end(), lineKeys.begin(), lineKeys.begin() + (std::ptrdiff_t) prefix);
+    
+    for (size_t i = prefix; i < newLines.size() - suffix; ++i)
+    {
+        auto key = nextKey++;
+        index.setDocument (key, newLines[i]);
+        newKeys.push_back (key);
+    }
+    
+    newKeys.insert (newKeys.end(), lineKeys.end() - (std::ptrdiff_t) suffix, lineKeys.end());
+    
+    lines = std::move (newLines);
+    lineKeys = std::move (newKeys);
+    
+    // Positions are cheap to rebuild and only change here
+    lineStarts.resize (lines.size());
+    lineForKey.clear();
+    
+    int start = 0;
+    for (size_t i = 0; i < lines.size(); ++i)
+    {
+        lineStarts[i] = start;
+        lineForKey[lineKeys[i]] = (int) i;
+        start += lines[i].length() + 1;
+    }
+}
+
+juce::Array<juce::Range<int>> NotesSearchIndex::findMatches (const juce::String& query, int maxMatches) const
+{
+    juce::Array<juce::Range<int>> matches;
+    auto lowerQuery = query.toLowerCase();
+    auto queryLength = lowerQuery.length();
+    
+    if (queryLength == 0)
+        return matches;
+    
+    std::vector<int> matchingLines;
+    for (auto key : index.search (lowerQuery))
+    {
+        auto line = lineForKey.find (key);
+        if (line != lineForKey.end())
+            matchingLines.push_back (line->second);
+    }
+    
+    std::sort (matchingLines.begin(), matchingLines.end());
+    
+    for (auto line : matchingLines)
+    {
+        auto lowerLine = index.getLowerCaseText (lineKeys[(size_t) line]);
+        
+        for (int found = lowerLine.indexOf (lowerQuery); found >= 0; found = lowerLine.indexOf (found + 1, lowerQuery))
+        {
+            if (matches.size() >= maxMatches)
+                return matches;
+            
+            auto start = lineStarts[(size_t) line] + found;
+            matches.add ({ start, start + queryLength });
+        }
+    }
+    
+    return matches;
+}
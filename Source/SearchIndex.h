@@ -0,0 +1,82 @@
+/*
+  ==============================================================================
+
+    Incrementally maintained trigram index used by the search bar.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+//==============================================================================
+/**
+ * Case-insensitive substring index over a set of keyed documents.
+ *
+ * Each document is lower-cased once and broken into overlapping three-character
+ * grams. A query walks the posting set of its rarest gram and only verifies
+ * those candidates, so lookups don't scale with the total amount of text.
+ * Queries shorter than a gram fall back to scanning the lower-cased documents.
+ */
+class SearchIndex
+{
+public:
+    using Key = juce::int64;
+    
+    // Adds the document, or replaces the text of an existing one
+    void setDocument (Key key, const juce::String& text);
+    void removeDocument (Key key);
+    void clear();
+    
+    int getNumDocuments() const { return (int) documents.size(); }
+    
+    // Keys of every document containing the query, in no particular order
+    std::vector<Key> search (const juce::String& query) const;
+    
+    // The lower-cased text the index holds for a document, empty if unknown
+    juce::String getLowerCaseText (Key key) const;
+    
+private:
+    using Gram = juce::uint64;
+    
+    struct Document
+    {
+        juce::String lowerText;
+        std::vector<Gram> grams; // unique
+    };
+    
+    std::unordered_map<Key, Document> documents;
+    std::unordered_map<Gram, std::unordered_set<Key>> postings;
+    
+    static std::vector<Gram> getGrams (const juce::String& lowerText);
+    void unlink (Key key, const Document& document);
+};
+
+//==============================================================================
+/**
+ * Keeps a SearchIndex over the lines of the session notes.
+ *
+ * update() compares the new text with the previous one line by line from both
+ * ends, so only the lines that were actually edited are re-indexed. Every line
+ * keeps its key while it is unchanged, however much text is added around it.
+ */
+class NotesSearchIndex
+{
+public:
+    void update (const juce::String& newText);
+    
+    // Character ranges of matches in the text given to the last update(), in order
+    juce::Array<juce::Range<int>> findMatches (const juce::String& query, int maxMatches) const;
+    
+private:
+    SearchIndex index;
+    std::vector<juce::String> lines;          // without the trailing newline
+    std::vector<SearchIndex::Key> lineKeys;
+    std::vector<int> lineStarts;
+    std::unordered_map<SearchIndex::Key, int> lineForKey;
+    SearchIndex::Key nextKey = 1;
+};
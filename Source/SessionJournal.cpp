@@ -0,0 +1,597 @@
+/*
+  ==============================================================================
+
+    Crash journal: notes and todo edits appended to a local file as they
+    happen, so they survive the host going down before the project is saved.
+
+  ==============================================================================
+*/
+
+#include "SessionJournal.h"
+
+namespace
+{
+    const juce::Identifier sessionTextId ("SessionText");
+    const juce::Identifier todoItemsId ("TodoItems");
+    const juce::Identifier idId ("Id");
+    
+    constexpr int recordHeaderSize = (int) (sizeof (juce::int32) + sizeof (juce::int64));
+    
+    // Ids held by live journals in this process, so two instances never share a file
+    juce::CriticalSection claimedIdsLock;
+    juce::StringArray claimedIds;
+    
+    juce::uint32 getChecksum (const void* data, size_t size)
+    {
+        // FNV-1a, only there to catch torn and corrupt records
+        juce::uint32 hash = 2166136261u;
+        auto bytes = static_cast<const juce::uint8*> (data);
+        for (size_t i = 0; i < size; ++i)
+            hash = (hash ^ bytes[i]) * 16777619u;
+        
+        return hash;
+    }
+    
+    void writeRecord (juce::OutputStream& out, int type, juce::uint64 revision, const juce::MemoryOutputStream& payload)
+    {
+        juce::MemoryOutputStream body;
+        body.writeInt (type);
+        body.writeInt64 ((juce::int64) revision);
+        body.write (payload.getData(), payload.getDataSize());
+        
+        out.writeInt ((int) body.getDataSize());
+        out.write (body.getData(), body.getDataSize());
+        out.writeInt ((int) getChecksum (body.getData(), body.getDataSize()));
+    }
+    
+    bool isContinuationByte (const char* text, size_t size, size_t index)
+    {
+        return index < size && (static_cast<juce::uint8> (text[index]) & 0xc0) == 0x80;
+    }
+    
+    bool haveSameId (const juce::ValueTree& a, const juce::ValueTree& b)
+    {
+        return a.getProperty (idId) == b.getProperty (idId);
+    }
+}
+
+//==============================================================================
+SessionJournalWriter::SessionJournalWriter()
+    : juce::Thread ("M1-Notepad journal")
+{
+    startThread();
+}
+
+SessionJournalWriter::~SessionJournalWriter()
+{
+    // Only destroyed once the last journal has gone
+    jassert (journals.isEmpty());
+    
+    signalThreadShouldExit();
+    notify();
+    stopThread (10000);
+}
+
+void SessionJournalWriter::addJournal (SessionJournal* journal)
+{
+    const juce::ScopedLock sl (journalsLock);
+    journals.add (journal);
+}
+
+void SessionJournalWriter::removeJournal (SessionJournal* journal)
+{
+    // Held by the thread while it writes, so this waits for a write in progress
+    const juce::ScopedLock sl (journalsLock);
+    journals.removeFirstMatchingValue (journal);
+}
+
+void SessionJournalWriter::run()
+{
+    SessionJournal::deleteStaleJournals();
+    
+    while (! threadShouldExit())
+    {
+        auto now = juce::Time::getMillisecondCounter();
+        auto waitMs = -1;
+        
+        // One journal per lock, a journal removed meanwhile just shifts the rest and any
+        // skipped one is picked up on the next round
+        for (int i = 0; ! threadShouldExit(); ++i)
+        {
+            const juce::ScopedLock sl (journalsLock);
+            if (i >= journals.size())
+                break;
+            
+            auto* journal = journals.getUnchecked (i);
+            if (! journal->hasWork())
+                continue;
+            
+            // Edits arriving before the journal is due again are batched into its next write
+            auto remaining = (int) (journal->nextWriteTime - now);
+            if (remaining > 0 && remaining <= SessionJournal::flushIntervalMs)
+            {
+                waitMs = waitMs < 0 ? remaining : juce::jmin (waitMs, remaining);
+                continue;
+            }
+            
+            journal->processPending();
+            now = juce::Time::getMillisecondCounter();
+            journal->nextWriteTime = now + (juce::uint32) SessionJournal::flushIntervalMs;
+        }
+        
+        if (! threadShouldExit())
+            wait (waitMs);
+    }
+}
+
+//==============================================================================
+SessionJournal::SessionJournal()
+{
+    writer->addJournal (this);
+}
+
+SessionJournal::~SessionJournal()
+{
+    writer->removeJournal (this);
+    
+    // A clean shutdown, whatever the project was left at is what the user wanted.
+    // A recovery nobody has answered yet stays for the next time the project opens.
+    stream = nullptr;
+    if (instanceId.isNotEmpty() && ! holdForRecovery)
+        getJournalFile (instanceId).deleteFile();
+    
+    const juce::ScopedLock sl (claimedIdsLock);
+    claimedIds.removeString (claimedInstanceId);
+}
+
+juce::File SessionJournal::getJournalDirectory()
+{
+    return juce::File::getSpecialLocation (juce::File::userApplicationDataDirectory)
+               .getChildFile ("Mach1").getChildFile ("M1-Notepad").getChildFile ("Journal");
+}
+
+juce::File SessionJournal::getJournalFile (const juce::String& id)
+{
+    return getJournalDirectory().getChildFile (id + ".journal");
+}
+
+//==============================================================================
+juce::String SessionJournal::setInstance (const juce::String& requestedId, juce::uint64 restoredRevision, bool checkForRecovery)
+{
+    auto id = requestedId;
+    
+    {
+        const juce::ScopedLock sl (claimedIdsLock);
+        claimedIds.removeString (claimedInstanceId);
+        
+        // Ids end up in file names, anything that isn't one of ours is replaced
+        if (id.isEmpty() || ! id.containsOnly ("0123456789abcdef") || claimedIds.contains (id))
+        {
+            id = juce::Uuid().toString();
+            checkForRecovery = false;
+        }
+        
+        claimedIds.add (id);
+        claimedInstanceId = id;
+    }
+    
+    {
+        const juce::ScopedLock sl (pendingLock);
+        pendingInstanceId = id;
+        pendingRestoredRevision = restoredRevision;
+        pendingCheckForRecovery = checkForRecovery;
+        hasPendingInstance = true;
+        
+        // Anything still waiting belongs to the content that has just been replaced
+        pendingState = {};
+        hasPendingState = false;
+    }
+    
+    recoveryAvailable = false;
+    writer->journalChanged();
+    return id;
+}
+
+void SessionJournal::submit (const juce::ValueTree& state, juce::uint64 revision)
+{
+    {
+        const juce::ScopedLock sl (pendingLock);
+        pendingState = state;
+        pendingRevision = revision;
+        hasPendingState = true;
+    }
+    
+    writer->journalChanged();
+}
+
+bool SessionJournal::getRecovery (Recovery& result) const
+{
+    const juce::ScopedLock sl (recoveryLock);
+    
+    if (! recoveryAvailable.load())
+        return false;
+    
+    result = recovery;
+    return true;
+}
+
+void SessionJournal::recoveryResolved()
+{
+    recoveryAvailable = false;
+    
+    {
+        const juce::ScopedLock sl (pendingLock);
+        pendingResolve = true;
+    }
+    
+    writer->journalChanged();
+}
+
+//==============================================================================
+bool SessionJournal::hasWork()
+{
+    const juce::ScopedLock sl (pendingLock);
+    return hasPendingState || hasPendingInstance || pendingResolve;
+}
+
+void SessionJournal::processPending()
+{
+    juce::ValueTree state;
+    juce::uint64 revision = 0;
+    bool hasState = false;
+    juce::String newId;
+    juce::uint64 restoredRevision = 0;
+    bool checkForRecovery = false, hasInstance = false, resolve = false;
+    
+    {
+        const juce::ScopedLock sl (pendingLock);
+        std::swap (state, pendingState);
+        revision = pendingRevision;
+        hasState = std::exchange (hasPendingState, false);
+        newId = pendingInstanceId;
+        restoredRevision = pendingRestoredRevision;
+        checkForRecovery = pendingCheckForRecovery;
+        hasInstance = std::exchange (hasPendingInstance, false);
+        resolve = std::exchange (pendingResolve, false);
+    }
+    
+    if (hasInstance)
+        switchInstance (newId, restoredRevision, checkForRecovery);
+    
+    if (resolve && holdForRecovery)
+    {
+        // The next change starts a new journal with a checkpoint of the whole content
+        holdForRecovery = false;
+        getJournalFile (instanceId).deleteFile();
+        
+        const juce::ScopedLock sl (recoveryLock);
+        recovery = {};
+    }
+    
+    if (hasState && ! holdForRecovery)
+        writeState (state, revision);
+}
+
+void SessionJournal::switchInstance (const juce::String& newId, juce::uint64 restoredRevision, bool checkForRecovery)
+{
+    stream = nullptr;
+    
+    // The journal of the content that was just replaced is of no use any more, unless
+    // it is a recovery the user hasn't answered
+    if (instanceId.isNotEmpty() && ! holdForRecovery)
+        getJournalFile (instanceId).deleteFile();
+    
+    instanceId = newId;
+    hasBase = false;
+    holdForRecovery = false;
+    recordsSinceCheckpoint = 0;
+    writtenText = {};
+    writtenTodos = {};
+    
+    {
+        const juce::ScopedLock sl (recoveryLock);
+        recovery = {};
+    }
+    
+    auto file = getJournalFile (instanceId);
+    if (! file.existsAsFile())
+        return;
+    
+    Recovery found;
+    if (checkForRecovery && readJournal (file, found) && found.revision > restoredRevision)
+    {
+        holdForRecovery = true;
+        
+        const juce::ScopedLock sl (recoveryLock);
+        recovery = std::move (found);
+        recoveryAvailable = true;
+        return;
+    }
+    
+    file.deleteFile();
+}
+
+//==============================================================================
+void SessionJournal::writeState (const juce::ValueTree& state, juce::uint64 revision)
+{
+    auto text = state.getProperty (sessionTextId).toString();
+    auto todos = state.getChildWithName (todoItemsId);
+    
+    // The content as restored (or created) is already safe, only changes to it are written
+    if (! hasBase)
+    {
+        writtenText = text;
+        writtenTodos = todos;
+        hasBase = true;
+        return;
+    }
+    
+    bool needsCheckpoint = stream == nullptr
+                        || recordsSinceCheckpoint >= maxRecordsBeforeCompaction
+                        || stream->getPosition() > 2 * checkpointSize + compactionSlackBytes;
+    
+    bool written = needsCheckpoint ? writeCheckpoint (text, todos, revision)
+                                   : appendChanges (text, todos, revision);
+    
+    // A failed write is retried as a checkpoint with the next state
+    if (! written)
+    {
+        stream = nullptr;
+        return;
+    }
+    
+    writtenText = text;
+    writtenTodos = todos;
+}
+
+bool SessionJournal::writeCheckpoint (const juce::String& text, const juce::ValueTree& todos, juce::uint64 revision)
+{
+    // Nothing to do until the content differs from what the instance was given
+    if (stream == nullptr && text == writtenText && todos.isEquivalentTo (writtenTodos))
+        return true;
+    
+    stream = nullptr;
+    
+    auto file = getJournalFile (instanceId);
+    if (! file.getParentDirectory().createDirectory())
+        return false;
+    
+    auto temp = file.getSiblingFile (file.getFileName() + ".tmp");
+    
+    {
+        juce::FileOutputStream out (temp);
+        if (out.failedToOpen() || ! out.setPosition (0) || out.truncate().failed())
+            return false;
+        
+        juce::MemoryOutputStream payload;
+        payload.writeInt ((int) text.getNumBytesAsUTF8());
+        payload.write (text.toRawUTF8(), text.getNumBytesAsUTF8());
+        (todos.isValid() ? todos : juce::ValueTree (todoItemsId)).writeToStream (payload);
+        
+        out.writeInt (magic);
+        out.writeInt (currentVersion);
+        writeRecord (out, checkpoint, revision, payload);
+        
+        // On disk before it replaces the old journal, so a crash leaves one or the other
+        out.flush();
+        if (out.getStatus().failed())
+            return false;
+    }
+    
+    if (! temp.replaceFileIn (file))
+        return false;
+    
+    stream = std::make_unique<juce::FileOutputStream> (file);
+    if (stream->failedToOpen())
+        return false;
+    
+    checkpointSize = stream->getPosition();
+    recordsSinceCheckpoint = 0;
+    return true;
+}
+
+bool SessionJournal::appendChanges (const juce::String& text, const juce::ValueTree& todos, juce::uint64 revision)
+{
+    juce::MemoryOutputStream records;
+    int numRecords = 0;
+    
+    if (text != writtenText)
+    {
+        // Only the bytes between the common prefix and suffix changed. Both ends are
+        // moved back onto character boundaries so the record is valid UTF-8 on its own.
+        auto oldText = writtenText.toRawUTF8();
+        auto newText = text.toRawUTF8();
+        auto oldSize = writtenText.getNumBytesAsUTF8();
+        auto newSize = text.getNumBytesAsUTF8();
+        auto shorter = juce::jmin (oldSize, newSize);
+        
+        size_t prefix = 0;
+        while (prefix < shorter && oldText[prefix] == newText[prefix])
+            ++prefix;
+        
+        while (prefix > 0 && (isContinuationByte (oldText, oldSize, prefix) || isContinuationByte (newText, newSize, prefix)))
+            --prefix;
+        
+        size_t suffix = 0;
+        while (suffix < shorter - prefix && oldText[oldSize - 1 - suffix] == newText[newSize - 1 - suffix])
+            ++suffix;
+        
+        while (suffix > 0 && isContinuationByte (oldText, oldSize, oldSize - suffix))
+            --suffix;
+        
+        juce::MemoryOutputStream payload;
+        payload.writeInt ((int) prefix);
+        payload.writeInt ((int) (oldSize - prefix - suffix));
+        payload.writeInt ((int) (newSize - prefix - suffix));
+        payload.write (newText + prefix, newSize - prefix - suffix);
+        writeRecord (records, notesEdit, revision, payload);
+        ++numRecords;
+    }
+    
+    // Todos are matched by id. The run between the unchanged ends is replaced as a whole,
+    // which covers adding and deleting an item. Items kept on either side are rewritten
+    // in place if any of their properties changed.
+    auto oldCount = writtenTodos.getNumChildren();
+    auto newCount = todos.getNumChildren();
+    auto shorterCount = juce::jmin (oldCount, newCount);
+    
+    int prefix = 0;
+    while (prefix < shorterCount && haveSameId (writtenTodos.getChild (prefix), todos.getChild (prefix)))
+        ++prefix;
+    
+    int suffix = 0;
+    while (suffix < shorterCount - prefix && haveSameId (writtenTodos.getChild (oldCount - 1 - suffix), todos.getChild (newCount - 1 - suffix)))
+        ++suffix;
+    
+    if (prefix + suffix < juce::jmax (oldCount, newCount))
+    {
+        juce::MemoryOutputStream payload;
+        payload.writeInt (prefix);
+        payload.writeInt (oldCount - prefix - suffix);
+        payload.writeInt (newCount - prefix - suffix);
+        for (int i = prefix; i < newCount - suffix; ++i)
+            todos.getChild (i).writeToStream (payload);
+        
+        writeRecord (records, todoSplice, revision, payload);
+        ++numRecords;
+    }
+    
+    auto writeIfChanged = [&] (int oldIndex, int newIndex)
+    {
+        auto node = todos.getChild (newIndex);
+        if (node.isEquivalentTo (writtenTodos.getChild (oldIndex)))
+            return;
+        
+        juce::MemoryOutputStream payload;
+        payload.writeInt (newIndex);
+        node.writeToStream (payload);
+        writeRecord (records, todoSet, revision, payload);
+        ++numRecords;
+    };
+    
+    for (int i = 0; i < prefix; ++i)
+        writeIfChanged (i, i);
+    
+    for (int i = 1; i <= suffix; ++i)
+        writeIfChanged (oldCount - i, newCount - i);
+    
+    if (numRecords == 0)
+        return true;
+    
+    // One write and one sync for the whole batch
+    stream->write (records.getData(), records.getDataSize());
+    stream->flush();
+    if (stream->getStatus().failed())
+        return false;
+    
+    recordsSinceCheckpoint += numRecords;
+    return true;
+}
+
+//==============================================================================
+bool SessionJournal::readJournal (const juce::File& file, Recovery& result)
+{
+    juce::FileInputStream in (file);
+    if (in.failedToOpen() || in.readInt() != magic || in.readInt() != currentVersion)
+        return false;
+    
+    juce::MemoryBlock notes;
+    juce::ValueTree todos;
+    bool hasCheckpoint = false;
+    
+    while (in.getNumBytesRemaining() > 0)
+    {
+        auto bodySize = in.readInt();
+        if (bodySize < recordHeaderSize || bodySize > in.getNumBytesRemaining() - (juce::int64) sizeof (juce::int32))
+            break;
+        
+        juce::MemoryBlock body;
+        in.readIntoMemoryBlock (body, bodySize);
+        if ((juce::uint32) in.readInt() != getChecksum (body.getData(), body.getSize()))
+            break;
+        
+        juce::MemoryInputStream record (body, false);
+        auto type = record.readInt();
+        auto revision = (juce::uint64) record.readInt64();
+        
+        if (type == checkpoint)
+        {
+            auto size = record.readInt();
+            if (size < 0 || size > record.getNumBytesRemaining())
+                break;
+            
+            notes.setSize ((size_t) size);
+            record.read (notes.getData(), size);
+            todos = juce::ValueTree::readFromStream (record);
+            hasCheckpoint = todos.isValid();
+        }
+        else if (! hasCheckpoint)
+        {
+            break;
+        }
+        else if (type == notesEdit)
+        {
+            auto start = record.readInt();
+            auto removed = record.readInt();
+            auto size = record.readInt();
+            if (start < 0 || removed < 0 || size < 0 || (size_t) start + (size_t) removed > notes.getSize()
+                || size > record.getNumBytesRemaining())
+                break;
+            
+            notes.removeSection ((size_t) start, (size_t) removed);
+            notes.insert (juce::addBytesToPointer (body.getData(), (int) record.getPosition()), (size_t) size, (size_t) start);
+        }
+        else if (type == todoSplice)
+        {
+            auto index = record.readInt();
+            auto removed = record.readInt();
+            auto count = record.readInt();
+            if (index < 0 || removed < 0 || count < 0 || index + removed > todos.getNumChildren())
+                break;
+            
+            for (int i = 0; i < removed; ++i)
+                todos.removeChild (index, nullptr);
+            
+            for (int i = 0; i < count; ++i)
+                todos.addChild (juce::ValueTree::readFromStream (record), index + i, nullptr);
+        }
+        else if (type == todoSet)
+        {
+            auto index = record.readInt();
+            auto node = todos.getChild (index);
+            if (! node.isValid())
+                break;
+            
+            node.copyPropertiesAndChildrenFrom (juce::ValueTree::readFromStream (record), nullptr);
+        }
+        else
+        {
+            break;
+        }
+        
+        result.revision = revision;
+    }
+    
+    if (! hasCheckpoint)
+        return false;
+    
+    result.sessionText = juce::String::fromUTF8 (static_cast<const char*> (notes.getData()), (int) notes.getSize());
+    result.todoItems = todos;
+    return true;
+}
+
+void SessionJournal::deleteStaleJournals()
+{
+    // Journals of projects that were never opened again
+    auto cutoff = juce::Time::getCurrentTime() - juce::RelativeTime::days (staleJournalDays);
+    
+    for (const auto& entry : juce::RangedDirectoryIterator (getJournalDirectory(), false, "*.journal;*.tmp", juce::File::findFiles))
+    {
+        if (entry.getModificationTime() >= cutoff)
+            continue;
+        
+        const juce::ScopedLock sl (claimedIdsLock);
+        if (! claimedIds.contains (entry.getFile().getFileNameWithoutExtension()))
+            entry.getFile().deleteFile();
+    }
+}
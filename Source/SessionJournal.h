@@ -0,0 +1,171 @@
+/*
+  ==============================================================================
+
+    Crash journal: notes and todo edits appended to a local file as they
+    happen, so they survive the host going down before the project is saved.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+class SessionJournal;
+
+//==============================================================================
+/**
+ * The one thread that writes the journals of every instance in the process, held
+ * through a juce::SharedResourcePointer so it lives as long as any journal does.
+ *
+ * Each journal keeps its own queue. The thread goes round the journals that have
+ * work and are due, and sleeps until the next one is. The list is only locked
+ * while one journal is being written, so a journal going away waits for at most
+ * that one write.
+ */
+class SessionJournalWriter : private juce::Thread
+{
+public:
+    SessionJournalWriter();
+    ~SessionJournalWriter() override;
+    
+    void addJournal (SessionJournal* journal);
+    void removeJournal (SessionJournal* journal); // returns once the thread is done with it
+    void journalChanged() { notify(); }
+    
+private:
+    juce::CriticalSection journalsLock;
+    juce::Array<SessionJournal*> journals;
+    
+    void run() override;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SessionJournalWriter)
+};
+
+//==============================================================================
+/**
+ * Append-only journal of one instance's content, written by the shared
+ * SessionJournalWriter thread.
+ *
+ * The message thread only hands over the state snapshots the processor publishes
+ * anyway. The writer diffs the newest one against what it wrote last and appends
+ * the difference: a byte range of the notes, a run of todo nodes replaced, or a
+ * todo node rewritten in place. Whatever arrives while a write is in progress is
+ * batched into the next one, and the file is synced at most once per
+ * flushIntervalMs, so a burst of typing costs one small append and one fsync.
+ *
+ * File layout (all integers little-endian):
+ *   int32  magic           'M1NJ'
+ *   int32  version
+ *   records, each:
+ *     int32   bodySize
+ *     ...     body         int32 type, int64 revision, then the type's payload
+ *     uint32  checksum     FNV-1a of the body
+ *
+ * The first record is always a checkpoint holding the whole content. Replay stops
+ * at the first torn or corrupt record, everything before it is still recovered.
+ * Once the deltas outgrow the checkpoint the file is compacted: a new checkpoint
+ * is written to a temporary file, synced and renamed over the journal.
+ *
+ * Revisions are the processor's content generations, which are saved with the
+ * state. A journal whose last revision is past the restored one holds edits made
+ * after that state was saved, and is offered for recovery. A journal is deleted
+ * when its instance shuts down cleanly, so only crashed sessions leave one behind.
+ */
+class SessionJournal
+{
+public:
+    static constexpr int magic = 0x4a4e314d; // "M1NJ" read as a little-endian int32
+    static constexpr int currentVersion = 1;
+    
+    static constexpr int flushIntervalMs = 1000;
+    static constexpr int maxRecordsBeforeCompaction = 1000;
+    static constexpr juce::int64 compactionSlackBytes = 256 * 1024;
+    static constexpr int staleJournalDays = 30;
+    
+    SessionJournal();
+    ~SessionJournal();
+    
+    //==============================================================================
+    // Message thread. Switches to the journal of the given instance and returns the id
+    // actually used: a fresh one if another instance in this process already has it
+    // (a duplicated track, say). With checkForRecovery, an existing journal that got
+    // further than restoredRevision is kept and offered, any other one is discarded.
+    juce::String setInstance (const juce::String& instanceId, juce::uint64 restoredRevision, bool checkForRecovery);
+    
+    // Message thread. A published, never modified copy of the state. Only the newest
+    // one waiting is written, older ones are skipped.
+    void submit (const juce::ValueTree& state, juce::uint64 revision);
+    
+    //==============================================================================
+    struct Recovery
+    {
+        juce::String sessionText;
+        juce::ValueTree todoItems;
+        juce::uint64 revision = 0;
+    };
+    
+    // Nothing is written to the journal while a recovery is waiting, so it is still
+    // there if the host goes down again before the user has decided
+    bool isRecoveryAvailable() const { return recoveryAvailable.load(); }
+    bool getRecovery (Recovery& recovery) const;
+    
+    // Restored or declined. The journal starts over from the next state submitted.
+    void recoveryResolved();
+    
+    static juce::File getJournalDirectory();
+    
+private:
+    friend class SessionJournalWriter;
+    
+    enum RecordType
+    {
+        checkpoint = 1,
+        notesEdit = 2,  // int32 byte offset, int32 bytes removed, int32 size, inserted UTF-8
+        todoSplice = 3, // int32 index, int32 nodes removed, int32 count, inserted nodes
+        todoSet = 4     // int32 index, node
+    };
+    
+    // Handed over by the message thread, swapped out by the writer under the lock
+    juce::CriticalSection pendingLock;
+    juce::ValueTree pendingState;
+    juce::uint64 pendingRevision = 0;
+    bool hasPendingState = false;
+    juce::String pendingInstanceId;
+    juce::uint64 pendingRestoredRevision = 0;
+    bool pendingCheckForRecovery = false;
+    bool hasPendingInstance = false;
+    bool pendingResolve = false;
+    
+    juce::String claimedInstanceId; // message thread
+    
+    mutable juce::CriticalSection recoveryLock;
+    Recovery recovery;
+    std::atomic<bool> recoveryAvailable { false };
+    
+    juce::SharedResourcePointer<SessionJournalWriter> writer;
+    
+    // Writer thread only
+    juce::uint32 nextWriteTime = 0; // bounds the fsyncs of this journal
+    juce::String instanceId;
+    std::unique_ptr<juce::FileOutputStream> stream;
+    juce::String writtenText;
+    juce::ValueTree writtenTodos;
+    bool hasBase = false;
+    bool holdForRecovery = false;
+    int recordsSinceCheckpoint = 0;
+    juce::int64 checkpointSize = 0;
+    
+    bool hasWork();
+    void processPending();
+    void switchInstance (const juce::String& newId, juce::uint64 restoredRevision, bool checkForRecovery);
+    void writeState (const juce::ValueTree& state, juce::uint64 revision);
+    bool writeCheckpoint (const juce::String& text, const juce::ValueTree& todos, juce::uint64 revision);
+    bool appendChanges (const juce::String& text, const juce::ValueTree& todos, juce::uint64 revision);
+    static void deleteStaleJournals();
+    
+    static juce::File getJournalFile (const juce::String& id);
+    static bool readJournal (const juce::File& file, Recovery& result);
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SessionJournal)
+};
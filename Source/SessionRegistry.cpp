@@ -0,0 +1,607 @@
+/*
+  ==============================================================================
+
+    Registry shared by every instance in the process, with one search index
+    and an overview of all their notes and open todos.
+
+  ==============================================================================
+*/
+
+#include "SessionRegistry.h"
+#include "StateChunk.h"
+#include <algorithm>
+
+namespace
+{
+    const juce::Identifier sessionTextId ("SessionText");
+    const juce::Identifier todoItemsId ("TodoItems");
+    const juce::Identifier idId ("Id");
+    const juce::Identifier textId ("Text");
+    const juce::Identifier checkedId ("Checked");
+    const juce::Identifier priorityId ("Priority");
+    const juce::Identifier tagsId ("Tags");
+    
+    juce::String getDefaultName (int serial)
+    {
+        return "Instance " + juce::String (serial);
+    }
+    
+    // First non-empty line and the number of lines, in one pass over the notes
+    void summariseNotes (const juce::String& notes, juce::String& preview, int& numLines)
+    {
+        preview = {};
+        numLines = notes.isEmpty() ? 0 : 1;
+        
+        auto lineStart = notes.getCharPointer();
+        for (auto p = lineStart; ! p.isEmpty();)
+        {
+            auto c = p.getAndAdvance();
+            if (c != '\n')
+                continue;
+            
+            if (preview.isEmpty())
+                preview = juce::String (lineStart, p).trim();
+            
+            lineStart = p;
+            ++numLines;
+        }
+        
+        if (preview.isEmpty())
+            preview = juce::String (lineStart).trim();
+        
+        preview = preview.substring (0, SessionRegistry::notesPreviewLength);
+    }
+}
+
+//==============================================================================
+SessionRegistry::SessionRegistry()
+    : juce::Thread ("M1-Notepad session registry")
+{
+    startThread();
+}
+
+SessionRegistry::~SessionRegistry()
+{
+    signalThreadShouldExit();
+    notify();
+    stopThread (4000);
+    cancelPendingUpdate();
+}
+
+SearchIndex::Key SessionRegistry::makeKey (int serial, juce::int64 todoId)
+{
+    return ((SearchIndex::Key) serial << serialShift) | (todoId & (((SearchIndex::Key) 1 << serialShift) - 1));
+}
+
+//==============================================================================
+int SessionRegistry::addInstance()
+{
+    auto serial = nextSerial++;
+    setInstanceName (serial, {});
+    return serial;
+}
+
+void SessionRegistry::removeInstance (int serial)
+{
+    {
+        const juce::ScopedLock sl (pendingLock);
+        auto& change = pending[serial];
+        change = {};
+        change.removed = true;
+    }
+    
+    notify();
+}
+
+void SessionRegistry::setInstanceName (int serial, const juce::String& name)
+{
+    {
+        const juce::ScopedLock sl (pendingLock);
+        auto& change = pending[serial];
+        if (change.removed)
+            return;
+        
+        change.name = name.isNotEmpty() ? name : getDefaultName (serial);
+        change.hasName = true;
+    }
+    
+    notify();
+}
+
+void SessionRegistry::submit (int serial, const juce::ValueTree& state, juce::uint64 revision,
+                              StateChunk::StoredContent::Ptr storedContent)
+{
+    {
+        const juce::ScopedLock sl (pendingLock);
+        auto& change = pending[serial];
+        if (change.removed)
+            return;
+        
+        change.state = state;
+        change.revision = revision;
+        change.storedContent = std::move (storedContent);
+        change.hasState = true;
+    }
+    
+    notify();
+}
+
+//==============================================================================
+std::vector<SessionRegistry::Entry::Ptr> SessionRegistry::getEntries() const
+{
+    std::vector<Entry::Ptr> result;
+    
+    const juce::ScopedLock sl (entriesLock);
+    result.reserve (entries.size());
+    for (const auto& entry : entries)
+        result.push_back (entry.second);
+    
+    return result;
+}
+
+SessionRegistry::Entry::Ptr SessionRegistry::getEntry (int serial) const
+{
+    const juce::ScopedLock sl (entriesLock);
+    auto found = entries.find (serial);
+    return found != entries.end() ? found->second : nullptr;
+}
+
+std::vector<SessionRegistry::Match> SessionRegistry::search (const juce::String& query) const
+{
+    std::vector<Match> result;
+    if (query.isEmpty())
+        return result;
+    
+    std::vector<SearchIndex::Key> keys;
+    std::vector<int> notesSerials;
+    {
+        const juce::ScopedLock sl (indexLock);
+        keys = index.search (query);
+        
+        for (const auto& notes : notesIndices)
+            if (! notes.second.findMatches (query, 1).isEmpty())
+                notesSerials.push_back (notes.first);
+    }
+    
+    result.reserve (keys.size() + notesSerials.size());
+    for (auto key : keys)
+        result.push_back ({ (int) (key >> serialShift), key & (((SearchIndex::Key) 1 << serialShift) - 1) });
+    
+    for (auto serial : notesSerials)
+        result.push_back ({ serial, 0 });
+    
+    return result;
+}
+
+//==============================================================================
+void SessionRegistry::run()
+{
+    while (! threadShouldExit())
+    {
+        processPending();
+        wait (-1);
+    }
+}
+
+void SessionRegistry::processPending()
+{
+    std::map<int, Pending> changes;
+    {
+        const juce::ScopedLock sl (pendingLock);
+        std::swap (changes, pending);
+    }
+    
+    bool anyRemoved = false;
+    
+    for (auto& change : changes)
+    {
+        if (threadShouldExit())
+            return;
+        
+        if (change.second.removed)
+        {
+            remove (change.first);
+            anyRemoved = true;
+        }
+        else
+        {
+            update (change.first, change.second);
+        }
+    }
+    
+    // Names and tags nobody uses any more
+    if (anyRemoved)
+        stringPool.garbageCollect();
+}
+
+void SessionRegistry::update (int serial, Pending& change)
+{
+    auto& instance = indexed[serial];
+    auto previous = getEntry (serial);
+    
+    bool nameChanged = change.hasName && change.name != instance.name;
+    if (nameChanged)
+        instance.name = stringPool.getPooledString (change.name);
+    else if (instance.name.isEmpty())
+        instance.name = stringPool.getPooledString (getDefaultName (serial));
+    
+    // Content that is still stored only needs decoding when it isn't the one last read,
+    // stored content is never modified so comparing the pointers is enough
+    juce::ValueTree state;
+    if (change.hasState)
+    {
+        if (change.storedContent != nullptr)
+        {
+            if (! instance.hasContent || change.storedContent != instance.storedContent)
+            {
+                state = change.state.createCopy();
+                if (! StateChunk::readContent (change.storedContent->data, state))
+                    state = {};
+                
+                instance.storedContent = std::move (change.storedContent);
+            }
+        }
+        else if (! instance.hasContent || change.revision != instance.revision)
+        {
+            state = change.state;
+            instance.storedContent = nullptr;
+        }
+        
+        instance.revision = change.revision;
+    }
+    
+    if (! state.isValid() && ! nameChanged && previous != nullptr)
+        return;
+    
+    Entry::Ptr entry = new Entry();
+    entry->serial = serial;
+    entry->name = instance.name;
+    entry->revision = instance.revision;
+    
+    if (! state.isValid())
+    {
+        // Only the name moved on, the content summary stays as it was
+        if (previous != nullptr)
+        {
+            entry->notesPreview = previous->notesPreview;
+            entry->numNotesLines = previous->numNotesLines;
+            entry->numTodos = previous->numTodos;
+            entry->openTodos = previous->openTodos;
+        }
+        
+        publish (serial, entry);
+        return;
+    }
+    
+    auto notes = state.getProperty (sessionTextId).toString();
+    summariseNotes (notes, entry->notesPreview, entry->numNotesLines);
+    
+    // Documents as the editor indexes them: the text, then the tags on a line of their own
+    auto todoItems = state.getChildWithName (todoItemsId);
+    std::unordered_map<juce::int64, juce::String> documents;
+    documents.reserve ((size_t) todoItems.getNumChildren());
+    
+    for (const auto& node : todoItems)
+    {
+        auto text = node.getProperty (textId).toString();
+        if (text.isEmpty())
+            continue;
+        
+        auto id = static_cast<juce::int64> (node.getProperty (idId, 0));
+        auto tags = node.getProperty (tagsId).toString();
+        ++entry->numTodos;
+        
+        // Items restored from before ids existed get one when the editor opens, until
+        // then they're listed but can't be searched for
+        if (id > 0)
+            documents[id] = tags.isEmpty() ? text : text + "\n" + tags;
+        
+        if (static_cast<bool> (node.getProperty (checkedId)))
+            continue;
+        
+        TodoSummary summary;
+        summary.id = id;
+        summary.text = text;
+        summary.priority = juce::jlimit (0, 2, static_cast<int> (node.getProperty (priorityId, 0)));
+        
+        for (const auto& tag : juce::StringArray::fromTokens (tags, " ", ""))
+            if (tag.isNotEmpty())
+                summary.tags.add (stringPool.getPooledString (tag));
+        
+        entry->openTodos.push_back (std::move (summary));
+    }
+    
+    {
+        // Only what differs from this instance's last state is re-indexed
+        const juce::ScopedLock sl (indexLock);
+        
+        for (const auto& document : instance.todoDocuments)
+            if (documents.find (document.first) == documents.end())
+                index.removeDocument (makeKey (serial, document.first));
+        
+        for (const auto& document : documents)
+        {
+            auto old = instance.todoDocuments.find (document.first);
+            if (old == instance.todoDocuments.end() || old->second != document.second)
+                index.setDocument (makeKey (serial, document.first), document.second);
+        }
+        
+        // The notes are indexed by line, an edit re-indexes the lines it touched
+        if (! instance.hasContent || notes != instance.notes)
+        {
+            if (notes.isNotEmpty())
+                notesIndices[serial].update (notes);
+            else
+                notesIndices.erase (serial);
+        }
+    }
+    
+    instance.todoDocuments = std::move (documents);
+    instance.notes = notes;
+    instance.hasContent = true;
+    
+    publish (serial, entry);
+}
+
+void SessionRegistry::remove (int serial)
+{
+    auto found = indexed.find (serial);
+    if (found != indexed.end())
+    {
+        const juce::ScopedLock sl (indexLock);
+        
+        for (const auto& document : found->second.todoDocuments)
+            index.removeDocument (makeKey (serial, document.first));
+        
+        notesIndices.erase (serial);
+        indexed.erase (found);
+    }
+    
+    publish (serial, nullptr);
+}
+
+void SessionRegistry::publish (int serial, Entry::Ptr entry)
+{
+    {
+        const juce::ScopedLock sl (entriesLock);
+        if (entry != nullptr)
+            std::swap (entries[serial], entry);
+        else
+            entries.erase (serial);
+    }
+    
+    // entry now holds the previous summary, released here rather than under the lock
+    {
+        const juce::ScopedLock sl (changedLock);
+        changedSerials.addIfNotAlreadyThere (serial);
+    }
+    
+    triggerAsyncUpdate();
+}
+
+void SessionRegistry::handleAsyncUpdate()
+{
+    juce::Array<int> serials;
+    {
+        const juce::ScopedLock sl (changedLock);
+        serials.swapWith (changedSerials);
+    }
+    
+    if (! serials.isEmpty())
+        listeners.call ([&serials] (Listener& l) { l.sessionEntriesChanged (serials); });
+}
+
+//==============================================================================
+SessionOverviewComponent::SessionOverviewComponent (SessionRegistry& registryToShow, int serial)
+    : registry (registryToShow), ownSerial (serial)
+{
+    addAndMakeVisible (queryField);
+    queryField.addListener (this);
+    queryField.setMultiLine (false);
+    queryField.setReturnKeyStartsNewLine (false);
+    queryField.setTextToShowWhenEmpty ("Search every track...", juce::Colours::grey);
+    queryField.setColour (juce::TextEditor::backgroundColourId, juce::Colour (30, 30, 30));
+    queryField.setColour (juce::TextEditor::textColourId, juce::Colours::white);
+    
+    addAndMakeVisible (list);
+    list.setModel (this);
+    list.setRowHeight (24);
+    list.setWantsKeyboardFocus (false);
+    list.setColour (juce::ListBox::backgroundColourId, juce::Colours::transparentBlack);
+    
+    registry.addListener (this);
+    rebuildRows();
+}
+
+SessionOverviewComponent::~SessionOverviewComponent()
+{
+    registry.removeListener (this);
+    list.setModel (nullptr);
+}
+
+void SessionOverviewComponent::grabQueryFocus()
+{
+    queryField.grabKeyboardFocus();
+}
+
+void SessionOverviewComponent::paint (juce::Graphics& g)
+{
+    auto bounds = getLocalBounds().toFloat();
+    g.setColour (juce::Colour (24, 24, 24).withAlpha (0.97f));
+    g.fillRoundedRectangle (bounds, 4.0f);
+    g.setColour (juce::Colours::white.withAlpha (0.5f));
+    g.drawRoundedRectangle (bounds.reduced (0.5f), 4.0f, 1.0f);
+}
+
+void SessionOverviewComponent::resized()
+{
+    auto area = getLocalBounds().reduced (8);
+    queryField.setBounds (area.removeFromTop (24));
+    area.removeFromTop (6);
+    list.setBounds (area);
+}
+
+void SessionOverviewComponent::runQuery()
+{
+    matchingTodos.clear();
+    matchingNotes.clear();
+    
+    for (const auto& match : registry.search (queryField.getText()))
+    {
+        if (match.todoId == 0)
+            matchingNotes.insert (match.serial);
+        else
+            matchingTodos.insert (SessionRegistry::makeKey (match.serial, match.todoId));
+    }
+}
+
+void SessionOverviewComponent::appendRows (const SessionRegistry::Entry& entry, std::vector<Row>& dest) const
+{
+    auto filtering = queryField.getText().isNotEmpty();
+    auto headerRow = dest.size();
+    dest.push_back ({ entry.serial, -1 });
+    
+    for (int i = 0; i < (int) entry.openTodos.size(); ++i)
+        if (! filtering || matchingTodos.count (SessionRegistry::makeKey (entry.serial, entry.openTodos[(size_t) i].id)) > 0)
+            dest.push_back ({ entry.serial, i });
+    
+    // While searching, a track is only listed when something in it matched
+    if (filtering && dest.size() == headerRow + 1 && matchingNotes.count (entry.serial) == 0)
+        dest.pop_back();
+}
+
+void SessionOverviewComponent::rebuildRows()
+{
+    shownEntries.clear();
+    rows.clear();
+    
+    for (auto& entry : registry.getEntries())
+    {
+        appendRows (*entry, rows);
+        shownEntries[entry->serial] = entry;
+    }
+    
+    list.updateContent();
+    list.repaint();
+}
+
+void SessionOverviewComponent::replaceRows (int serial)
+{
+    auto first = std::lower_bound (rows.begin(), rows.end(), serial,
+                                   [] (const Row& row, int s) { return row.serial < s; });
+    auto last = std::upper_bound (first, rows.end(), serial,
+                                  [] (int s, const Row& row) { return s < row.serial; });
+    
+    std::vector<Row> replacement;
+    if (auto entry = registry.getEntry (serial))
+    {
+        appendRows (*entry, replacement);
+        shownEntries[serial] = entry;
+    }
+    else
+    {
+        shownEntries.erase (serial);
+    }
+    
+    auto position = rows.erase (first, last);
+    rows.insert (position, replacement.begin(), replacement.end());
+}
+
+void SessionOverviewComponent::sessionEntriesChanged (const juce::Array<int>& serials)
+{
+    // The index only moved on for these instances, so only their rows can differ
+    if (queryField.getText().isNotEmpty())
+        runQuery();
+    
+    for (auto serial : serials)
+        replaceRows (serial);
+    
+    list.updateContent();
+    list.repaint();
+}
+
+void SessionOverviewComponent::textEditorTextChanged (juce::TextEditor&)
+{
+    runQuery();
+    rebuildRows();
+}
+
+void SessionOverviewComponent::textEditorReturnKeyPressed (juce::TextEditor&)
+{
+    chooseRow (list.getSelectedRow());
+}
+
+void SessionOverviewComponent::textEditorEscapeKeyPressed (juce::TextEditor&)
+{
+    if (onDismiss != nullptr)
+        onDismiss();
+}
+
+void SessionOverviewComponent::chooseRow (int row)
+{
+    if (! juce::isPositiveAndBelow (row, (int) rows.size()) || rows[(size_t) row].serial != ownSerial)
+        return;
+    
+    auto found = shownEntries.find (ownSerial);
+    auto todo = rows[(size_t) row].todo;
+    if (found == shownEntries.end() || todo < 0 || onTodoChosen == nullptr)
+        return;
+    
+    auto id = found->second->openTodos[(size_t) todo].id;
+    if (id > 0)
+        onTodoChosen (id);
+}
+
+int SessionOverviewComponent::getNumRows()
+{
+    return (int) rows.size();
+}
+
+void SessionOverviewComponent::paintListBoxItem (int rowNumber, juce::Graphics& g, int width, int height, bool rowIsSelected)
+{
+    if (! juce::isPositiveAndBelow (rowNumber, (int) rows.size()))
+        return;
+    
+    const auto& row = rows[(size_t) rowNumber];
+    auto found = shownEntries.find (row.serial);
+    if (found == shownEntries.end())
+        return;
+    
+    const auto& entry = *found->second;
+    
+    if (rowIsSelected)
+        g.fillAll (juce::Colours::lightblue.withAlpha (0.25f));
+    
+    if (row.todo < 0)
+    {
+        auto title = entry.serial == ownSerial ? entry.name + " (this track)" : entry.name;
+        auto summary = juce::String ((int) entry.openTodos.size()) + " open of " + juce::String (entry.numTodos);
+        if (entry.notesPreview.isNotEmpty())
+            summary << "  -  " << entry.notesPreview;
+        
+        g.setColour (juce::Colours::white);
+        g.setFont (juce::Font (15.0f, juce::Font::bold));
+        g.drawText (title, 6, 0, width / 3 - 6, height, juce::Justification::centredLeft, true);
+        
+        g.setColour (juce::Colours::grey);
+        g.setFont (juce::Font (13.0f));
+        g.drawText (summary, width / 3, 0, width - width / 3 - 6, height, juce::Justification::centredLeft, true);
+        return;
+    }
+    
+    const auto& todo = entry.openTodos[(size_t) row.todo];
+    auto text = todo.text;
+    for (const auto& tag : todo.tags)
+        text << " #" << tag;
+    
+    // Same colours as the todo list
+    g.setColour (todo.priority == 2 ? juce::Colours::red
+                                    : todo.priority == 1 ? juce::Colours::orange : juce::Colours::white);
+    g.setFont (juce::Font (15.0f));
+    g.drawText (text, 24, 0, width - 30, height, juce::Justification::centredLeft, true);
+}
+
+void SessionOverviewComponent::listBoxItemDoubleClicked (int row, const juce::MouseEvent&)
+{
+    chooseRow (row);
+}
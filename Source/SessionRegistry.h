@@ -0,0 +1,226 @@
+/*
+  ==============================================================================
+
+    Registry shared by every instance in the process, with one search index
+    and an overview of all their notes and open todos.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "SearchIndex.h"
+#include "StateChunk.h"
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+//==============================================================================
+/**
+ * Process-wide view of the content of every instance, held through a
+ * juce::SharedResourcePointer so it lives as long as any instance does.
+ *
+ * Instances hand over the state snapshots they publish anyway. A background
+ * thread takes the newest one of each instance that changed, updates that
+ * instance's documents in the shared index (only the todos whose text or tags
+ * differ) and the lines of its notes that were edited, and rebuilds its
+ * summary. Nothing walks the other instances, so an edit on one track costs
+ * the same however many tracks the session has. Tags and track names are
+ * interned, a tag used on every track is stored once.
+ *
+ * Summaries are immutable once published. Listeners are told on the message
+ * thread which instances changed since the last call.
+ */
+class SessionRegistry : private juce::Thread,
+                        private juce::AsyncUpdater
+{
+public:
+    static constexpr int notesPreviewLength = 120;
+    
+    SessionRegistry();
+    ~SessionRegistry() override;
+    
+    //==============================================================================
+    // Message thread. Returns the serial the instance is known by from now on,
+    // serials are never reused within the process.
+    int addInstance();
+    void removeInstance (int serial);
+    
+    // Any thread, e.g. from AudioProcessor::updateTrackProperties
+    void setInstanceName (int serial, const juce::String& name);
+    
+    // Message thread. A published, never modified copy of the state. While its notes and
+    // todos are still in stored form (see StateChunk::readHead) they are shared, not copied,
+    // and decoded on the registry's thread. Only the newest state waiting is used.
+    void submit (int serial, const juce::ValueTree& state, juce::uint64 revision,
+                 StateChunk::StoredContent::Ptr storedContent = nullptr);
+    
+    //==============================================================================
+    struct TodoSummary
+    {
+        juce::int64 id = 0;
+        juce::String text;
+        juce::StringArray tags; // interned
+        int priority = 0;       // 0 low, 1 medium, 2 high
+    };
+    
+    // Never modified once published
+    struct Entry : public juce::ReferenceCountedObject
+    {
+        using Ptr = juce::ReferenceCountedObjectPtr<Entry>;
+        
+        int serial = 0;
+        juce::String name;          // interned, "Instance <serial>" until the host names the track
+        juce::String notesPreview;  // first non-empty line of the notes
+        int numNotesLines = 0;
+        int numTodos = 0;
+        std::vector<TodoSummary> openTodos;
+        juce::uint64 revision = 0;
+    };
+    
+    // Any thread. Ordered by serial, which is the order the instances were created in.
+    std::vector<Entry::Ptr> getEntries() const;
+    Entry::Ptr getEntry (int serial) const; // null once the instance is gone
+    
+    // Any thread. Every instance and todo whose text or tags contain the query,
+    // todoId is 0 when the match is in that instance's notes.
+    struct Match
+    {
+        int serial;
+        juce::int64 todoId;
+    };
+    
+    std::vector<Match> search (const juce::String& query) const;
+    
+    // Keys of the shared todo index: the serial in the top bits, the todo id below
+    static constexpr int serialShift = 40;
+    static SearchIndex::Key makeKey (int serial, juce::int64 todoId);
+    
+    //==============================================================================
+    struct Listener
+    {
+        virtual ~Listener() = default;
+        
+        // Message thread. Entries that were added, updated or removed since the last call.
+        virtual void sessionEntriesChanged (const juce::Array<int>& serials) = 0;
+    };
+    
+    void addListener (Listener* listener)       { listeners.add (listener); }
+    void removeListener (Listener* listener)    { listeners.remove (listener); }
+    
+private:
+    struct Pending
+    {
+        juce::ValueTree state;
+        juce::uint64 revision = 0;
+        StateChunk::StoredContent::Ptr storedContent;
+        juce::String name;
+        bool hasState = false, hasName = false, removed = false;
+    };
+    
+    // Handed over by the instances, swapped out by the thread under the lock
+    juce::CriticalSection pendingLock;
+    std::map<int, Pending> pending;
+    std::atomic<int> nextSerial { 1 };
+    
+    // Thread only: what each instance has in the index
+    struct Indexed
+    {
+        juce::String name;
+        juce::String notes;
+        std::unordered_map<juce::int64, juce::String> todoDocuments;
+        StateChunk::StoredContent::Ptr storedContent; // the one last decoded
+        juce::uint64 revision = 0;
+        bool hasContent = false;
+    };
+    
+    std::map<int, Indexed> indexed;
+    juce::StringPool stringPool;
+    
+    // Held for as long as an update touches the indices, which is only for what changed
+    mutable juce::CriticalSection indexLock;
+    SearchIndex index;                          // every instance's todos
+    std::map<int, NotesSearchIndex> notesIndices; // each instance's notes, by line
+    
+    mutable juce::CriticalSection entriesLock; // only ever held to swap or copy pointers
+    std::map<int, Entry::Ptr> entries;
+    
+    juce::CriticalSection changedLock;
+    juce::Array<int> changedSerials;
+    
+    juce::ListenerList<Listener> listeners;
+    
+    void run() override;
+    void processPending();
+    void update (int serial, Pending& change);
+    void remove (int serial);
+    void publish (int serial, Entry::Ptr entry);
+    void handleAsyncUpdate() override;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SessionRegistry)
+};
+
+//==============================================================================
+/**
+ * Every instance's notes and open todos in one list, shown over the editor.
+ *
+ * Rows are kept grouped by instance. When the registry reports a change only
+ * that instance's rows are replaced, the rest of the list is left alone. The
+ * query field filters through the registry's shared index.
+ */
+class SessionOverviewComponent : public juce::Component,
+                                 private SessionRegistry::Listener,
+                                 private juce::TextEditor::Listener,
+                                 private juce::ListBoxModel
+{
+public:
+    SessionOverviewComponent (SessionRegistry& registry, int ownSerial);
+    ~SessionOverviewComponent() override;
+    
+    // Only todos of the instance this overview belongs to can be chosen
+    std::function<void (juce::int64 todoId)> onTodoChosen;
+    std::function<void()> onDismiss;
+    
+    void paint (juce::Graphics& g) override;
+    void resized() override;
+    void grabQueryFocus();
+    
+private:
+    struct Row
+    {
+        int serial;
+        int todo; // index into the entry's openTodos, -1 for the instance's header
+    };
+    
+    SessionRegistry& registry;
+    const int ownSerial;
+    
+    juce::TextEditor queryField;
+    juce::ListBox list;
+    
+    std::map<int, SessionRegistry::Entry::Ptr> shownEntries;
+    std::vector<Row> rows; // sorted by serial
+    
+    // Matches of the current query, unused while it's empty
+    std::unordered_set<SearchIndex::Key> matchingTodos;
+    std::unordered_set<int> matchingNotes;
+    
+    void runQuery();
+    void rebuildRows();
+    void replaceRows (int serial);
+    void appendRows (const SessionRegistry::Entry& entry, std::vector<Row>& dest) const;
+    
+    void sessionEntriesChanged (const juce::Array<int>& serials) override;
+    void textEditorTextChanged (juce::TextEditor&) override;
+    void textEditorReturnKeyPressed (juce::TextEditor&) override;
+    void textEditorEscapeKeyPressed (juce::TextEditor&) override;
+    
+    int getNumRows() override;
+    void paintListBoxItem (int rowNumber, juce::Graphics& g, int width, int height, bool rowIsSelected) override;
+    void listBoxItemDoubleClicked (int row, const juce::MouseEvent&) override;
+    void chooseRow (int row);
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SessionOverviewComponent)
+};
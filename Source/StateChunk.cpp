@@ -0,0 +1,246 @@
+/*
+  ==============================================================================
+
+    Versioned binary chunk format used by get/setStateInformation.
+
+  ==============================================================================
+*/
+
+#include "StateChunk.h"
+
+namespace
+{
+    const juce::Identifier sessionTextId ("SessionText");
+    const juce::Identifier todoItemsId ("TodoItems");
+    
+    // flags, storedSize, rawSize and the (possibly deflated) bytes
+    void writeSection (juce::OutputStream& out, const void* raw, size_t rawSize)
+    {
+        int flags = 0;
+        const void* payload = raw;
+        auto storedSize = rawSize;
+        
+        juce::MemoryOutputStream deflated;
+        if (rawSize >= (size_t) StateChunk::compressionThreshold)
+        {
+            {
+                // Fastest zlib level - notes are plain text and still shrink a lot
+                juce::GZIPCompressorOutputStream zipper (deflated, 1);
+                zipper.write (raw, rawSize);
+            }
+            
+            if (deflated.getDataSize() < rawSize)
+            {
+                flags |= StateChunk::compressed;
+                payload = deflated.getData();
+                storedSize = deflated.getDataSize();
+            }
+        }
+        
+        out.writeInt (flags);
+        out.writeInt ((int) storedSize);
+        out.writeInt ((int) rawSize);
+        out.write (payload, storedSize);
+    }
+    
+    // Returns the number of bytes the section occupies, or -1 if it doesn't fit the data
+    int checkSection (const void* data, int sizeInBytes)
+    {
+        if (sizeInBytes < StateChunk::sectionHeaderSize)
+            return -1;
+        
+        juce::MemoryInputStream in (data, (size_t) sizeInBytes, false);
+        in.readInt(); // flags
+        auto storedSize = in.readInt();
+        auto rawSize = in.readInt();
+        
+        if (storedSize < 0 || rawSize < 0 || storedSize > sizeInBytes - StateChunk::sectionHeaderSize)
+            return -1;
+        
+        return StateChunk::sectionHeaderSize + storedSize;
+    }
+    
+    // Decodes a section checked by checkSection(). Fails unless the payload comes out at
+    // exactly the raw size its header gives, so truncated or corrupt data is never parsed.
+    bool readSection (const void* data, int sectionSize, juce::MemoryBlock& raw)
+    {
+        juce::MemoryInputStream in (data, (size_t) sectionSize, false);
+        auto flags = in.readInt();
+        auto storedSize = in.readInt();
+        auto rawSize = in.readInt();
+        
+        juce::MemoryInputStream payload (juce::addBytesToPointer (data, StateChunk::sectionHeaderSize), (size_t) storedSize, false);
+        raw.reset();
+        
+        if ((flags & StateChunk::compressed) != 0)
+        {
+            juce::GZIPDecompressorInputStream unzipper (payload);
+            unzipper.readIntoMemoryBlock (raw, rawSize);
+            
+            // Anything left over means the header and payload disagree
+            char extra;
+            if (unzipper.read (&extra, 1) > 0)
+                return false;
+        }
+        else
+        {
+            if (storedSize != rawSize)
+                return false;
+            
+            payload.readIntoMemoryBlock (raw, rawSize);
+        }
+        
+        return raw.getSize() == (size_t) rawSize;
+    }
+    
+    void writeHead (juce::OutputStream& out, const juce::ValueTree& state)
+    {
+        // Everything except the notes content: parameter nodes and small flags
+        juce::ValueTree head (state.getType());
+        head.copyPropertiesFrom (state, nullptr);
+        head.removeProperty (sessionTextId, nullptr);
+        
+        for (const auto& child : state)
+            if (! child.hasType (todoItemsId))
+                head.appendChild (child.createCopy(), nullptr);
+        
+        juce::MemoryOutputStream headStream;
+        head.writeToStream (headStream);
+        
+        out.writeInt (StateChunk::magic);
+        out.writeInt (StateChunk::currentVersion);
+        out.writeInt ((int) headStream.getDataSize());
+        out.write (headStream.getData(), headStream.getDataSize());
+    }
+}
+
+//==============================================================================
+void StateChunk::write (const juce::ValueTree& state, juce::MemoryBlock& destData)
+{
+    // The content is streamed straight from the live nodes, no copy of the todo tree is made
+    juce::MemoryOutputStream content;
+    content.writeString (state.getProperty (sessionTextId).toString());
+    state.getChildWithName (todoItemsId).writeToStream (content);
+    
+    juce::MemoryOutputStream out (destData, false);
+    writeHead (out, state);
+    writeSection (out, content.getData(), content.getDataSize());
+}
+
+void StateChunk::writeContent (const juce::ValueTree& state, juce::MemoryBlock& destData)
+{
+    juce::MemoryOutputStream content;
+    content.writeString (state.getProperty (sessionTextId).toString());
+    state.getChildWithName (todoItemsId).writeToStream (content);
+    
+    juce::MemoryOutputStream out (destData, false);
+    writeSection (out, content.getData(), content.getDataSize());
+}
+
+void StateChunk::write (const juce::ValueTree& state, const juce::MemoryBlock& storedContent, juce::MemoryBlock& destData)
+{
+    juce::MemoryOutputStream out (destData, false);
+    writeHead (out, state);
+    out.write (storedContent.getData(), storedContent.getSize());
+}
+
+juce::ValueTree StateChunk::read (const void* data, int sizeInBytes)
+{
+    auto version = getVersion (data, sizeInBytes);
+    
+    if (version == 1)
+    {
+        // Single section holding the whole tree, right after magic and version
+        auto section = juce::addBytesToPointer (data, 2 * (int) sizeof (juce::int32));
+        auto sectionSize = checkSection (section, sizeInBytes - 2 * (int) sizeof (juce::int32));
+        
+        juce::MemoryBlock raw;
+        if (sectionSize <= 0 || ! readSection (section, sectionSize, raw))
+            return {};
+        
+        return juce::ValueTree::readFromData (raw.getData(), raw.getSize());
+    }
+    
+    juce::MemoryBlock storedContent;
+    auto state = readHead (data, sizeInBytes, storedContent);
+    
+    if (state.isValid() && ! readContent (storedContent, state))
+        return {};
+    
+    return state;
+}
+
+juce::ValueTree StateChunk::readHead (const void* data, int sizeInBytes, juce::MemoryBlock& storedContent)
+{
+    if (getVersion (data, sizeInBytes) != 2)
+        return {};
+    
+    juce::MemoryInputStream in (data, (size_t) sizeInBytes, false);
+    in.readInt(); // magic
+    in.readInt(); // version
+    auto headSize = in.readInt();
+    
+    // Checked against what's left before adding, a corrupt size near INT_MAX would overflow
+    if (headSize <= 0 || headSize > sizeInBytes - 3 * (int) sizeof (juce::int32))
+        return {};
+    
+    auto contentOffset = 3 * (int) sizeof (juce::int32) + headSize;
+    auto contentData = juce::addBytesToPointer (data, contentOffset);
+    auto contentSize = checkSection (contentData, sizeInBytes - contentOffset);
+    
+    if (contentSize < 0)
+        return {};
+    
+    auto state = juce::ValueTree::readFromData (juce::addBytesToPointer (data, 3 * (int) sizeof (juce::int32)), (size_t) headSize);
+    
+    if (state.isValid())
+        storedContent.replaceAll (contentData, (size_t) contentSize);
+    
+    return state;
+}
+
+bool StateChunk::readContent (const juce::MemoryBlock& storedContent, juce::ValueTree& state)
+{
+    auto sectionSize = checkSection (storedContent.getData(), (int) storedContent.getSize());
+    if (sectionSize < 0)
+        return false;
+    
+    juce::MemoryBlock raw;
+    if (! readSection (storedContent.getData(), sectionSize, raw))
+        return false;
+    
+    // Both parts have to use up the content exactly, the state is only touched once they do
+    juce::MemoryInputStream in (raw, false);
+    auto sessionText = in.readString();
+    auto todoItems = juce::ValueTree::readFromStream (in);
+    
+    if (! in.isExhausted())
+        return false;
+    
+    state.setProperty (sessionTextId, sessionText, nullptr);
+    
+    auto oldTodoItems = state.getChildWithName (todoItemsId);
+    if (oldTodoItems.isValid())
+        state.removeChild (oldTodoItems, nullptr);
+    
+    if (todoItems.isValid())
+        state.appendChild (todoItems, nullptr);
+    
+    return true;
+}
+
+bool StateChunk::isStateChunk (const void* data, int sizeInBytes)
+{
+    return data != nullptr
+        && sizeInBytes >= 2 * (int) sizeof (juce::int32)
+        && (int) juce::ByteOrder::littleEndianInt (data) == magic;
+}
+
+int StateChunk::getVersion (const void* data, int sizeInBytes)
+{
+    if (! isStateChunk (data, sizeInBytes))
+        return 0;
+    
+    auto version = (int) juce::ByteOrder::littleEndianInt (juce::addBytesToPointer (data, (int) sizeof (juce::int32)));
+    return version <= currentVersion ? version : 0;
+}
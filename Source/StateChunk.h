@@ -0,0 +1,81 @@
+/*
+  ==============================================================================
+
+    Versioned binary chunk format used by get/setStateInformation.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+ * Serializes the plugin state as a small header followed by ValueTree binary
+ * streams. Large sections (long notes, big todo lists) are deflated.
+ *
+ * Version 2 (all integers little-endian):
+ *   int32  magic           'M1NP'
+ *   int32  version
+ *   int32  headSize        bytes of the head stream that follows
+ *   ...    head            the state without its content: parameters, TodoMode,
+ *                          InstanceId and the Revision the snapshot was taken at
+ *   int32  flags           see Flags, applies to the content section
+ *   int32  storedSize      bytes of content that follow
+ *   int32  rawSize         bytes of the content stream before compression
+ *   ...    content         SessionText as a string, then the TodoItems tree
+ *
+ * The head is tiny and cheap to parse, so a chunk can be restored without
+ * touching the content section at all, and written back verbatim later.
+ *
+ * Version 1 stored the whole tree in one section:
+ *   int32  magic, version, flags, storedSize, rawSize, then the payload
+ */
+class StateChunk
+{
+public:
+    enum Flags
+    {
+        compressed = 1 << 0
+    };
+    
+    static constexpr int magic = 0x504e314d; // "M1NP" read as a little-endian int32
+    static constexpr int currentVersion = 2;
+    static constexpr int sectionHeaderSize = 3 * (int) sizeof (juce::int32);
+    
+    // Sections smaller than this are stored as-is, deflating them isn't worth the time
+    static constexpr int compressionThreshold = 4096;
+    
+    // A content section as readHead() hands it back. Never modified once filled, so the
+    // processor, its snapshots and the session registry all share one copy of the bytes
+    struct StoredContent : public juce::ReferenceCountedObject
+    {
+        using Ptr = juce::ReferenceCountedObjectPtr<StoredContent>;
+        
+        juce::MemoryBlock data;
+    };
+    
+    static void write (const juce::ValueTree& state, juce::MemoryBlock& destData);
+    
+    // Encodes only the content section of the given state, as readHead() hands it back
+    static void writeContent (const juce::ValueTree& state, juce::MemoryBlock& destData);
+    
+    // Writes the head of the given state with a content section kept from an earlier chunk
+    static void write (const juce::ValueTree& state, const juce::MemoryBlock& storedContent, juce::MemoryBlock& destData);
+    
+    // Parses a whole chunk of any version. Returns an invalid tree if the data can't be read
+    static juce::ValueTree read (const void* data, int sizeInBytes);
+    
+    // Parses only the head of a version 2 chunk. The content section is checked for
+    // consistency and copied into storedContent without being decoded
+    static juce::ValueTree readHead (const void* data, int sizeInBytes, juce::MemoryBlock& storedContent);
+    
+    // Decodes a content section into the given state. Returns false, leaving the state
+    // untouched, if the section is truncated or doesn't decode to what its header says.
+    static bool readContent (const juce::MemoryBlock& storedContent, juce::ValueTree& state);
+    
+    // Cheap header checks, used to tell binary chunks apart from legacy XML ones
+    static bool isStateChunk (const void* data, int sizeInBytes);
+    static int getVersion (const void* data, int sizeInBytes);
+};
@@ -0,0 +1,693 @@
+/*
+  ==============================================================================
+
+    Todo list import and export as Markdown, JSON or CSV, streamed one item
+    at a time on a background thread.
+
+  ==============================================================================
+*/
+
+#include "TodoTransfer.h"
+
+namespace
+{
+    const juce::Identifier todoItemId ("TodoItem");
+    const juce::Identifier textId ("Text");
+    const juce::Identifier checkedId ("Checked");
+    const juce::Identifier priorityId ("Priority");
+    const juce::Identifier dueDateId ("DueDate");
+    const juce::Identifier tagsId ("Tags");
+    const juce::Identifier anchorTimeId ("AnchorTime");
+    
+    constexpr int inputBufferSize = 64 * 1024;
+    
+    juce::StringArray getTags (const juce::ValueTree& item)
+    {
+        return juce::StringArray::fromTokens (item[tagsId].toString(), ", ", "");
+    }
+    
+    void setTags (juce::ValueTree& item, const juce::StringArray& tags)
+    {
+        juce::StringArray cleaned;
+        for (auto tag : tags)
+        {
+            tag = tag.trim().trimCharactersAtStart ("#");
+            if (tag.isNotEmpty())
+                cleaned.add (tag);
+        }
+        
+        if (! cleaned.isEmpty())
+            item.setProperty (tagsId, cleaned.joinIntoString (" "), nullptr);
+    }
+    
+    bool isTruthy (const juce::String& text)
+    {
+        auto value = text.trim().toLowerCase();
+        return value == "x" || value == "true" || value == "yes" || value == "1" || value == "done";
+    }
+    
+    juce::String quoteCsvField (const juce::String& field)
+    {
+        if (! field.containsAnyOf (",\"\r\n"))
+            return field;
+        
+        return "\"" + field.replace ("\"", "\"\"") + "\"";
+    }
+    
+    // Words the Markdown reader takes from the end of an item as its tags, priority and due date
+    bool isMarkdownMetadata (const juce::String& word)
+    {
+        return (word.length() > 1 && word.startsWithChar ('#'))
+            || (word.startsWithChar ('!') && TodoTransfer::priorityFromString (word.substring (1)) >= 0)
+            || (word.startsWithIgnoreCase ("due:") && TodoTransfer::dateFromString (word.substring (4)) != 0);
+    }
+    
+    // A last word that would pass for metadata gets a backslash in front, as Markdown
+    // escapes punctuation, so it stays part of the text. One that already starts with a
+    // backslash gets another, the reader takes exactly one off.
+    juce::String escapeMarkdownText (const juce::String& text)
+    {
+        auto trimmed = text.trimEnd();
+        auto lastWordStart = juce::jmax (trimmed.lastIndexOfChar (' '), trimmed.lastIndexOfChar ('\t')) + 1;
+        auto lastWord = trimmed.substring (lastWordStart);
+        
+        if (! isMarkdownMetadata (lastWord) && ! lastWord.startsWithChar ('\\'))
+            return text;
+        
+        return trimmed.substring (0, lastWordStart) + "\\" + lastWord;
+    }
+}
+
+//==============================================================================
+TodoTransfer::Format TodoTransfer::getFormatForFile (const juce::File& file)
+{
+    if (file.hasFileExtension ("json"))
+        return Format::json;
+    
+    if (file.hasFileExtension ("csv"))
+        return Format::csv;
+    
+    return Format::markdown;
+}
+
+juce::String TodoTransfer::priorityToString (int priority)
+{
+    switch (priority)
+    {
+        case 2:  return "high";
+        case 1:  return "medium";
+        default: return "low";
+    }
+}
+
+int TodoTransfer::priorityFromString (const juce::String& text)
+{
+    auto value = text.trim().toLowerCase();
+    
+    if (value == "high" || value == "h" || value == "2")    return 2;
+    if (value == "medium" || value == "m" || value == "1")  return 1;
+    if (value == "low" || value == "l" || value == "0")     return 0;
+    return -1;
+}
+
+juce::String TodoTransfer::dateToString (juce::int64 milliseconds)
+{
+    return juce::Time (milliseconds).formatted ("%Y-%m-%d");
+}
+
+juce::int64 TodoTransfer::dateFromString (const juce::String& text)
+{
+    // Only the calendar date counts, times of day that follow it are ignored
+    auto parts = juce::StringArray::fromTokens (text.trim().upToFirstOccurrenceOf ("T", false, true), "-", "");
+    if (parts.size() != 3 || ! parts.joinIntoString ({}).containsOnly ("0123456789"))
+        return 0;
+    
+    auto year = parts[0].getIntValue();
+    auto month = parts[1].getIntValue();
+    auto day = parts[2].getIntValue();
+    if (year < 1970 || month < 1 || month > 12 || day < 1 || day > 31)
+        return 0;
+    
+    return juce::Time (year, month - 1, day, 0, 0, 0, 0, true).toMilliseconds();
+}
+
+//==============================================================================
+TodoTransfer::Writer::Writer (juce::OutputStream& outputStream, Format formatToWrite)
+    : out (outputStream), format (formatToWrite)
+{
+    if (format == Format::json)
+        out << "[\n";
+    else if (format == Format::csv)
+        out << "Done,Text,Priority,Due,Tags,Anchor\n";
+}
+
+void TodoTransfer::Writer::writeItem (const juce::ValueTree& item)
+{
+    auto text = item[textId].toString();
+    auto checked = static_cast<bool> (item[checkedId]);
+    auto priority = static_cast<int> (item[priorityId]);
+    auto dueDate = static_cast<juce::int64> (item[dueDateId]);
+    auto tags = getTags (item);
+    
+    if (format == Format::markdown)
+    {
+        // A line break would end the item, the rest of the text stays on its line
+        out << (checked ? "- [x] " : "- [ ] ") << escapeMarkdownText (text.replaceCharacters ("\r\n", "  "));
+        
+        if (priority > 0)
+            out << " !" << priorityToString (priority);
+        
+        if (dueDate != 0)
+            out << " due:" << dateToString (dueDate);
+        
+        for (const auto& tag : tags)
+            out << " #" << tag;
+        
+        out << "\n";
+    }
+    else if (format == Format::json)
+    {
+        // One small object at a time, the array around them is written by hand
+        auto object = std::make_unique<juce::DynamicObject>();
+        object->setProperty ("text", text);
+        object->setProperty ("done", checked);
+        object->setProperty ("priority", priorityToString (priority));
+        
+        if (dueDate != 0)
+            object->setProperty ("due", dateToString (dueDate));
+        
+        if (! tags.isEmpty())
+        {
+            juce::Array<juce::var> tagArray;
+            for (const auto& tag : tags)
+                tagArray.add (tag);
+            object->setProperty ("tags", tagArray);
+        }
+        
+        if (item.hasProperty (anchorTimeId))
+            object->setProperty ("anchor", item[anchorTimeId]);
+        
+        if (numWritten > 0)
+            out << ",\n";
+        
+        out << "  ";
+        juce::JSON::writeToStream (out, juce::var (object.release()), true);
+    }
+    else
+    {
+        out << (checked ? "x" : "") << ","
+            << quoteCsvField (text) << ","
+            << priorityToString (priority) << ","
+            << (dueDate != 0 ? dateToString (dueDate) : juce::String()) << ","
+            << quoteCsvField (tags.joinIntoString (" ")) << ","
+            << (item.hasProperty (anchorTimeId) ? item[anchorTimeId].toString() : juce::String()) << "\n";
+    }
+    
+    ++numWritten;
+}
+
+void TodoTransfer::Writer::finish()
+{
+    if (format == Format::json)
+        out << (numWritten > 0 ? "\n]\n" : "]\n");
+    
+    out.flush();
+}
+
+//==============================================================================
+TodoTransfer::Reader::Reader (juce::InputStream& sourceStream, Format formatToRead)
+    : in (sourceStream, inputBufferSize),
+      format (formatToRead),
+      totalLength (sourceStream.getTotalLength())
+{
+}
+
+float TodoTransfer::Reader::getProgress() const
+{
+    if (totalLength <= 0)
+        return -1.0f;
+    
+    return juce::jlimit (0.0f, 1.0f, (float) ((double) in.getPosition() / (double) totalLength));
+}
+
+bool TodoTransfer::Reader::readNext (juce::ValueTree& item)
+{
+    item = juce::ValueTree (todoItemId);
+    
+    switch (format)
+    {
+        case Format::json:  return readJsonItem (item);
+        case Format::csv:   return readCsvItem (item);
+        default:            return readMarkdownItem (item);
+    }
+}
+
+juce::String TodoTransfer::Reader::readLine()
+{
+    // Ends at "\n", "\r\n" or a lone "\r" (classic Mac OS files), which
+    // BufferedInputStream::readNextLine wouldn't split on
+    juce::MemoryOutputStream line;
+    
+    while (! in.isExhausted())
+    {
+        auto c = in.readByte();
+        if (c == '\n')
+            break;
+        
+        if (c == '\r')
+        {
+            if (! in.isExhausted() && in.peekByte() == '\n')
+                in.readByte();
+            
+            break;
+        }
+        
+        line.writeByte (c);
+    }
+    
+    return line.toUTF8();
+}
+
+bool TodoTransfer::Reader::readMarkdownItem (juce::ValueTree& item)
+{
+    while (! in.isExhausted())
+    {
+        auto line = readLine().trim();
+        
+        if (! (line.startsWith ("- ") || line.startsWith ("* ") || line.startsWith ("+ ")))
+            continue;
+        
+        auto body = line.substring (2).trimStart();
+        auto checked = false;
+        
+        if (body.startsWithIgnoreCase ("[x]"))
+        {
+            checked = true;
+            body = body.substring (3);
+        }
+        else if (body.startsWith ("[ ]") || body.startsWith ("[]"))
+        {
+            body = body.fromFirstOccurrenceOf ("]", false, false);
+        }
+        
+        // Metadata is read from the end, the first word that isn't any ends it
+        auto words = juce::StringArray::fromTokens (body, " \t", "");
+        words.removeEmptyStrings();
+        
+        juce::StringArray tags;
+        while (! words.isEmpty())
+        {
+            const auto& word = words[words.size() - 1];
+            
+            if (! isMarkdownMetadata (word))
+            {
+                // The writer escapes a last word of the text that would look like metadata
+                if (word.startsWithChar ('\\'))
+                    words.set (words.size() - 1, word.substring (1));
+                
+                break;
+            }
+            
+            if (word.startsWithChar ('#'))
+                tags.insert (0, word.substring (1));
+            else if (word.startsWithChar ('!'))
+                item.setProperty (priorityId, priorityFromString (word.substring (1)), nullptr);
+            else
+                item.setProperty (dueDateId, dateFromString (word.substring (4)), nullptr);
+            
+            words.remove (words.size() - 1);
+        }
+        
+        auto text = words.joinIntoString (" ");
+        if (text.isEmpty())
+            continue;
+        
+        item.setProperty (textId, text, nullptr);
+        item.setProperty (checkedId, checked, nullptr);
+        setTags (item, tags);
+        return true;
+    }
+    
+    return false;
+}
+
+bool TodoTransfer::Reader::readJsonItem (juce::ValueTree& item)
+{
+    // Skips to the array the first time, wherever it is, e.g. {"todos": [ ... ]}
+    if (! inJsonArray)
+    {
+        while (! in.isExhausted() && in.readByte() != '[')
+            ;
+        
+        inJsonArray = true;
+    }
+    
+    while (! in.isExhausted())
+    {
+        // Cut out the next top-level object by tracking braces outside of strings
+        char c = 0;
+        while (! in.isExhausted() && (c = in.readByte()) != '{')
+            if (c == ']')
+                return false;
+        
+        if (c != '{')
+            return false;
+        
+        juce::MemoryOutputStream objectText;
+        objectText.writeByte ('{');
+        
+        int depth = 1;
+        bool inString = false, escaped = false;
+        
+        while (depth > 0 && ! in.isExhausted())
+        {
+            c = in.readByte();
+            objectText.writeByte (c);
+            
+            if (inString)
+            {
+                if (escaped)            escaped = false;
+                else if (c == '\\')     escaped = true;
+                else if (c == '"')      inString = false;
+            }
+            else if (c == '"')          inString = true;
+            else if (c == '{')          ++depth;
+            else if (c == '}')          --depth;
+        }
+        
+        if (depth > 0)
+            return false;
+        
+        auto object = juce::JSON::parse (objectText.toUTF8());
+        if (! object.isObject())
+            continue;
+        
+        auto text = object.getProperty ("text", object.getProperty ("title", {})).toString().trim();
+        if (text.isEmpty())
+            continue;
+        
+        item.setProperty (textId, text, nullptr);
+        
+        auto done = object.getProperty ("done", object.getProperty ("completed", object.getProperty ("checked", false)));
+        item.setProperty (checkedId, done.isString() ? isTruthy (done.toString()) : static_cast<bool> (done), nullptr);
+        
+        auto priority = object.getProperty ("priority", {});
+        auto priorityValue = priority.isString() ? priorityFromString (priority.toString())
+                                                 : (priority.isVoid() ? -1 : juce::jlimit (0, 2, static_cast<int> (priority)));
+        if (priorityValue > 0)
+            item.setProperty (priorityId, priorityValue, nullptr);
+        
+        auto due = dateFromString (object.getProperty ("due", object.getProperty ("dueDate", {})).toString());
+        if (due != 0)
+            item.setProperty (dueDateId, due, nullptr);
+        
+        auto tags = object.getProperty ("tags", {});
+        juce::StringArray tagList;
+        if (auto* tagArray = tags.getArray())
+            for (const auto& tag : *tagArray)
+                tagList.add (tag.toString());
+        else
+            tagList = juce::StringArray::fromTokens (tags.toString(), ", ", "");
+        setTags (item, tagList);
+        
+        auto anchor = object.getProperty ("anchor", {});
+        if (! anchor.isVoid() && static_cast<double> (anchor) >= 0.0)
+            item.setProperty (anchorTimeId, static_cast<double> (anchor), nullptr);
+        
+        return true;
+    }
+    
+    return false;
+}
+
+bool TodoTransfer::Reader::readCsvRecord (juce::StringArray& fields)
+{
+    fields.clearQuick();
+    
+    if (in.isExhausted())
+        return false;
+    
+    juce::MemoryOutputStream field;
+    bool quoted = false;
+    
+    while (! in.isExhausted())
+    {
+        auto c = in.readByte();
+        
+        if (quoted)
+        {
+            if (c != '"')
+                field.writeByte (c);
+            else if (! in.isExhausted() && in.peekByte() == '"')
+                field.writeByte (in.readByte());
+            else
+                quoted = false;
+        }
+        else if (c == '"')
+        {
+            quoted = true;
+        }
+        else if (c == ',')
+        {
+            fields.add (field.toUTF8());
+            field.reset();
+        }
+        else if (c == '\n')
+        {
+            break;
+        }
+        else if (c != '\r')
+        {
+            field.writeByte (c);
+        }
+    }
+    
+    fields.add (field.toUTF8());
+    return true;
+}
+
+bool TodoTransfer::Reader::readCsvItem (juce::ValueTree& item)
+{
+    juce::StringArray fields;
+    
+    if (! hasCsvHeader)
+    {
+        if (! readCsvRecord (fields))
+            return false;
+        
+        for (const auto& name : fields)
+            csvColumns.add (name.trim().toLowerCase());
+        
+        hasCsvHeader = true;
+    }
+    
+    auto column = [this] (std::initializer_list<const char*> names)
+    {
+        for (auto* name : names)
+            if (auto index = csvColumns.indexOf (name); index >= 0)
+                return index;
+        
+        return -1;
+    };
+    
+    auto textColumn = column ({ "text", "title", "task", "todo" });
+    auto doneColumn = column ({ "done", "checked", "completed", "status" });
+    auto priorityColumn = column ({ "priority" });
+    auto dueColumn = column ({ "due", "due date", "duedate" });
+    auto tagsColumn = column ({ "tags" });
+    auto anchorColumn = column ({ "anchor" });
+    
+    if (textColumn < 0)
+        return false;
+    
+    while (readCsvRecord (fields))
+    {
+        auto text = fields[textColumn].trim();
+        if (text.isEmpty())
+            continue;
+        
+        item.setProperty (textId, text, nullptr);
+        item.setProperty (checkedId, doneColumn >= 0 && isTruthy (fields[doneColumn]), nullptr);
+        
+        if (auto priority = priorityColumn >= 0 ? priorityFromString (fields[priorityColumn]) : -1; priority > 0)
+            item.setProperty (priorityId, priority, nullptr);
+        
+        if (auto due = dueColumn >= 0 ? dateFromString (fields[dueColumn]) : 0; due != 0)
+            item.setProperty (dueDateId, due, nullptr);
+        
+        if (tagsColumn >= 0)
+            setTags (item, juce::StringArray::fromTokens (fields[tagsColumn], ", ", ""));
+        
+        if (anchorColumn >= 0 && fields[anchorColumn].trim().isNotEmpty())
+            item.setProperty (anchorTimeId, juce::jmax (0.0, fields[anchorColumn].getDoubleValue()), nullptr);
+        
+        return true;
+    }
+    
+    return false;
+}
+
+//==============================================================================
+TodoExportTask::TodoExportTask (const juce::ValueTree& items, const juce::File& fileToWrite, juce::Component* parent)
+    : juce::ThreadWithProgressWindow ("Exporting todos...", true, true, 10000, {}, parent),
+      todoItems (items),
+      file (fileToWrite)
+{
+}
+
+void TodoExportTask::run()
+{
+    juce::TemporaryFile temp (file);
+    
+    {
+        juce::FileOutputStream out (temp.getFile());
+        if (out.failedToOpen())
+            return;
+        
+        TodoTransfer::Writer writer (out, TodoTransfer::getFormatForFile (file));
+        auto numItems = todoItems.getNumChildren();
+        
+        for (int i = 0; i < numItems; ++i)
+        {
+            if (threadShouldExit())
+                return;
+            
+            writer.writeItem (todoItems.getChild (i));
+            
+            if ((i & 255) == 0)
+                setProgress ((double) i / (double) numItems);
+        }
+        
+        writer.finish();
+        if (out.getStatus().failed())
+            return;
+    }
+    
+    succeeded = temp.overwriteTargetFileWithTemporary();
+}
+
+void TodoExportTask::threadComplete (bool userPressedCancel)
+{
+    // Copied first, the callback may delete this task
+    auto callback = onFinished;
+    if (callback != nullptr)
+        callback (! userPressedCancel && succeeded.load(), userPressedCancel);
+}
+
+//==============================================================================
+TodoImportTask::TodoImportTask (const juce::File& fileToRead, juce::Component* parent)
+    : juce::ThreadWithProgressWindow ("Importing todos...", true, true, 10000, {}, parent),
+      file (fileToRead)
+{
+}
+
+TodoImportTask::~TodoImportTask()
+{
+    // Stopped before the AsyncUpdater base goes, the thread may still be triggering it
+    stopThread (10000);
+    cancelPendingUpdate();
+}
+
+bool TodoImportTask::pushBatch (std::vector<juce::ValueTree>& batch)
+{
+    // Holds the reader back while the message thread catches up
+    for (;;)
+    {
+        if (threadShouldExit())
+            return false;
+        
+        {
+            const juce::ScopedLock sl (batchLock);
+            if ((int) pendingBatches.size() < maxPendingBatches)
+            {
+                pendingBatches.push_back (std::move (batch));
+                break;
+            }
+        }
+        
+        wait (20);
+    }
+    
+    batch = {};
+    batch.reserve ((size_t) batchSize);
+    triggerAsyncUpdate();
+    return true;
+}
+
+void TodoImportTask::run()
+{
+    juce::FileInputStream source (file);
+    if (source.failedToOpen())
+        return;
+    
+    TodoTransfer::Reader reader (source, TodoTransfer::getFormatForFile (file));
+    std::vector<juce::ValueTree> batch;
+    batch.reserve ((size_t) batchSize);
+    
+    juce::ValueTree item;
+    while (! threadShouldExit() && reader.readNext (item))
+    {
+        batch.push_back (std::move (item));
+        
+        if ((int) batch.size() >= batchSize)
+        {
+            if (! pushBatch (batch))
+                return;
+            
+            setProgress (reader.getProgress());
+        }
+    }
+    
+    if (! batch.empty())
+        pushBatch (batch);
+}
+
+void TodoImportTask::threadComplete (bool userPressedCancel)
+{
+    {
+        const juce::ScopedLock sl (batchLock);
+        finished = true;
+        cancelled = userPressedCancel;
+        
+        // Nothing more is taken after a cancel
+        if (cancelled)
+            pendingBatches.clear();
+    }
+    
+    handleAsyncUpdate();
+}
+
+void TodoImportTask::handleAsyncUpdate()
+{
+    std::vector<juce::ValueTree> batch;
+    bool done = false, hasBatch = false;
+    
+    {
+        const juce::ScopedLock sl (batchLock);
+        
+        if (! pendingBatches.empty())
+        {
+            batch = std::move (pendingBatches.front());
+            pendingBatches.pop_front();
+            hasBatch = true;
+        }
+        
+        done = finished && pendingBatches.empty();
+    }
+    
+    if (hasBatch && onItems != nullptr)
+        onItems (batch);
+    
+    if (done && ! hasBatch)
+    {
+        // Copied first, the callback may delete this task
+        auto callback = onFinished;
+        if (callback != nullptr)
+            callback (cancelled);
+        return;
+    }
+    
+    // One batch per pass, so the editor repaints and stays responsive in between
+    if (hasBatch)
+        triggerAsyncUpdate();
+}
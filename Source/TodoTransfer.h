@@ -0,0 +1,159 @@
+/*
+  ==============================================================================
+
+    Todo list import and export as Markdown, JSON or CSV, streamed one item
+    at a time on a background thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <deque>
+#include <vector>
+
+//==============================================================================
+/**
+ * Streaming readers and writers for todo lists, working on "TodoItem" nodes as
+ * stored in the state: "Text", "Checked", "Priority" (0 low, 1 medium, 2 high),
+ * "DueDate" (milliseconds since the epoch), "Tags" (space separated) and
+ * "AnchorTime" (seconds).
+ *
+ * Markdown   - [x] Fix the vocal edit !high due:2024-05-01 #mix #vocals
+ *            Lines that aren't list items are skipped. Plain "- " bullets are
+ *            read as open todos.
+ * JSON       an array of objects: text, done, priority, due, tags, anchor.
+ *            Objects are cut out of the stream one at a time and only those are
+ *            parsed, the array itself is never built.
+ * CSV        a header row naming the columns (Done, Text, Priority, Due, Tags,
+ *            Anchor, in any order), quoted as in RFC 4180.
+ *
+ * Neither side holds more than the current item.
+ */
+class TodoTransfer
+{
+public:
+    enum class Format { markdown, json, csv };
+    
+    // By extension: .json, .csv, anything else is Markdown
+    static Format getFormatForFile (const juce::File& file);
+    
+    //==============================================================================
+    class Writer
+    {
+    public:
+        Writer (juce::OutputStream& out, Format format);
+        
+        void writeItem (const juce::ValueTree& item);
+        void finish();
+        
+    private:
+        juce::OutputStream& out;
+        Format format;
+        int numWritten = 0;
+        
+        JUCE_DECLARE_NON_COPYABLE (Writer)
+    };
+    
+    //==============================================================================
+    class Reader
+    {
+    public:
+        Reader (juce::InputStream& source, Format format);
+        
+        // Fills in a new "TodoItem" node, returns false once the input is used up
+        bool readNext (juce::ValueTree& item);
+        
+        float getProgress() const;
+        
+    private:
+        juce::BufferedInputStream in;
+        Format format;
+        juce::int64 totalLength;
+        
+        juce::StringArray csvColumns; // lower-cased names from the header row
+        bool hasCsvHeader = false;
+        bool inJsonArray = false;
+        
+        bool readMarkdownItem (juce::ValueTree& item);
+        bool readJsonItem (juce::ValueTree& item);
+        bool readCsvItem (juce::ValueTree& item);
+        
+        juce::String readLine();
+        bool readCsvRecord (juce::StringArray& fields);
+        
+        JUCE_DECLARE_NON_COPYABLE (Reader)
+    };
+    
+    //==============================================================================
+    static juce::String priorityToString (int priority);
+    static int priorityFromString (const juce::String& text); // -1 if it isn't one
+    static juce::String dateToString (juce::int64 milliseconds);
+    static juce::int64 dateFromString (const juce::String& text); // 0 if it isn't a date
+};
+
+//==============================================================================
+/**
+ * Writes a todo list to a file on a background thread, behind a progress window
+ * with a Cancel button. The list is a snapshot that nothing modifies, so it is
+ * read in place. Output goes to a temporary file that only replaces the target
+ * once everything was written, so cancelling leaves the target as it was.
+ */
+class TodoExportTask : public juce::ThreadWithProgressWindow
+{
+public:
+    TodoExportTask (const juce::ValueTree& todoItems, const juce::File& file, juce::Component* parent);
+    
+    // Message thread, when the thread has finished. The task may be deleted from here.
+    std::function<void (bool succeeded, bool cancelled)> onFinished;
+    
+    void run() override;
+    void threadComplete (bool userPressedCancel) override;
+    
+private:
+    juce::ValueTree todoItems;
+    juce::File file;
+    std::atomic<bool> succeeded { false };
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TodoExportTask)
+};
+
+//==============================================================================
+/**
+ * Reads a todo list on a background thread and hands the items to the message
+ * thread in batches as they are parsed, so the list fills in while the import
+ * runs. At most maxPendingBatches wait to be taken, the reader holds off beyond
+ * that, so memory stays bounded however long the file is.
+ */
+class TodoImportTask : public juce::ThreadWithProgressWindow,
+                       private juce::AsyncUpdater
+{
+public:
+    static constexpr int batchSize = 1000;
+    static constexpr int maxPendingBatches = 4;
+    
+    TodoImportTask (const juce::File& file, juce::Component* parent);
+    ~TodoImportTask() override;
+    
+    // Message thread, one batch per message loop pass
+    std::function<void (const std::vector<juce::ValueTree>& items)> onItems;
+    
+    // Message thread, after the last batch. The task may be deleted from here.
+    std::function<void (bool cancelled)> onFinished;
+    
+    void run() override;
+    void threadComplete (bool userPressedCancel) override;
+    
+private:
+    juce::File file;
+    
+    juce::CriticalSection batchLock;
+    std::deque<std::vector<juce::ValueTree>> pendingBatches;
+    bool finished = false, cancelled = false;
+    
+    bool pushBatch (std::vector<juce::ValueTree>& batch);
+    void handleAsyncUpdate() override;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TodoImportTask)
+};
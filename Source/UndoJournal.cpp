@@ -0,0 +1,269 @@
+/*
+  ==============================================================================
+
+    Plugin-local undo and redo for the notes and the todo list.
+
+  ==============================================================================
+*/
+
+#include "UndoJournal.h"
+
+//==============================================================================
+size_t UndoJournal::getTreeSize (const juce::ValueTree& tree)
+{
+    if (! tree.isValid())
+        return 0;
+    
+    size_t size = sizeof (juce::ValueTree) + 64;
+    for (int i = 0; i < tree.getNumProperties(); ++i)
+        size += 32 + tree[tree.getPropertyName (i)].toString().getNumBytesAsUTF8();
+    
+    return size;
+}
+
+size_t UndoJournal::Edit::getSize() const
+{
+    return sizeof (Edit) + removed.getNumBytesAsUTF8() + inserted.getNumBytesAsUTF8()
+         + getTreeSize (before) + getTreeSize (after);
+}
+
+//==============================================================================
+UndoJournal::UndoJournal (Target& targetToUse)
+    : target (targetToUse)
+{
+}
+
+void UndoJournal::recordNotesEdit (int position, const juce::String& removed, const juce::String& inserted)
+{
+    if (removed.isEmpty() && inserted.isEmpty())
+        return;
+    
+    Edit edit;
+    edit.type = Type::notes;
+    edit.position = position;
+    edit.removed = removed;
+    edit.inserted = inserted;
+    record (std::move (edit));
+}
+
+void UndoJournal::recordTodoAdded (int index, const juce::ValueTree& item)
+{
+    Edit edit;
+    edit.type = Type::todoAdd;
+    edit.position = index;
+    edit.after = item;
+    record (std::move (edit));
+    closeGroup();
+}
+
+void UndoJournal::recordTodoRemoved (int index, const juce::ValueTree& item)
+{
+    Edit edit;
+    edit.type = Type::todoRemove;
+    edit.position = index;
+    edit.before = item;
+    record (std::move (edit));
+    closeGroup();
+}
+
+void UndoJournal::recordTodoMoved (int fromIndex, int toIndex)
+{
+    if (fromIndex == toIndex)
+        return;
+    
+    Edit edit;
+    edit.type = Type::todoMove;
+    edit.position = fromIndex;
+    edit.toPosition = toIndex;
+    record (std::move (edit));
+    closeGroup();
+}
+
+void UndoJournal::recordTodoChanged (const juce::ValueTree& before, const juce::ValueTree& after)
+{
+    if (before.isEquivalentTo (after))
+        return;
+    
+    Edit edit;
+    edit.type = Type::todoChange;
+    edit.before = before;
+    edit.after = after;
+    record (std::move (edit));
+    closeGroup();
+}
+
+//==============================================================================
+bool UndoJournal::coalesce (const Edit& edit)
+{
+    auto now = juce::Time::getApproximateMillisecondCounter();
+    bool recent = now - lastRecordTime < groupIntervalMs;
+    lastRecordTime = now;
+    
+    if (! groupOpen || ! recent || undoSteps.empty() || edit.type != Type::notes)
+        return false;
+    
+    auto& step = undoSteps.back();
+    auto& last = step.edits.back();
+    if (last.type != Type::notes)
+        return false;
+    
+    auto sizeBefore = last.getSize();
+    
+    // Typing: one more character straight after the previous insert. A space after a
+    // word, or anything after a newline, starts the next step.
+    if (edit.removed.isEmpty() && edit.inserted.length() == 1 && edit.inserted != "\n"
+        && edit.position == last.position + last.inserted.length() && last.inserted.isNotEmpty()
+        && ! last.inserted.endsWithChar ('\n')
+        && ! (juce::CharacterFunctions::isWhitespace (edit.inserted[0])
+              && ! juce::CharacterFunctions::isWhitespace (last.inserted.getLastCharacter())))
+    {
+        last.inserted += edit.inserted;
+    }
+    // Backspace: one more character just before the previous removal
+    else if (edit.inserted.isEmpty() && last.inserted.isEmpty() && edit.removed.length() == 1
+             && edit.position + 1 == last.position && edit.removed != "\n")
+    {
+        last.removed = edit.removed + last.removed;
+        last.position = edit.position;
+    }
+    // Forward delete: one more character at the same place
+    else if (edit.inserted.isEmpty() && last.inserted.isEmpty() && edit.removed.length() == 1
+             && edit.position == last.position && edit.removed != "\n")
+    {
+        last.removed += edit.removed;
+    }
+    else
+    {
+        return false;
+    }
+    
+    auto sizeAfter = last.getSize();
+    step.bytes += sizeAfter - sizeBefore;
+    memoryUsage += sizeAfter - sizeBefore;
+    return true;
+}
+
+void UndoJournal::record (Edit edit)
+{
+    if (isApplying)
+        return;
+    
+    clearRedo();
+    
+    if (! coalesce (edit))
+    {
+        undoSteps.emplace_back();
+        auto& step = undoSteps.back();
+        step.bytes = edit.getSize();
+        step.edits.push_back (std::move (edit));
+        memoryUsage += step.bytes;
+        groupOpen = true;
+    }
+    
+    evict();
+}
+
+void UndoJournal::apply (const Edit& edit, bool forwards)
+{
+    switch (edit.type)
+    {
+        case Type::notes:
+            if (forwards)
+                target.applyNotesEdit (edit.position, edit.removed.length(), edit.inserted);
+            else
+                target.applyNotesEdit (edit.position, edit.inserted.length(), edit.removed);
+            break;
+        
+        case Type::todoAdd:
+            if (forwards)
+                target.applyTodoInsert (edit.position, edit.after);
+            else
+                target.applyTodoRemove (edit.position);
+            break;
+        
+        case Type::todoRemove:
+            if (forwards)
+                target.applyTodoRemove (edit.position);
+            else
+                target.applyTodoInsert (edit.position, edit.before);
+            break;
+        
+        case Type::todoMove:
+            if (forwards)
+                target.applyTodoMove (edit.position, edit.toPosition);
+            else
+                target.applyTodoMove (edit.toPosition, edit.position);
+            break;
+        
+        case Type::todoChange:
+            target.applyTodoChange (forwards ? edit.after : edit.before);
+            break;
+    }
+}
+
+bool UndoJournal::undo()
+{
+    if (undoSteps.empty())
+        return false;
+    
+    auto step = std::move (undoSteps.back());
+    undoSteps.pop_back();
+    
+    const juce::ScopedValueSetter<bool> applying (isApplying, true);
+    for (auto edit = step.edits.rbegin(); edit != step.edits.rend(); ++edit)
+        apply (*edit, false);
+    
+    redoSteps.push_back (std::move (step));
+    closeGroup();
+    return true;
+}
+
+bool UndoJournal::redo()
+{
+    if (redoSteps.empty())
+        return false;
+    
+    auto step = std::move (redoSteps.back());
+    redoSteps.pop_back();
+    
+    const juce::ScopedValueSetter<bool> applying (isApplying, true);
+    for (const auto& edit : step.edits)
+        apply (edit, true);
+    
+    undoSteps.push_back (std::move (step));
+    closeGroup();
+    return true;
+}
+
+//==============================================================================
+void UndoJournal::clear()
+{
+    undoSteps.clear();
+    redoSteps.clear();
+    memoryUsage = 0;
+    closeGroup();
+}
+
+void UndoJournal::clearRedo()
+{
+    for (const auto& step : redoSteps)
+        memoryUsage -= step.bytes;
+    
+    redoSteps.clear();
+}
+
+void UndoJournal::setMemoryLimit (size_t newLimitBytes)
+{
+    memoryLimit = newLimitBytes;
+    evict();
+}
+
+void UndoJournal::evict()
+{
+    // Oldest first, and never the step just recorded
+    while (memoryUsage > memoryLimit && undoSteps.size() > 1)
+    {
+        memoryUsage -= undoSteps.front().bytes;
+        undoSteps.pop_front();
+    }
+}
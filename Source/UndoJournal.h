@@ -0,0 +1,110 @@
+/*
+  ==============================================================================
+
+    Plugin-local undo and redo for the notes and the todo list.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <deque>
+#include <vector>
+
+//==============================================================================
+/**
+ * Undo history kept inside the plugin, so the host's undo stays for audio edits.
+ *
+ * Each step holds the edits it undoes as deltas: the replaced and inserted text
+ * of a notes edit, or the todo node that was added, removed, moved or changed.
+ * Undo and redo replay those deltas through the Target, so their cost follows
+ * the size of the edit rather than the size of the notes or the list.
+ *
+ * Typing is coalesced: characters typed (or backspaced) one after another join
+ * the current step until a word ends, a line ends, the caret moves or the user
+ * pauses. The whole history is held under a memory limit, the oldest steps are
+ * dropped first. The latest step is always kept, however big, so an accidental
+ * select-all and delete can still be taken back.
+ */
+class UndoJournal
+{
+public:
+    // Applies edits during undo and redo. Nothing applied here is recorded again.
+    struct Target
+    {
+        virtual ~Target() = default;
+        
+        virtual void applyNotesEdit (int position, int lengthToRemove, const juce::String& textToInsert) = 0;
+        virtual void applyTodoInsert (int index, const juce::ValueTree& item) = 0;
+        virtual void applyTodoRemove (int index) = 0;
+        virtual void applyTodoMove (int fromIndex, int toIndex) = 0;
+        virtual void applyTodoChange (const juce::ValueTree& item) = 0; // matched by its "Id"
+    };
+    
+    static constexpr size_t defaultMemoryLimit = 32 * 1024 * 1024;
+    static constexpr juce::uint32 groupIntervalMs = 1000;
+    
+    explicit UndoJournal (Target& targetToUse);
+    
+    //==============================================================================
+    void recordNotesEdit (int position, const juce::String& removed, const juce::String& inserted);
+    void recordTodoAdded (int index, const juce::ValueTree& item);
+    void recordTodoRemoved (int index, const juce::ValueTree& item);
+    void recordTodoMoved (int fromIndex, int toIndex);
+    void recordTodoChanged (const juce::ValueTree& before, const juce::ValueTree& after);
+    
+    // The next edit starts a new step, e.g. after the caret was moved
+    void closeGroup() { groupOpen = false; }
+    
+    bool canUndo() const { return ! undoSteps.empty(); }
+    bool canRedo() const { return ! redoSteps.empty(); }
+    bool undo();
+    bool redo();
+    
+    void clear();
+    
+    void setMemoryLimit (size_t newLimitBytes);
+    size_t getMemoryLimit() const { return memoryLimit; }
+    size_t getMemoryUsage() const { return memoryUsage; }
+    int getNumUndoSteps() const { return (int) undoSteps.size(); }
+    
+private:
+    enum class Type { notes, todoAdd, todoRemove, todoMove, todoChange };
+    
+    struct Edit
+    {
+        Type type = Type::notes;
+        int position = 0;   // notes position, or todo index
+        int toPosition = 0; // todo moves only
+        juce::String removed, inserted;
+        juce::ValueTree before, after;
+        
+        size_t getSize() const;
+    };
+    
+    struct Step
+    {
+        std::vector<Edit> edits;
+        size_t bytes = 0;
+    };
+    
+    Target& target;
+    std::deque<Step> undoSteps, redoSteps;
+    size_t memoryUsage = 0;
+    size_t memoryLimit = defaultMemoryLimit;
+    
+    bool groupOpen = false;
+    juce::uint32 lastRecordTime = 0;
+    bool isApplying = false;
+    
+    void record (Edit edit);
+    bool coalesce (const Edit& edit);
+    void apply (const Edit& edit, bool forwards);
+    void clearRedo();
+    void evict();
+    
+    static size_t getTreeSize (const juce::ValueTree& tree);
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (UndoJournal)
+};